@@ -0,0 +1,160 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+
+#include "base58.h"
+#include "chain.h"
+#include "hash.h"
+#include "main.h"
+#include "script/script.h"
+#include "script/standard.h"
+#include "undo.h"
+#include "util.h"
+#include "utilstrencodings.h"
+
+#include <boost/scoped_ptr.hpp>
+
+using namespace std;
+
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_BEST_BLOCK = 'B';
+
+CAddressIndexer* paddressindexer = NULL;
+
+static uint160 GetScriptHash(const CScript& scriptPubKey)
+{
+    return Hash160(scriptPubKey.begin(), scriptPubKey.end());
+}
+
+CAddressIndexDB::CAddressIndexDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "addressindex", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CAddressIndexDB::WriteBatch(const std::vector<CAddressIndexEntry>& vAdd, const std::vector<CAddressIndexKey>& vErase, const CBlockLocator& locator)
+{
+    CDBBatch batch(&GetObfuscateKey());
+    for (std::vector<CAddressIndexKey>::const_iterator it = vErase.begin(); it != vErase.end(); it++)
+        batch.Erase(make_pair(DB_ADDRESSINDEX, *it));
+    for (std::vector<CAddressIndexEntry>::const_iterator it = vAdd.begin(); it != vAdd.end(); it++)
+        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    batch.Write(DB_BEST_BLOCK, locator);
+    return CDBWrapper::WriteBatch(batch);
+}
+
+bool CAddressIndexDB::ReadBestBlock(CBlockLocator& locator)
+{
+    return Read(DB_BEST_BLOCK, locator);
+}
+
+bool CAddressIndexDB::ReadHistory(const uint160& hashScript, size_t nSkip, size_t nCount, std::vector<CAddressIndexEntry>& vEntries)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(NewLookupIterator());
+    pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexKey(hashScript, 0, uint256(), 0, false)));
+    for (; pcursor->Valid() && vEntries.size() < nCount; pcursor->Next()) {
+        std::pair<char, CAddressIndexKey> key;
+        if (!pcursor->GetKey(key) || key.first != DB_ADDRESSINDEX || key.second.hashScript != hashScript)
+            break;
+        if (nSkip > 0) {
+            nSkip--;
+            continue;
+        }
+        CAddressIndexValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read entry", __func__);
+        vEntries.push_back(make_pair(key.second, value));
+    }
+    return true;
+}
+
+CAddressIndexer::CAddressIndexer(const CChainParams& chainparamsIn, size_t nCacheSize, bool fMemory, bool fWipe) :
+    CChainIndexer(chainparamsIn), db(nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CAddressIndexer::GetEntries(const CBlockIndex* pindex, const CBlock& block, std::vector<CAddressIndexEntry>& vEntries)
+{
+    CBlockUndo blockundo;
+    if (block.vtx.size() > 1) {
+        CDiskBlockPos pos;
+        {
+            LOCK(cs_main);
+            pos = pindex->GetUndoPos();
+        }
+        if (pos.IsNull() || !UndoReadFromDisk(blockundo, pos, pindex->pprev->GetBlockHash()))
+            return error("%s: no undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size())
+            return error("%s: undo data doesn't match block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction& tx = block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (i > 0) {
+            const CTxUndo& txundo = blockundo.vtxundo[i - 1];
+            if (txundo.vprevout.size() != tx.vin.size())
+                return error("%s: undo data doesn't match transaction %s", __func__, txid.ToString());
+            for (unsigned int j = 0; j < tx.vin.size(); j++) {
+                const CTxOut& txout = txundo.vprevout[j].txout;
+                vEntries.push_back(make_pair(CAddressIndexKey(GetScriptHash(txout.scriptPubKey), pindex->nHeight, txid, j, true),
+                                             CAddressIndexValue(txout.nValue, tx.vin[j].prevout)));
+            }
+        }
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            const CTxOut& txout = tx.vout[j];
+            vEntries.push_back(make_pair(CAddressIndexKey(GetScriptHash(txout.scriptPubKey), pindex->nHeight, txid, j, false),
+                                         CAddressIndexValue(txout.nValue, COutPoint())));
+        }
+    }
+    return true;
+}
+
+bool CAddressIndexer::AddBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    std::vector<CAddressIndexEntry> vEntries;
+    if (!GetEntries(pindex, block, vEntries))
+        return false;
+    vAdd.insert(vAdd.end(), vEntries.begin(), vEntries.end());
+    return true;
+}
+
+bool CAddressIndexer::RemoveBlock(const CBlockIndex* pindex)
+{
+    CBlock block;
+    std::vector<CAddressIndexEntry> vEntries;
+    if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()) || !GetEntries(pindex, block, vEntries))
+        return false;
+    for (std::vector<CAddressIndexEntry>::const_iterator it = vEntries.begin(); it != vEntries.end(); it++)
+        vErase.push_back(it->first);
+    return true;
+}
+
+bool CAddressIndexer::WriteBatch(const CBlockLocator& locator)
+{
+    if (!db.WriteBatch(vAdd, vErase, locator))
+        return false;
+    vAdd.clear();
+    vErase.clear();
+    return true;
+}
+
+bool CAddressIndexer::ReadHistory(const CScript& scriptPubKey, size_t nSkip, size_t nCount, std::vector<CAddressIndexEntry>& vEntries)
+{
+    return db.ReadHistory(GetScriptHash(scriptPubKey), nSkip, nCount, vEntries);
+}
+
+bool ParseAddressIndexScript(const std::string& str, CScript& scriptPubKey)
+{
+    CCrowcoinAddress address(str);
+    if (address.IsValid()) {
+        scriptPubKey = GetScriptForDestination(address.Get());
+        return true;
+    }
+    if (!str.empty() && IsHex(str)) {
+        std::vector<unsigned char> data(ParseHex(str));
+        scriptPubKey = CScript(data.begin(), data.end());
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,158 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_ADDRESSINDEX_H
+#define CROWCOIN_ADDRESSINDEX_H
+
+#include "amount.h"
+#include "chainindexer.h"
+#include "crypto/common.h"
+#include "dbwrapper.h"
+#include "primitives/transaction.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+class CScript;
+
+static const bool DEFAULT_ADDRESSINDEX = false;
+
+/** Number of entries the address indexer collects before writing them out */
+static const unsigned int ADDRESSINDEX_BATCH_SIZE = 50000;
+
+/** Most entries returned by one address history lookup */
+static const unsigned int MAX_ADDRESS_HISTORY_ENTRIES = 1000;
+
+/**
+ * Key of an address index entry: an output paying to a script (funding),
+ * or an input spending one (spending). The height and the output or input
+ * index are serialized big-endian, so the entries for a script are sorted
+ * by height in the database.
+ */
+struct CAddressIndexKey
+{
+    //! Hash160 of the scriptPubKey
+    uint160 hashScript;
+    int nHeight;
+    uint256 txid;
+    //! The output index for funding entries, the input index for spending ones
+    uint32_t nIndex;
+    bool fSpending;
+
+    CAddressIndexKey() : nHeight(0), nIndex(0), fSpending(false) {}
+    CAddressIndexKey(const uint160& hashScriptIn, int nHeightIn, const uint256& txidIn, uint32_t nIndexIn, bool fSpendingIn) :
+        hashScript(hashScriptIn), nHeight(nHeightIn), txid(txidIn), nIndex(nIndexIn), fSpending(fSpendingIn) {}
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 20 + 4 + 32 + 4 + 1;
+    }
+
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[4];
+        hashScript.Serialize(s, nType, nVersion);
+        WriteBE32(buf, nHeight);
+        s.write((const char*)buf, 4);
+        txid.Serialize(s, nType, nVersion);
+        WriteBE32(buf, nIndex);
+        s.write((const char*)buf, 4);
+        ::Serialize(s, fSpending, nType, nVersion);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[4];
+        hashScript.Unserialize(s, nType, nVersion);
+        s.read((char*)buf, 4);
+        nHeight = ReadBE32(buf);
+        txid.Unserialize(s, nType, nVersion);
+        s.read((char*)buf, 4);
+        nIndex = ReadBE32(buf);
+        ::Unserialize(s, fSpending, nType, nVersion);
+    }
+};
+
+/** Value of an address index entry */
+struct CAddressIndexValue
+{
+    //! The value of the output paying to the script
+    CAmount nValue;
+    //! For spending entries, the output spent; null otherwise
+    COutPoint prevout;
+
+    CAddressIndexValue() : nValue(0) {}
+    CAddressIndexValue(CAmount nValueIn, const COutPoint& prevoutIn) : nValue(nValueIn), prevout(prevoutIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(nValue);
+        READWRITE(prevout);
+    }
+};
+
+typedef std::pair<CAddressIndexKey, CAddressIndexValue> CAddressIndexEntry;
+
+/** Access to the address index database (blocks/addressindex/) */
+class CAddressIndexDB : public CDBWrapper
+{
+public:
+    CAddressIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    bool WriteBatch(const std::vector<CAddressIndexEntry>& vAdd, const std::vector<CAddressIndexKey>& vErase, const CBlockLocator& locator);
+    bool ReadBestBlock(CBlockLocator& locator);
+
+    /**
+     * Read the entries for a script, oldest first: at most nCount of them,
+     * after skipping the first nSkip. Only the index is scanned.
+     */
+    bool ReadHistory(const uint160& hashScript, size_t nSkip, size_t nCount, std::vector<CAddressIndexEntry>& vEntries);
+};
+
+/**
+ * Builds the address index (-addressindex) in the background: an entry for
+ * every output paying to a script, and for every input spending one, keyed
+ * by the script's hash, the height and the transaction. The spent outputs
+ * come from the blocks' undo data. Entries for disconnected blocks are
+ * removed.
+ */
+class CAddressIndexer : public CChainIndexer
+{
+private:
+    CAddressIndexDB db;
+    std::vector<CAddressIndexEntry> vAdd;
+    std::vector<CAddressIndexKey> vErase;
+
+    bool GetEntries(const CBlockIndex* pindex, const CBlock& block, std::vector<CAddressIndexEntry>& vEntries);
+
+protected:
+    const char* GetName() const { return "addressindex"; }
+    bool ReadBestBlock(CBlockLocator& locator) { return db.ReadBestBlock(locator); }
+    bool AddBlock(const CBlock& block, const CBlockIndex* pindex);
+    bool RemoveBlock(const CBlockIndex* pindex);
+    size_t GetBatchSize() const { return vAdd.size() + vErase.size(); }
+    size_t GetMaxBatchSize() const { return ADDRESSINDEX_BATCH_SIZE; }
+    bool WriteBatch(const CBlockLocator& locator);
+
+public:
+    CAddressIndexer(const CChainParams& chainparamsIn, size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CAddressIndexer() { Stop(); }
+
+    bool ReadHistory(const CScript& scriptPubKey, size_t nSkip, size_t nCount, std::vector<CAddressIndexEntry>& vEntries);
+};
+
+/** The address indexer, if -addressindex is set */
+extern CAddressIndexer* paddressindexer;
+
+/** Parse an address, or a hex-encoded scriptPubKey, into the scriptPubKey to look up. */
+bool ParseAddressIndexScript(const std::string& str, CScript& scriptPubKey);
+
+#endif // CROWCOIN_ADDRESSINDEX_H
@@ -0,0 +1,190 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "consensus/consensus.h"
+#include "main.h"
+#include "miner.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include <iostream>
+#include <queue>
+#include <set>
+#include <vector>
+
+#include <boost/foreach.hpp>
+
+/*
+ * A full default-sized mempool of transactions spending coins outside of it,
+ * or outputs of other transactions in it, with fees all over the place.
+ * Transactions aren't checked on the way into the pool, so the inputs are
+ * made up.
+ */
+static CTxMemPool* CreateFullPool()
+{
+    CTxMemPool* pool = new CTxMemPool(CFeeRate(0));
+    seed_insecure_rand(true);
+    std::vector<uint256> vRecent;
+    std::set<COutPoint> setSpent;
+    const size_t nMaxUsage = DEFAULT_MAX_MEMPOOL_SIZE * 1000000;
+
+    LOCK(pool->cs);
+    while (pool->DynamicMemoryUsage() < nMaxUsage) {
+        CMutableTransaction tx;
+        tx.vin.resize(1 + insecure_rand() % 2);
+        for (unsigned int i = 0; i < tx.vin.size(); i++) {
+            // About a third of the inputs spend recent transactions in the pool,
+            // within the default ancestor and descendant limits
+            tx.vin[i].prevout = COutPoint(GetRandHash(), 0);
+            if (!vRecent.empty() && insecure_rand() % 3 == 0) {
+                CTxMemPool::txiter parent = pool->mapTx.find(vRecent[insecure_rand() % vRecent.size()]);
+                COutPoint prevout(parent->GetTx().GetHash(), insecure_rand() % 2);
+                if (parent->GetCountWithAncestors() < DEFAULT_ANCESTOR_LIMIT - 1 &&
+                    parent->GetCountWithDescendants() < DEFAULT_DESCENDANT_LIMIT - 1 &&
+                    setSpent.insert(prevout).second)
+                    tx.vin[i].prevout = prevout;
+            }
+            tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+        }
+        tx.vout.resize(2);
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            tx.vout[i].nValue = COIN;
+            tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        CAmount nFee = 1000 + insecure_rand() % 100000;
+        CTxMemPoolEntry entry(MakeTransactionRef(tx), nFee, 0, 0.0, 1, false, 0, false, tx.vin.size(), LockPoints());
+        pool->addUnchecked(tx.GetHash(), entry);
+
+        vRecent.push_back(tx.GetHash());
+        if (vRecent.size() > 1000)
+            vRecent.erase(vRecent.begin());
+    }
+    return pool;
+}
+
+static CTxMemPool* GetFullPool()
+{
+    static CTxMemPool* pool = NULL;
+    if (pool == NULL) {
+        int64_t nStart = GetTimeMillis();
+        pool = CreateFullPool();
+        std::cout << "Mempool of " << pool->size() << " transactions, " << pool->DynamicMemoryUsage() / 1000000 << " MB (" << GetTimeMillis() - nStart << " ms)\n";
+    }
+    return pool;
+}
+
+class ScoreCompare
+{
+public:
+    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b) const
+    {
+        return CompareTxMemPoolEntryByScore()(*b, *a); // Convert to less than
+    }
+};
+
+/**
+ * Fill a block the way the miner did before ancestor fee rates, to compare
+ * with: by each transaction's own fee rate, holding back transactions until
+ * their parents are in. The pool has no coin age priority to fill a priority
+ * part with. Returns the block's fees.
+ */
+static CAmount AssembleBlockByScore(CTxMemPool& pool, uint64_t& nBlockTx)
+{
+    const uint64_t nBlockMaxSize = DEFAULT_BLOCK_MAX_SIZE;
+    CTxMemPool::setEntries inBlock;
+    CTxMemPool::setEntries waitSet;
+    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
+    uint64_t nBlockSize = 1000;
+    unsigned int nBlockSigOps = 100;
+    int lastFewTxs = 0;
+    CAmount nFees = 0;
+    nBlockTx = 0;
+
+    CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = pool.mapTx.get<3>().begin();
+    while (mi != pool.mapTx.get<3>().end() || !clearedTxs.empty()) {
+        CTxMemPool::txiter iter;
+        if (clearedTxs.empty()) { // add tx with next highest score
+            iter = pool.mapTx.project<0>(mi);
+            mi++;
+        } else { // try to add a previously postponed child tx
+            iter = clearedTxs.top();
+            clearedTxs.pop();
+        }
+
+        bool fStillDependent = false;
+        BOOST_FOREACH(CTxMemPool::txiter parent, pool.GetMemPoolParents(iter))
+            fStillDependent |= !inBlock.count(parent);
+        if (fStillDependent) {
+            waitSet.insert(iter);
+            continue;
+        }
+
+        unsigned int nTxSize = iter->GetTxSize();
+        if (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize))
+            break;
+        if (nBlockSize + nTxSize >= nBlockMaxSize) {
+            if (nBlockSize > nBlockMaxSize - 100 || lastFewTxs > 50)
+                break;
+            // Once we're within 1000 bytes of a full block, only look at 50 more txs
+            if (nBlockSize > nBlockMaxSize - 1000)
+                lastFewTxs++;
+            continue;
+        }
+        if (nBlockSigOps + iter->GetSigOpCount() >= MAX_BLOCK_SIGOPS) {
+            if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2)
+                break;
+            continue;
+        }
+
+        nBlockSize += nTxSize;
+        nBlockSigOps += iter->GetSigOpCount();
+        nFees += iter->GetFee();
+        nBlockTx++;
+        inBlock.insert(iter);
+
+        BOOST_FOREACH(CTxMemPool::txiter child, pool.GetMemPoolChildren(iter)) {
+            if (waitSet.erase(child))
+                clearedTxs.push(child);
+        }
+    }
+    return nFees;
+}
+
+/** Fill a block from the pool, by ancestor fee rate or by each transaction's own. */
+static void AssembleBlock(benchmark::State& state, bool fPackages)
+{
+    CTxMemPool* pool = GetFullPool();
+    LOCK(pool->cs);
+
+    CAmount nFees = 0;
+    uint64_t nBlockTx = 0;
+    int64_t nBuilds = 0;
+    int64_t nStart = GetTimeMicros();
+    while (state.KeepRunning()) {
+        if (fPackages) {
+            CBlockTemplate blocktemplate;
+            BlockAssembler assembler(*pool, &blocktemplate, 1, 0);
+            assembler.AddPriorityTxs();
+            assembler.AddPackageTxs();
+            nFees = assembler.GetFees();
+            nBlockTx = assembler.GetBlockTx();
+        } else {
+            nFees = AssembleBlockByScore(*pool, nBlockTx);
+        }
+        nBuilds++;
+    }
+    int64_t nElapsed = GetTimeMicros() - nStart;
+
+    std::cout << (fPackages ? "AssembleBlock_Packages" : "AssembleBlock_Score") << ": " << nBlockTx << " txs, fees " << nFees
+              << ", " << nElapsed / 1000 / std::max(nBuilds, (int64_t)1) << " ms per block\n";
+}
+
+static void AssembleBlock_Packages(benchmark::State& state) { AssembleBlock(state, true); }
+static void AssembleBlock_Score(benchmark::State& state) { AssembleBlock(state, false); }
+
+BENCHMARK(AssembleBlock_Packages);
+BENCHMARK(AssembleBlock_Score);
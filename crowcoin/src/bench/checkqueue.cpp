@@ -0,0 +1,83 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string.h>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+/* A stand-in for a script check: a few microseconds of hashing. */
+struct BenchCheck
+{
+    unsigned char data[64];
+
+    BenchCheck() { memset(data, 0, sizeof(data)); }
+
+    bool operator()()
+    {
+        unsigned char hash[CSHA256::OUTPUT_SIZE];
+        for (int i = 0; i < 16; i++) {
+            CSHA256().Write(data, sizeof(data)).Finalize(hash);
+            memcpy(data, hash, sizeof(hash));
+        }
+        return true;
+    }
+
+    void swap(BenchCheck& check) { std::swap_ranges(data, data + sizeof(data), check.data); }
+};
+
+/* Checks per block, as a block with this many inputs would queue. */
+static const unsigned int BLOCK_CHECKS = 4000;
+
+/** Verify blocks' worth of checks with nThreads threads (the benchmark loop being the master). */
+static void CheckQueueThroughput(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<BenchCheck> queue(128, 64);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<BenchCheck>::Thread, &queue));
+
+    uint64_t nChecks = 0;
+    int64_t nStart = GetTimeMicros();
+    while (state.KeepRunning()) {
+        CCheckQueueControl<BenchCheck> control(&queue);
+        // Transactions mostly have one to three inputs.
+        for (unsigned int i = 0; i < BLOCK_CHECKS; ) {
+            std::vector<BenchCheck> vChecks(std::min(1 + i % 3, BLOCK_CHECKS - i));
+            i += vChecks.size();
+            control.Add(vChecks);
+        }
+        control.Wait();
+        nChecks += BLOCK_CHECKS;
+    }
+    int64_t nElapsed = std::max(GetTimeMicros() - nStart, (int64_t)1);
+    threads.interrupt_all();
+    threads.join_all();
+
+    std::cout << "CheckQueue_" << nThreads << "Threads: " << nChecks * 1000000.0 / nElapsed << " checks/s\n";
+}
+
+static void CheckQueue_1Thread(benchmark::State& state) { CheckQueueThroughput(state, 1); }
+static void CheckQueue_2Threads(benchmark::State& state) { CheckQueueThroughput(state, 2); }
+static void CheckQueue_4Threads(benchmark::State& state) { CheckQueueThroughput(state, 4); }
+static void CheckQueue_8Threads(benchmark::State& state) { CheckQueueThroughput(state, 8); }
+static void CheckQueue_16Threads(benchmark::State& state) { CheckQueueThroughput(state, 16); }
+static void CheckQueue_32Threads(benchmark::State& state) { CheckQueueThroughput(state, 32); }
+static void CheckQueue_64Threads(benchmark::State& state) { CheckQueueThroughput(state, 64); }
+
+BENCHMARK(CheckQueue_1Thread);
+BENCHMARK(CheckQueue_2Threads);
+BENCHMARK(CheckQueue_4Threads);
+BENCHMARK(CheckQueue_8Threads);
+BENCHMARK(CheckQueue_16Threads);
+BENCHMARK(CheckQueue_32Threads);
+BENCHMARK(CheckQueue_64Threads);
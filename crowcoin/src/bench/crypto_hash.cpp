@@ -0,0 +1,50 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <vector>
+
+#include "bench.h"
+#include "crypto/sha256.h"
+#include "hash.h"
+
+/* Number of bytes to hash per iteration */
+static const uint64_t BUFFER_SIZE = 1000*1000;
+
+static void SHA256(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        CSHA256().Write(begin_ptr(in), in.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32,0);
+    while (state.KeepRunning())
+        CSHA256().Write(begin_ptr(in), in.size()).Finalize(&in[0]);
+}
+
+static void SHA256D64_1024(benchmark::State& state)
+{
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(begin_ptr(in), begin_ptr(in), 1024);
+    }
+}
+
+static void SHA256D80Scan_4096(benchmark::State& state)
+{
+    std::vector<uint8_t> header(80, 0);
+    uint32_t nonce = 0;
+    while (state.KeepRunning()) {
+        SHA256D80Scan(begin_ptr(header), nonce, 4096);
+        ++nonce;
+    }
+}
+
+BENCHMARK(SHA256);
+BENCHMARK(SHA256_32b);
+BENCHMARK(SHA256D64_1024);
+BENCHMARK(SHA256D80Scan_4096);
@@ -0,0 +1,95 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "uint256.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> SigCacheType;
+
+/* Size of the cache, as with the default -maxsigcachesize */
+static const size_t CACHE_BYTES = DEFAULT_MAX_SIG_CACHE_SIZE * ((size_t)1 << 20);
+
+static void FillRandom(std::vector<uint256>& v)
+{
+    for (size_t i = 0; i < v.size(); i++) {
+        uint32_t* p = (uint32_t*)v[i].begin();
+        for (int j = 0; j < 8; j++)
+            p[j] = insecure_rand();
+    }
+}
+
+/** Look up a mix of present and absent entries until told to stop, like a script check thread would. */
+static void LookupLoop(const SigCacheType* cache, const std::vector<uint256>* keys, size_t offset, volatile bool* stop, uint64_t* lookups, uint64_t* hits)
+{
+    uint64_t n = 0, h = 0;
+    for (size_t i = offset; !*stop; i = (i + 1) % keys->size()) {
+        h += cache->contains((*keys)[i], false);
+        ++n;
+    }
+    *lookups = n;
+    *hits = h;
+}
+
+/** Run lookups on the given number of threads, with the benchmark loop as one of them. */
+static void CuckooCacheLookup(benchmark::State& state, int nThreads)
+{
+    seed_insecure_rand(true);
+    SigCacheType* cache = new SigCacheType();
+    uint32_t nElems = cache->setup_bytes(CACHE_BYTES);
+
+    // Fill the cache to 90%, and look up those entries interleaved with as many unknown ones.
+    std::vector<uint256> inserted(nElems * 9 / 10), keys(2 * inserted.size());
+    FillRandom(inserted);
+    for (size_t i = 0; i < inserted.size(); i++)
+        cache->insert(inserted[i]);
+    FillRandom(keys);
+    for (size_t i = 0; i < inserted.size(); i++)
+        keys[2 * i] = inserted[i];
+
+    volatile bool stop = false;
+    std::vector<uint64_t> lookups(nThreads, 0), hits(nThreads, 0);
+    boost::thread_group threads;
+    for (int t = 1; t < nThreads; t++)
+        threads.create_thread(boost::bind(&LookupLoop, cache, &keys, t * keys.size() / nThreads, &stop, &lookups[t], &hits[t]));
+
+    int64_t nStart = GetTimeMicros();
+    size_t i = 0;
+    while (state.KeepRunning()) {
+        hits[0] += cache->contains(keys[i], false);
+        ++lookups[0];
+        if (++i == keys.size())
+            i = 0;
+    }
+    stop = true;
+    threads.join_all();
+    int64_t nElapsed = std::max(GetTimeMicros() - nStart, (int64_t)1);
+
+    uint64_t nLookups = 0, nHits = 0;
+    for (int t = 0; t < nThreads; t++) {
+        nLookups += lookups[t];
+        nHits += hits[t];
+    }
+    std::cout << "CuckooCacheLookup_" << nThreads << "Threads: hit rate " << 100.0 * nHits / nLookups << "% (expected 50%), "
+              << nLookups * 1000000.0 / nElapsed << " lookups/s\n";
+    delete cache;
+}
+
+static void CuckooCacheLookup_1Thread(benchmark::State& state) { CuckooCacheLookup(state, 1); }
+static void CuckooCacheLookup_4Threads(benchmark::State& state) { CuckooCacheLookup(state, 4); }
+static void CuckooCacheLookup_16Threads(benchmark::State& state) { CuckooCacheLookup(state, 16); }
+
+BENCHMARK(CuckooCacheLookup_1Thread);
+BENCHMARK(CuckooCacheLookup_4Threads);
+BENCHMARK(CuckooCacheLookup_16Threads);
@@ -0,0 +1,113 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "main.h"
+#include "txmempool.h"
+
+#include <assert.h>
+#include <list>
+#include <limits>
+#include <vector>
+
+/* Transactions in a chain, as batched payouts chain them with a raised -limitancestorcount */
+static const unsigned int CHAIN_LENGTH = 1000;
+
+static CMutableTransaction Spend(const std::vector<COutPoint>& vPrevouts, unsigned int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(vPrevouts.size());
+    for (unsigned int i = 0; i < vPrevouts.size(); i++) {
+        tx.vin[i].prevout = vPrevouts[i];
+        tx.vin[i].scriptSig = CScript() << std::vector<unsigned char>(72) << std::vector<unsigned char>(33);
+    }
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = COIN;
+        tx.vout[i].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    }
+    return tx;
+}
+
+/** Accept a transaction the way AcceptToMemoryPool does: ancestors against the limits first. */
+static bool AddToPool(CTxMemPool& pool, const CTransaction& tx, uint64_t nLimitAncestors)
+{
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    CTxMemPoolEntry entry(MakeTransactionRef(tx), 1000, 0, 0.0, 1, false, 0, false, tx.vin.size(), LockPoints());
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nNoLimit, nNoLimit, nNoLimit, errString))
+        return false;
+    pool.addUnchecked(tx.GetHash(), entry, setAncestors, false);
+    return true;
+}
+
+/** Accept the transactions in order, and then mine them one by one. */
+static void AcceptAndMine(benchmark::State& state, const std::vector<CTransaction>& vtx)
+{
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(0));
+        LOCK(pool.cs);
+        for (unsigned int i = 0; i < vtx.size(); i++) {
+            bool fAccepted = AddToPool(pool, vtx[i], vtx.size());
+            assert(fAccepted);
+        }
+        std::list<CTransactionRef> removed;
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            pool.remove(vtx[i], removed, false);
+        assert(pool.size() == 0);
+    }
+}
+
+/* Every transaction spends the one before it. */
+static void MempoolChainDeep(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx;
+    vtx.push_back(Spend(std::vector<COutPoint>(1, COutPoint(uint256S("01"), 0)), 1));
+    while (vtx.size() < CHAIN_LENGTH)
+        vtx.push_back(Spend(std::vector<COutPoint>(1, COutPoint(vtx.back().GetHash(), 0)), 1));
+    AcceptAndMine(state, vtx);
+}
+
+/* A fan-out to as many transactions, all swept back together by the last one. */
+static void MempoolChainWide(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx;
+    vtx.push_back(Spend(std::vector<COutPoint>(1, COutPoint(uint256S("01"), 0)), CHAIN_LENGTH - 2));
+    std::vector<COutPoint> vSweep;
+    for (unsigned int i = 0; i < CHAIN_LENGTH - 2; i++) {
+        vtx.push_back(Spend(std::vector<COutPoint>(1, COutPoint(vtx[0].GetHash(), i)), 1));
+        vSweep.push_back(COutPoint(vtx.back().GetHash(), 0));
+    }
+    vtx.push_back(Spend(vSweep, 1));
+    AcceptAndMine(state, vtx);
+}
+
+/* Children of a chain that is too long already, as a spammer would offer them. */
+static void MempoolChainTooLong(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(0));
+    LOCK(pool.cs);
+    uint256 hashTip = uint256S("01");
+    for (unsigned int i = 0; i < CHAIN_LENGTH; i++) {
+        CTransaction tx = Spend(std::vector<COutPoint>(1, COutPoint(hashTip, 0)), 1);
+        AddToPool(pool, tx, CHAIN_LENGTH);
+        hashTip = tx.GetHash();
+    }
+    // The outputs they spend don't need to exist for the limits to be checked
+    std::vector<CTransaction> vChildren;
+    for (unsigned int i = 0; i < CHAIN_LENGTH; i++)
+        vChildren.push_back(Spend(std::vector<COutPoint>(1, COutPoint(hashTip, i)), 1));
+
+    while (state.KeepRunning()) {
+        for (unsigned int i = 0; i < vChildren.size(); i++) {
+            bool fAccepted = AddToPool(pool, vChildren[i], DEFAULT_ANCESTOR_LIMIT);
+            assert(!fAccepted);
+        }
+    }
+}
+
+BENCHMARK(MempoolChainDeep);
+BENCHMARK(MempoolChainWide);
+BENCHMARK(MempoolChainTooLong);
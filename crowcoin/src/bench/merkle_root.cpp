@@ -0,0 +1,25 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "random.h"
+#include "uint256.h"
+
+static void MerkleRoot(benchmark::State& state)
+{
+    std::vector<uint256> leaves;
+    leaves.resize(9001);
+    for (size_t s = 0; s < leaves.size(); s++) {
+        leaves[s] = GetRandHash();
+    }
+    while (state.KeepRunning()) {
+        bool mutation = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutation);
+        leaves[mutation] = hash;
+    }
+}
+
+BENCHMARK(MerkleRoot);
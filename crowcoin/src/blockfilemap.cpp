@@ -0,0 +1,120 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "compat.h"
+#include "serialize.h"
+
+#include <stdio.h>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include <boost/thread/locks.hpp>
+
+/** A read-only mapping of a block file, as far as it extended when mapped. */
+struct CBlockFileMapper::CMapping
+{
+    int nFile;
+    boost::filesystem::path path;
+    const char* data;
+    size_t size;
+
+    CMapping(int nFileIn, const boost::filesystem::path& pathIn, const char* dataIn, size_t sizeIn) : nFile(nFileIn), path(pathIn), data(dataIn), size(sizeIn) {}
+    ~CMapping()
+    {
+#ifndef WIN32
+        munmap((void*)data, size);
+#endif
+    }
+};
+
+boost::shared_ptr<CBlockFileMapper::CMapping> CBlockFileMapper::GetMapping(int nFile, const boost::filesystem::path& path, uint64_t nEnd)
+{
+    for (std::list<boost::shared_ptr<CMapping> >::iterator it = mappings.begin(); it != mappings.end(); it++) {
+        if ((*it)->nFile != nFile)
+            continue;
+        boost::shared_ptr<CMapping> mapping = *it;
+        mappings.erase(it);
+        if (mapping->size >= nEnd && mapping->path == path) {
+            mappings.push_front(mapping);
+            return mapping;
+        }
+        // The file grew since, or it is another one now; map it again.
+        break;
+    }
+    if (nMaxFiles == 0)
+        return boost::shared_ptr<CMapping>();
+
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return boost::shared_ptr<CMapping>();
+    struct stat st;
+    // Never map past the end of the file: touching that would raise SIGBUS.
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size < nEnd) {
+        close(fd);
+        return boost::shared_ptr<CMapping>();
+    }
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return boost::shared_ptr<CMapping>();
+
+    boost::shared_ptr<CMapping> mapping(new CMapping(nFile, path, (const char*)data, st.st_size));
+    mappings.push_front(mapping);
+    while (mappings.size() > nMaxFiles)
+        mappings.pop_back();
+    return mapping;
+#else
+    return boost::shared_ptr<CMapping>();
+#endif
+}
+
+bool CBlockFileMapper::GetView(int nFile, const boost::filesystem::path& path, uint64_t nPos, size_t nSize, CBlockFileView& view)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        boost::shared_ptr<CMapping> mapping = GetMapping(nFile, path, nPos + nSize);
+        if (mapping) {
+            view = CBlockFileView(mapping, mapping->data + nPos, mapping->data + nPos + nSize);
+            return true;
+        }
+    }
+
+    // Fall back to reading the range.
+    FILE* file = fopen(path.string().c_str(), "rb");
+    if (!file)
+        return false;
+    boost::shared_ptr<std::vector<char> > buffer(new std::vector<char>(nSize));
+    bool fOk = fseek(file, nPos, SEEK_SET) == 0 && fread(begin_ptr(*buffer), 1, nSize, file) == nSize;
+    fclose(file);
+    if (!fOk)
+        return false;
+    view = CBlockFileView(buffer, begin_ptr(*buffer), begin_ptr(*buffer) + nSize);
+    return true;
+}
+
+void CBlockFileMapper::Forget(int nFile)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    for (std::list<boost::shared_ptr<CMapping> >::iterator it = mappings.begin(); it != mappings.end(); it++) {
+        if ((*it)->nFile == nFile) {
+            mappings.erase(it);
+            return;
+        }
+    }
+}
+
+void CBlockFileMapper::SetMaxFiles(size_t nMaxFilesIn)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nMaxFiles = nMaxFilesIn;
+    while (mappings.size() > nMaxFiles)
+        mappings.pop_back();
+}
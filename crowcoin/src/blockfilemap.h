@@ -0,0 +1,73 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_BLOCKFILEMAP_H
+#define CROWCOIN_BLOCKFILEMAP_H
+
+#include <list>
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** Number of block files kept mapped by default (none where address space is scarce) */
+static const size_t DEFAULT_MAPPED_BLOCK_FILES = sizeof(void*) > 4 ? 64 : 0;
+
+/**
+ * A range of bytes in a block file, e.g. one serialized block. It keeps the
+ * memory it points into (a file mapping, or a buffer read from the file)
+ * alive for as long as it exists, even if the mapping has been replaced.
+ */
+class CBlockFileView
+{
+private:
+    boost::shared_ptr<const void> owner;
+    const char* pbegin;
+    const char* pend;
+
+public:
+    CBlockFileView() : pbegin(NULL), pend(NULL) {}
+    CBlockFileView(const boost::shared_ptr<const void>& ownerIn, const char* pbeginIn, const char* pendIn) :
+        owner(ownerIn), pbegin(pbeginIn), pend(pendIn) {}
+
+    bool IsNull() const { return pbegin == NULL; }
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pend; }
+    size_t size() const { return pend - pbegin; }
+};
+
+/**
+ * Keeps the most recently used block files mapped into memory, so that
+ * reading a block from them needs neither a file open nor a copy through
+ * stdio buffers. Block files only ever grow (until they are deleted by
+ * pruning), so a mapping is renewed when a read goes past its end.
+ *
+ * Where files can't be mapped, GetView() reads the range into a buffer.
+ */
+class CBlockFileMapper
+{
+private:
+    struct CMapping;
+
+    boost::mutex cs;
+    //! Most recently used first
+    std::list<boost::shared_ptr<CMapping> > mappings;
+    size_t nMaxFiles;
+
+    boost::shared_ptr<CMapping> GetMapping(int nFile, const boost::filesystem::path& path, uint64_t nEnd);
+
+public:
+    CBlockFileMapper(size_t nMaxFilesIn = DEFAULT_MAPPED_BLOCK_FILES) : nMaxFiles(nMaxFilesIn) {}
+
+    /** Get a view of the nSize bytes at nPos in block file nFile, which lives at path. */
+    bool GetView(int nFile, const boost::filesystem::path& path, uint64_t nPos, size_t nSize, CBlockFileView& view);
+
+    /** Drop the mapping of a file, e.g. before it gets deleted. */
+    void Forget(int nFile);
+
+    void SetMaxFiles(size_t nMaxFilesIn);
+};
+
+#endif // CROWCOIN_BLOCKFILEMAP_H
@@ -0,0 +1,157 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+/** Read ahead at most this many bytes of blocks that weren't handed out yet */
+static const size_t MAX_IMPORT_BYTES_HELD = 32 * MAX_BLOCK_SIZE;
+
+CBlockImportPipeline::CBlockImportPipeline(const CChainParams& chainparamsIn, FILE* fileIn, int nFileIn, int nThreads) :
+    chainparams(chainparamsIn), nFile(nFileIn), nSeqRead(0), nSeqNext(0), nBytesHeld(0), fReadDone(false)
+{
+    threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadRead, this, fileIn));
+    for (int i = 0; i < std::max(nThreads, 1); i++)
+        threads.create_thread(boost::bind(&CBlockImportPipeline::ThreadCheck, this));
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+void CBlockImportPipeline::ThreadRead(FILE* fileIn)
+{
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            boost::this_thread::interruption_point();
+
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(chainparams.MessageStart()[0]);
+                nRewind = blkdat.GetPos()+1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+            Job job;
+            try {
+                // read the block's bytes, leaving the rest to the workers
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.SetPos(nBlockPos);
+                job.vData.resize(nSize);
+                blkdat.read(begin_ptr(job.vData), nSize);
+                nRewind = blkdat.GetPos();
+                if (nFile >= 0)
+                    job.block.pos = CDiskBlockPos(nFile, nBlockPos);
+                job.block.nSize = nSize;
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(cs);
+            while (nBytesHeld > 0 && nBytesHeld + nSize > MAX_IMPORT_BYTES_HELD)
+                condReader.wait(lock);
+            nBytesHeld += nSize;
+            queueRead.push_back(Job());
+            Job& queued = queueRead.back();
+            queued.nSeq = nSeqRead++;
+            queued.block = job.block;
+            queued.vData.swap(job.vData);
+            condWorker.notify_one();
+        }
+    } catch (const std::runtime_error& e) {
+        boost::unique_lock<boost::mutex> lock(cs);
+        strError = e.what();
+    }
+    boost::unique_lock<boost::mutex> lock(cs);
+    fReadDone = true;
+    condDone.notify_all();
+}
+
+void CBlockImportPipeline::ThreadCheck()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        while (queueRead.empty())
+            condWorker.wait(lock);
+        Job job;
+        job.nSeq = queueRead.front().nSeq;
+        job.block = queueRead.front().block;
+        job.vData.swap(queueRead.front().vData);
+        queueRead.pop_front();
+        lock.unlock();
+
+        boost::shared_ptr<CBlock> pblock(new CBlock());
+        try {
+            CMemoryReader(begin_ptr(job.vData), end_ptr(job.vData), SER_DISK, CLIENT_VERSION) >> *pblock;
+            // This only saves ProcessNewBlock() the work; a block that fails
+            // is checked, and reported, again there.
+            CValidationState state;
+            CheckBlock(*pblock, state);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+            pblock.reset();
+        }
+        job.block.pblock = pblock;
+
+        lock.lock();
+        mapDone[job.nSeq] = job.block;
+        if (job.nSeq == nSeqNext)
+            condDone.notify_all();
+    }
+}
+
+bool CBlockImportPipeline::Next(CImportedBlock& block)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        std::map<uint64_t, CImportedBlock>::iterator it = mapDone.find(nSeqNext);
+        if (it != mapDone.end()) {
+            block = it->second;
+            mapDone.erase(it);
+            nSeqNext++;
+            nBytesHeld -= block.nSize;
+            condReader.notify_one();
+            return true;
+        }
+        if (fReadDone && nSeqNext == nSeqRead)
+            return false;
+        condDone.wait(lock);
+    }
+}
+
+std::string CBlockImportPipeline::GetError()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return strError;
+}
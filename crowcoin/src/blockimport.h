@@ -0,0 +1,116 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_BLOCKIMPORT_H
+#define CROWCOIN_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "primitives/block.h"
+
+#include <deque>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CChainParams;
+
+/** -importthreads default (number of threads checking blocks during -reindex and -loadblock) */
+static const int DEFAULT_IMPORT_THREADS = 2;
+/** Maximum number of block import threads allowed */
+static const int MAX_IMPORT_THREADS = 16;
+
+/** A block found in a file being imported */
+struct CImportedBlock
+{
+    //! Where the block is in its file; null unless it is one of our block files.
+    CDiskBlockPos pos;
+    //! Size of the serialized block
+    unsigned int nSize;
+    //! The block, or NULL if it could not be deserialized
+    boost::shared_ptr<CBlock> pblock;
+
+    CImportedBlock() : nSize(0) {}
+};
+
+/**
+ * Reads the blocks in a file (blk?????.dat, bootstrap.dat or -loadblock) in
+ * a pipeline.
+ *
+ * A reader thread locates the blocks in the file by their message start
+ * and reads their bytes. A pool of worker threads deserializes them and
+ * runs the context-free CheckBlock(), so that they reach ProcessNewBlock()
+ * with that work done. Next() hands the blocks out in the order they are
+ * in the file.
+ *
+ * The reader stops reading ahead while the blocks that were read but not
+ * yet handed out add up to more than a few times the maximum block size.
+ */
+class CBlockImportPipeline
+{
+private:
+    struct Job {
+        uint64_t nSeq;
+        CImportedBlock block;
+        std::vector<char> vData;
+    };
+
+    const CChainParams& chainparams;
+    const int nFile;
+
+    //! Protects all state below.
+    boost::mutex cs;
+
+    //! The reader blocks on this while too much is held
+    boost::condition_variable condReader;
+
+    //! Workers block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Next() blocks on this until the next block is done
+    boost::condition_variable condDone;
+
+    //! Blocks read but not picked up by a worker yet, in file order.
+    std::deque<Job> queueRead;
+
+    //! Blocks done by the workers, by their position in the file.
+    std::map<uint64_t, CImportedBlock> mapDone;
+
+    //! Number of blocks the reader found, and the next one Next() returns.
+    uint64_t nSeqRead;
+    uint64_t nSeqNext;
+
+    //! Serialized size of the blocks read and not handed out yet.
+    size_t nBytesHeld;
+
+    bool fReadDone;
+    std::string strError;
+
+    boost::thread_group threads;
+
+    void ThreadRead(FILE* fileIn);
+    void ThreadCheck();
+
+public:
+    /**
+     * Start reading fileIn, which is closed once it has been read. For one
+     * of our block files, nFileIn is its number, and -1 otherwise.
+     */
+    CBlockImportPipeline(const CChainParams& chainparamsIn, FILE* fileIn, int nFileIn, int nThreads);
+    ~CBlockImportPipeline();
+
+    /** Get the next block in the file. Returns false at the end of the file. */
+    bool Next(CImportedBlock& block);
+
+    /** An I/O error that ended the reading before the end of the file, if any. */
+    std::string GetError();
+};
+
+#endif // CROWCOIN_BLOCKIMPORT_H
@@ -0,0 +1,105 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+
+#include "memusage.h"
+
+#include <new>
+
+/** Smallest hash table allocated */
+static const size_t MIN_SLOTS = 64;
+
+static inline uint32_t GetTag(uint64_t nHash)
+{
+    return nHash >> 32;
+}
+
+size_t CBlockIndexMap::Lookup(const uint256& hash) const
+{
+    if (vTable.empty())
+        return nSize;
+    const uint64_t nHash = hash.GetCheapHash();
+    const size_t nMask = vTable.size() - 1;
+    for (size_t i = nHash & nMask; ; i = (i + 1) & nMask) {
+        const Slot& slot = vTable[i];
+        if (slot.nPos == EMPTY)
+            return nSize;
+        if (slot.nTag == GetTag(nHash) && GetNode(slot.nPos).value.first == hash)
+            return slot.nPos;
+    }
+}
+
+void CBlockIndexMap::Rehash(size_t nSlots)
+{
+    Slot empty;
+    empty.nPos = EMPTY;
+    empty.nTag = 0;
+    vTable.assign(nSlots, empty);
+    const size_t nMask = nSlots - 1;
+    for (size_t nPos = 0; nPos < nSize; nPos++) {
+        const uint64_t nHash = GetNode(nPos).value.first.GetCheapHash();
+        size_t i = nHash & nMask;
+        while (vTable[i].nPos != EMPTY)
+            i = (i + 1) & nMask;
+        vTable[i].nPos = nPos;
+        vTable[i].nTag = GetTag(nHash);
+    }
+}
+
+void CBlockIndexMap::reserve(size_t n)
+{
+    // Keep the table at most 3/4 full
+    size_t nSlots = vTable.empty() ? MIN_SLOTS : vTable.size();
+    while (n * 4 > nSlots * 3)
+        nSlots *= 2;
+    if (nSlots != vTable.size())
+        Rehash(nSlots);
+    vChunks.reserve((n + CHUNK_SIZE - 1) >> CHUNK_BITS);
+}
+
+std::pair<CBlockIndexMap::iterator, bool> CBlockIndexMap::emplace(const uint256& hash, const CBlockIndex& index)
+{
+    size_t nPos = Lookup(hash);
+    if (nPos != nSize)
+        return std::make_pair(iterator(this, nPos), false);
+
+    reserve(nSize + 1);
+    if (nSize == vChunks.size() << CHUNK_BITS)
+        vChunks.push_back(static_cast<Node*>(::operator new(sizeof(Node) * CHUNK_SIZE)));
+    new (&GetNode(nSize)) Node(hash, index);
+
+    const uint64_t nHash = hash.GetCheapHash();
+    const size_t nMask = vTable.size() - 1;
+    size_t i = nHash & nMask;
+    while (vTable[i].nPos != EMPTY)
+        i = (i + 1) & nMask;
+    vTable[i].nPos = nSize;
+    vTable[i].nTag = GetTag(nHash);
+
+    return std::make_pair(iterator(this, nSize++), true);
+}
+
+void CBlockIndexMap::clear()
+{
+    for (size_t nPos = 0; nPos < nSize; nPos++)
+        GetNode(nPos).~Node();
+    for (size_t i = 0; i < vChunks.size(); i++)
+        ::operator delete(vChunks[i]);
+    std::vector<Node*>().swap(vChunks);
+    std::vector<Slot>().swap(vTable);
+    nSize = 0;
+}
+
+size_t CBlockIndexMap::DynamicMemoryUsage() const
+{
+    return memusage::MallocUsage(sizeof(Node) * CHUNK_SIZE) * vChunks.size() + memusage::DynamicUsage(vChunks) + memusage::DynamicUsage(vTable);
+}
+
+size_t CBlockIndexMap::UnpooledMemoryUsage() const
+{
+    // One CBlockIndex and one hash table node per entry, and about as many
+    // buckets as entries
+    return (memusage::MallocUsage(sizeof(CBlockIndex)) + memusage::MallocUsage(sizeof(memusage::boost_unordered_node<value_type>)) + sizeof(void*)) * nSize;
+}
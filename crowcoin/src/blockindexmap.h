@@ -0,0 +1,151 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_BLOCKINDEXMAP_H
+#define CROWCOIN_BLOCKINDEXMAP_H
+
+#include "chain.h"
+#include "uint256.h"
+
+#include <cstddef>
+#include <iterator>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+/**
+ * The block index: every CBlockIndex we know about, by block hash.
+ *
+ * Entries are stored in a chunked arena in the order they are added, next
+ * to their hash, so they keep their address for as long as the map exists
+ * and a chain loaded in height order sits mostly contiguous in memory.
+ * Lookups go through a flat, open-addressing hash table (linear probing)
+ * of positions in the arena, each with a few bits of the hash to skip most
+ * entries that don't match without touching them.
+ *
+ * Entries can't be removed one at a time, only all at once by clear().
+ * The interface follows the part of boost::unordered_map that mapBlockIndex
+ * used to need, except that entries are added with emplace(), and that
+ * operator[] never adds any.
+ */
+class CBlockIndexMap
+{
+public:
+    typedef uint256 key_type;
+    typedef CBlockIndex* mapped_type;
+    typedef std::pair<const uint256, CBlockIndex*> value_type;
+
+private:
+    //! An entry in the arena; value.second points to index.
+    struct Node {
+        CBlockIndex index;
+        value_type value;
+
+        Node(const uint256& hash, const CBlockIndex& indexIn) : index(indexIn), value(hash, &index)
+        {
+            index.phashBlock = &value.first;
+        }
+    };
+
+    //! A slot of the hash table; nPos is the arena position of the entry, or EMPTY
+    struct Slot {
+        uint32_t nPos;
+        uint32_t nTag;
+    };
+
+    static const uint32_t EMPTY = 0xffffffff;
+    static const unsigned int CHUNK_BITS = 8;
+    static const size_t CHUNK_SIZE = (size_t)1 << CHUNK_BITS;
+
+    std::vector<Node*> vChunks;
+    std::vector<Slot> vTable;
+    size_t nSize;
+
+    Node& GetNode(size_t nPos) const { return vChunks[nPos >> CHUNK_BITS][nPos & (CHUNK_SIZE - 1)]; }
+    size_t Lookup(const uint256& hash) const;
+    void Rehash(size_t nSlots);
+
+    CBlockIndexMap(const CBlockIndexMap&);
+    CBlockIndexMap& operator=(const CBlockIndexMap&);
+
+public:
+    template <typename Value>
+    class iterator_base
+    {
+    private:
+        const CBlockIndexMap* map;
+        size_t nPos;
+
+        friend class CBlockIndexMap;
+        template <typename> friend class iterator_base;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        iterator_base() : map(NULL), nPos(0) {}
+        iterator_base(const CBlockIndexMap* mapIn, size_t nPosIn) : map(mapIn), nPos(nPosIn) {}
+        template <typename Other>
+        iterator_base(const iterator_base<Other>& other) : map(other.map), nPos(other.nPos) {}
+
+        Value& operator*() const { return map->GetNode(nPos).value; }
+        Value* operator->() const { return &map->GetNode(nPos).value; }
+        iterator_base& operator++() { nPos++; return *this; }
+        iterator_base operator++(int) { iterator_base ret(*this); nPos++; return ret; }
+        bool operator==(const iterator_base& other) const { return nPos == other.nPos; }
+        bool operator!=(const iterator_base& other) const { return nPos != other.nPos; }
+    };
+
+    typedef iterator_base<value_type> iterator;
+    typedef iterator_base<const value_type> const_iterator;
+
+    CBlockIndexMap() : nSize(0) {}
+    ~CBlockIndexMap() { clear(); }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, nSize); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, nSize); }
+
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    iterator find(const uint256& hash) { return iterator(this, Lookup(hash)); }
+    const_iterator find(const uint256& hash) const { return const_iterator(this, Lookup(hash)); }
+    size_t count(const uint256& hash) const { return Lookup(hash) != nSize; }
+
+    /** The entry for hash, or NULL if there is none. */
+    CBlockIndex* operator[](const uint256& hash) const
+    {
+        size_t nPos = Lookup(hash);
+        return nPos == nSize ? NULL : GetNode(nPos).value.second;
+    }
+
+    /**
+     * Add an entry for hash, a copy of index with phashBlock pointing to the
+     * stored hash, unless there is one already. Returns the entry for hash,
+     * and whether it was added.
+     */
+    std::pair<iterator, bool> emplace(const uint256& hash, const CBlockIndex& index = CBlockIndex());
+
+    /** Make room for n entries without rehashing. */
+    void reserve(size_t n);
+
+    /** Remove, and free, all entries. Pointers to them become invalid. */
+    void clear();
+
+    /** Memory used by the map and its entries. */
+    size_t DynamicMemoryUsage() const;
+
+    /**
+     * What the same entries would use as separately allocated CBlockIndex
+     * objects in a boost::unordered_map, for comparison.
+     */
+    size_t UnpooledMemoryUsage() const;
+};
+
+#endif // CROWCOIN_BLOCKINDEXMAP_H
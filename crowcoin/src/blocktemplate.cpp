@@ -0,0 +1,178 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocktemplate.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "miner.h"
+#include "script/script.h"
+#include "uint256.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+CBlockTemplateBuilder* pblocktemplatebuilder = NULL;
+
+CBlockTemplateBuilder::CBlockTemplateBuilder(const CChainParams& chainparamsIn, CAmount nFeeDeltaIn) :
+    pindexTemplate(NULL), fTemplateFull(false), nTemplateFees(0), fNewTip(false), fMempoolChanged(false),
+    chainparams(chainparamsIn), nFeeDelta(nFeeDeltaIn)
+{
+}
+
+CBlockTemplateBuilder::~CBlockTemplateBuilder()
+{
+    Stop();
+}
+
+void CBlockTemplateBuilder::Start()
+{
+    RegisterValidationInterface(this);
+    thread = boost::thread(boost::bind(&CBlockTemplateBuilder::ThreadBuild, this));
+}
+
+void CBlockTemplateBuilder::Stop()
+{
+    if (thread.joinable()) {
+        UnregisterValidationInterface(this);
+        thread.interrupt();
+        thread.join();
+    }
+}
+
+void CBlockTemplateBuilder::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fNewTip = true;
+    cond.notify_all();
+}
+
+void CBlockTemplateBuilder::SyncTransaction(const CTransaction& tx, const CBlock* pblock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fMempoolChanged = true;
+    cond.notify_all();
+}
+
+boost::shared_ptr<const CBlockTemplate> CBlockTemplateBuilder::GetTemplate(const CBlockIndex* pindexPrev)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    if (pindexTemplate != pindexPrev)
+        return boost::shared_ptr<const CBlockTemplate>();
+    return ptemplate;
+}
+
+bool CBlockTemplateBuilder::WaitForChange(const uint256& hashPrevBlock, CAmount nFeesMin, int64_t nTimeout)
+{
+    const int64_t nDeadline = GetTimeMillis() + nTimeout;
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (true) {
+        if (ptemplate && (ptemplate->block.hashPrevBlock != hashPrevBlock || (fTemplateFull && nTemplateFees >= nFeesMin)))
+            return true;
+        const int64_t nNow = GetTimeMillis();
+        if (nNow >= nDeadline)
+            return false;
+        cond.timed_wait(lock, boost::posix_time::milliseconds(nDeadline - nNow));
+    }
+}
+
+bool CBlockTemplateBuilder::Build(bool fMempool, const CBlockIndex*& pindexPrev)
+{
+    const int64_t nStart = GetTimeMicros();
+    boost::shared_ptr<const CBlockTemplate> pnew;
+    try {
+        CScript scriptDummy = CScript() << OP_TRUE;
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+        pnew.reset(CreateNewBlock(chainparams, scriptDummy, fMempool));
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+        return false;
+    }
+    if (!pnew)
+        return false;
+    const CAmount nFees = -pnew->vTxFees[0];
+    LogPrint("bench", "%s: %s template on %s, %u txs, fees %d: %.2fms\n", __func__, fMempool ? "full" : "empty",
+             pindexPrev->GetBlockHash().ToString(), pnew->block.vtx.size(), nFees, (GetTimeMicros() - nStart) * 0.001);
+
+    boost::unique_lock<boost::mutex> lock(cs);
+    ptemplate = pnew;
+    pindexTemplate = pindexPrev;
+    fTemplateFull = fMempool;
+    nTemplateFees = nFees;
+    cond.notify_all();
+    return true;
+}
+
+void CBlockTemplateBuilder::ThreadBuild()
+{
+    RenameThread("crowcoin-blocktemplate");
+    // What the current template was built from
+    const CBlockIndex* pindexBuilt = NULL;
+    bool fFullBuilt = false;
+    unsigned int nTransactionsUpdatedBuilt = 0;
+    int64_t nLastBuild = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+
+        const CBlockIndex* pindexTip;
+        bool fInitialDownload;
+        {
+            LOCK(cs_main);
+            pindexTip = chainActive.Tip();
+            fInitialDownload = IsInitialBlockDownload();
+        }
+        const unsigned int nTransactionsUpdated = mempool.GetTransactionsUpdated();
+
+        int64_t nWait = BLOCK_TEMPLATE_BUILD_INTERVAL;
+        bool fRateLimited = false;
+        if (!fInitialDownload && pindexTip != NULL) {
+            bool fBuild = false;
+            bool fMempool = true;
+            if (pindexTip != pindexBuilt) {
+                // Miners can start on the new tip while the mempool is gone through
+                fBuild = true;
+                fMempool = false;
+            } else if (!fFullBuilt) {
+                fBuild = true;
+            } else if (nTransactionsUpdated != nTransactionsUpdatedBuilt) {
+                nWait = nLastBuild + BLOCK_TEMPLATE_BUILD_INTERVAL - GetTimeMillis();
+                fBuild = nWait <= 0;
+                fRateLimited = !fBuild;
+            }
+
+            if (fBuild) {
+                const CBlockIndex* pindexPrev;
+                if (Build(fMempool, pindexPrev)) {
+                    pindexBuilt = pindexPrev;
+                    fFullBuilt = fMempool;
+                    nTransactionsUpdatedBuilt = nTransactionsUpdated;
+                    nLastBuild = GetTimeMillis();
+                    continue;
+                }
+                // Try again later
+                nWait = BLOCK_TEMPLATE_BUILD_INTERVAL;
+                fRateLimited = true;
+            }
+        }
+
+        // Wait for a change; while the mempool is being held back, only a new tip counts
+        boost::unique_lock<boost::mutex> lock(cs);
+        const int64_t nDeadline = GetTimeMillis() + nWait;
+        while (!fNewTip && !(fMempoolChanged && !fRateLimited)) {
+            const int64_t nNow = GetTimeMillis();
+            if (nNow >= nDeadline)
+                break;
+            cond.timed_wait(lock, boost::posix_time::milliseconds(nDeadline - nNow));
+        }
+        fNewTip = false;
+        fMempoolChanged = false;
+    }
+}
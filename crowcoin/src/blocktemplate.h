@@ -0,0 +1,105 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_BLOCKTEMPLATE_H
+#define CROWCOIN_BLOCKTEMPLATE_H
+
+#include "amount.h"
+#include "validationinterface.h"
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockIndex;
+class CChainParams;
+class CTransaction;
+class uint256;
+struct CBlockTemplate;
+
+static const bool DEFAULT_BLOCK_TEMPLATE_BUILDER = false;
+/** Default for -blocktemplatefeedelta, the fee increase that wakes up longpolling getblocktemplate clients */
+static const CAmount DEFAULT_BLOCK_TEMPLATE_FEE_DELTA = COIN / 1000;
+/** Minimum time between two templates built from the same tip, in milliseconds */
+static const int64_t BLOCK_TEMPLATE_BUILD_INTERVAL = 1000;
+
+/**
+ * Keeps a block template for the tip ready for getblocktemplate, so that
+ * calls don't have to wait for CreateNewBlock.
+ *
+ * A thread rebuilds the template when the tip or the mempool changes. On a
+ * new tip it first builds a template without mempool transactions, which
+ * takes next to no time, and then a full one. Changes to the mempool are
+ * picked up at most once every BLOCK_TEMPLATE_BUILD_INTERVAL.
+ *
+ * The thread wakes up on UpdatedBlockTip and SyncTransaction, and otherwise
+ * every BLOCK_TEMPLATE_BUILD_INTERVAL. It builds nothing during the initial
+ * block download.
+ */
+class CBlockTemplateBuilder : public CValidationInterface
+{
+private:
+    //! Protects the template, fNewTip and fMempoolChanged.
+    boost::mutex cs;
+
+    //! The thread waits on this for changes; WaitForChange() for a new template.
+    boost::condition_variable cond;
+
+    boost::shared_ptr<const CBlockTemplate> ptemplate;
+
+    //! The block the template builds on
+    const CBlockIndex* pindexTemplate;
+
+    //! Whether the template has the mempool transactions in it
+    bool fTemplateFull;
+
+    //! The fees of the transactions in the template
+    CAmount nTemplateFees;
+
+    //! Whether the tip changed since the thread last looked
+    bool fNewTip;
+
+    //! Whether transactions were added or removed since the thread last looked
+    bool fMempoolChanged;
+
+    const CChainParams& chainparams;
+    const CAmount nFeeDelta;
+
+    boost::thread thread;
+
+    void ThreadBuild();
+    /** Build a template on the tip, with or without the mempool transactions, and publish it. */
+    bool Build(bool fMempool, const CBlockIndex*& pindexPrev);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+    void SyncTransaction(const CTransaction& tx, const CBlock* pblock);
+
+public:
+    CBlockTemplateBuilder(const CChainParams& chainparamsIn, CAmount nFeeDeltaIn);
+    virtual ~CBlockTemplateBuilder();
+
+    void Start();
+    void Stop();
+
+    /** The fee increase after which longpolling clients should get a new template. */
+    CAmount GetFeeDelta() const { return nFeeDelta; }
+
+    /** The latest template, if it builds on pindexPrev, or NULL. The template must not be modified. */
+    boost::shared_ptr<const CBlockTemplate> GetTemplate(const CBlockIndex* pindexPrev);
+
+    /**
+     * Wait until there is a template on another block than hashPrevBlock, or
+     * a full one paying at least nFeesMin, for at most nTimeout milliseconds.
+     * Returns whether there is.
+     */
+    bool WaitForChange(const uint256& hashPrevBlock, CAmount nFeesMin, int64_t nTimeout);
+};
+
+extern CBlockTemplateBuilder* pblocktemplatebuilder;
+
+#endif // CROWCOIN_BLOCKTEMPLATE_H
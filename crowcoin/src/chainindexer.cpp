@@ -0,0 +1,191 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainindexer.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread/locks.hpp>
+
+CChainIndexer::CChainIndexer(const CChainParams& chainparamsIn) : pindexBest(NULL), fNotified(false), chainparams(chainparamsIn)
+{
+}
+
+CChainIndexer::~CChainIndexer()
+{
+    Stop();
+}
+
+void CChainIndexer::Start()
+{
+    const CBlockIndex* pindex = NULL;
+    {
+        LOCK(cs_main);
+        CBlockLocator locator;
+        if (ReadBestBlock(locator))
+            pindex = FindForkInGlobalIndex(chainActive, locator);
+    }
+    SetBestBlock(pindex);
+    if (pindex)
+        LogPrintf("%s: %s is up to date at height %d\n", __func__, GetName(), pindex->nHeight);
+    else
+        LogPrintf("%s: building %s from scratch\n", __func__, GetName());
+    RegisterValidationInterface(this);
+    thread = boost::thread(boost::bind(&CChainIndexer::ThreadSync, this));
+}
+
+void CChainIndexer::Stop()
+{
+    if (thread.joinable()) {
+        UnregisterValidationInterface(this);
+        thread.interrupt();
+        thread.join();
+    }
+}
+
+const CBlockIndex* CChainIndexer::GetBestBlock()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return pindexBest;
+}
+
+void CChainIndexer::SetBestBlock(const CBlockIndex* pindex)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    pindexBest = pindex;
+    cond.notify_all();
+}
+
+void CChainIndexer::UpdatedBlockTip(const CBlockIndex* pindex)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    fNotified = true;
+    cond.notify_all();
+}
+
+bool CChainIndexer::WaitForSync(int64_t nTimeout)
+{
+    const int64_t nDeadline = GetTimeMillis() + nTimeout;
+    while (true) {
+        const CBlockIndex* pindexTip;
+        {
+            LOCK(cs_main);
+            pindexTip = chainActive.Tip();
+        }
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (pindexBest == pindexTip)
+            return true;
+        if (GetTimeMillis() >= nDeadline)
+            return false;
+        cond.timed_wait(lock, boost::posix_time::milliseconds(std::min((int64_t)100, nDeadline - GetTimeMillis())));
+    }
+}
+
+bool CChainIndexer::Commit(const CBlockIndex* pindex)
+{
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(pindex);
+    }
+    if (!WriteBatch(locator))
+        return error("%s: failed to write %s", __func__, GetName());
+    return true;
+}
+
+bool CChainIndexer::Rewind(const CBlockIndex* pindex, const CBlockIndex* pindexFork)
+{
+    // Write out what we have first, so that the removals can't be undone
+    // by entries queued before them
+    if (GetBatchSize() > 0 && !Commit(pindex))
+        return false;
+    for (; pindex != pindexFork; pindex = pindex->pprev) {
+        if (!RemoveBlock(pindex))
+            return error("%s: failed to remove block %s from %s", __func__, pindex->GetBlockHash().ToString(), GetName());
+    }
+    LogPrint("index", "%s: rewound %s to height %d\n", __func__, GetName(), pindexFork ? pindexFork->nHeight : -1);
+    return Commit(pindexFork);
+}
+
+void CChainIndexer::ThreadSync()
+{
+    RenameThread(strprintf("crowcoin-%s", GetName()).c_str());
+    const CBlockIndex* pindexWritten = GetBestBlock();
+    const CBlockIndex* pindex = pindexWritten;
+    int64_t nLastLog = GetTime();
+    try {
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            const CBlockIndex* pindexNext;
+            const CBlockIndex* pindexFork = pindex;
+            {
+                LOCK(cs_main);
+                // The genesis block's transactions can't be spent, and aren't indexed
+                if (pindex == NULL)
+                    pindex = pindexFork = chainActive.Genesis();
+                else if (!chainActive.Contains(pindex))
+                    pindexFork = chainActive.FindFork(pindex);
+                pindexNext = pindexFork ? chainActive.Next(pindexFork) : NULL;
+            }
+
+            if (pindexFork != pindex) {
+                // Blocks we indexed were disconnected
+                if (!Rewind(pindex, pindexFork))
+                    return;
+                pindex = pindexWritten = pindexFork;
+                SetBestBlock(pindex);
+                continue;
+            }
+
+            if (pindexNext == NULL) {
+                // Caught up: write out what we have, and wait for a new tip
+                if (pindex != pindexWritten) {
+                    if (!Commit(pindex))
+                        return;
+                    pindexWritten = pindex;
+                }
+                boost::unique_lock<boost::mutex> lock(cs);
+                pindexBest = pindex;
+                cond.notify_all();
+                if (!fNotified)
+                    cond.timed_wait(lock, boost::posix_time::seconds(1));
+                fNotified = false;
+                continue;
+            }
+
+            CBlock block;
+            if (!ReadBlockFromDisk(block, pindexNext, chainparams.GetConsensus()) || !AddBlock(block, pindexNext)) {
+                LogPrintf("%s: failed to index block %s; %s stops at height %d\n", __func__, pindexNext->GetBlockHash().ToString(), GetName(), pindex ? pindex->nHeight : -1);
+                if (pindex != pindexWritten)
+                    Commit(pindex);
+                return;
+            }
+            pindex = pindexNext;
+
+            if (GetBatchSize() >= GetMaxBatchSize()) {
+                if (!Commit(pindex))
+                    return;
+                pindexWritten = pindex;
+                SetBestBlock(pindex);
+            }
+            if (GetTime() - nLastLog >= 10) {
+                LogPrintf("%s: %s at height %d\n", __func__, GetName(), pindex->nHeight);
+                nLastLog = GetTime();
+            }
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Keep what has been indexed so far
+        if (pindex != pindexWritten)
+            Commit(pindex);
+        throw;
+    }
+}
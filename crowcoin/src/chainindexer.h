@@ -0,0 +1,109 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_CHAININDEXER_H
+#define CROWCOIN_CHAININDEXER_H
+
+#include "validationinterface.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlock;
+class CBlockIndex;
+class CChainParams;
+struct CBlockLocator;
+
+/**
+ * Base class for optional indexes that are built from the active chain in
+ * the background, like the transaction index.
+ *
+ * A thread follows the active chain: it reads every block that gets
+ * connected back from disk, hands it to AddBlock(), and writes out what
+ * that queued once there is enough of it, or once it has caught up with the
+ * tip, together with a locator of the last block it indexed. After a restart
+ * it carries on from that locator. When a reorg disconnects blocks it
+ * indexed, it hands them to RemoveBlock(), from the tip down, and goes on
+ * from the fork point.
+ *
+ * The thread wakes up on UpdatedBlockTip, and otherwise every second. Until
+ * it has caught up with the tip, lookups of recent entries can miss the
+ * index.
+ *
+ * Subclasses must call Stop() in their destructor, as the thread calls their
+ * methods.
+ */
+class CChainIndexer : public CValidationInterface
+{
+private:
+    //! Protects pindexBest and fNotified.
+    boost::mutex cs;
+
+    //! The thread waits on this for a new tip; WaitForSync() for the thread.
+    boost::condition_variable cond;
+
+    //! The last block that has been indexed and written out, or NULL
+    const CBlockIndex* pindexBest;
+
+    //! Whether the tip changed since the thread last looked
+    bool fNotified;
+
+    boost::thread thread;
+
+    void ThreadSync();
+    bool Commit(const CBlockIndex* pindex);
+    bool Rewind(const CBlockIndex* pindex, const CBlockIndex* pindexFork);
+    void SetBestBlock(const CBlockIndex* pindex);
+
+protected:
+    const CChainParams& chainparams;
+
+    void UpdatedBlockTip(const CBlockIndex* pindex);
+
+    /** Name of the index, for the log and the thread. */
+    virtual const char* GetName() const = 0;
+
+    /** Read the locator stored by the last WriteBatch(). */
+    virtual bool ReadBestBlock(CBlockLocator& locator) = 0;
+
+    /** Queue the entries for a block that was connected to the active chain. */
+    virtual bool AddBlock(const CBlock& block, const CBlockIndex* pindex) = 0;
+
+    /**
+     * Queue the removal of the entries for a block that was disconnected.
+     * By default they are kept, for indexes where they can't mislead.
+     */
+    virtual bool RemoveBlock(const CBlockIndex* pindex) { return true; }
+
+    /** Number of entries queued since the last WriteBatch(). */
+    virtual size_t GetBatchSize() const = 0;
+
+    /** Number of queued entries at which they are written out. */
+    virtual size_t GetMaxBatchSize() const = 0;
+
+    /** Write the queued changes, and the locator, atomically. */
+    virtual bool WriteBatch(const CBlockLocator& locator) = 0;
+
+public:
+    CChainIndexer(const CChainParams& chainparamsIn);
+    virtual ~CChainIndexer();
+
+    /** Pick up where the index left off and start following the active chain. */
+    void Start();
+
+    /** Stop the thread, after writing out what it has indexed. */
+    void Stop();
+
+    /** The last block that has been indexed and written out, or NULL. */
+    const CBlockIndex* GetBestBlock();
+
+    /** Wait until the index has caught up with the tip, for at most nTimeout milliseconds. */
+    bool WaitForSync(int64_t nTimeout);
+};
+
+#endif // CROWCOIN_CHAININDEXER_H
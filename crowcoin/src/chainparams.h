@@ -25,6 +25,9 @@ struct SeedSpec6 {
 
 typedef std::map<int, uint256> MapCheckpoints;
 
+/** Checksums of known good UTXO set snapshots (see dumptxoutset), by the hash of the block they were taken at */
+typedef std::map<uint256, uint256> MapTxOutSetSnapshots;
+
 struct CCheckpointData {
     MapCheckpoints mapCheckpoints;
     int64_t nTimeLastCheckpoint;
@@ -76,6 +79,8 @@ public:
     const std::vector<unsigned char>& Base58Prefix(Base58Type type) const { return base58Prefixes[type]; }
     const std::vector<SeedSpec6>& FixedSeeds() const { return vFixedSeeds; }
     const CCheckpointData& Checkpoints() const { return checkpointData; }
+    /** UTXO set snapshots -loadtxoutset accepts */
+    const MapTxOutSetSnapshots& TxOutSetSnapshots() const { return mapTxOutSetSnapshots; }
 protected:
     CChainParams() {}
 
@@ -97,6 +102,7 @@ protected:
     bool fMineBlocksOnDemand;
     bool fTestnetToBeDeprecatedFieldRPC;
     CCheckpointData checkpointData;
+    MapTxOutSetSnapshots mapTxOutSetSnapshots;
 };
 
 /**
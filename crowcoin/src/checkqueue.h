@@ -6,6 +6,7 @@
 #define CROWCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <deque>
 #include <vector>
 
 #include <boost/foreach.hpp>
@@ -25,110 +26,156 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker owns a deque of checks. The master spreads each batch over
+  * the workers' deques, locking only the deque it appends to. A worker takes
+  * checks from the back of its own deque one at a time, and when that runs
+  * dry steals up to half of another worker's deque from the front, so
+  * there is no single lock that all threads contend on. The shared counters
+  * are updated with atomic builtins; a mutex is only taken to go to sleep
+  * and to wake sleeping threads up.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
-
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
-
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+    //! A worker's own share of the queued checks.
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<T> checks;
+    };
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! The per-worker deques. Slot 0 belongs to the master.
+    std::vector<WorkerQueue*> vQueues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! Number of slots handed out so far, including the master's.
+    volatile unsigned int nSlots;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! Next deque the master appends to (only used by the master).
+    unsigned int nNextQueue;
 
-    //! The temporary evaluation result.
-    bool fAllOk;
+    //! Number of checks sitting in one of the deques.
+    volatile unsigned int nQueued;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but still in a
+     * worker's own batch.
      */
-    unsigned int nTodo;
+    volatile unsigned int nTodo;
+
+    //! The temporary evaluation result.
+    volatile bool fAllOk;
 
     //! Whether we're shutting down.
-    bool fQuit;
+    volatile bool fQuit;
 
-    //! The maximum number of elements to be processed in one batch
+    //! Mutex that sleeping threads wait on.
+    boost::mutex mutexSleep;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    //! Number of worker threads waiting on condWorker.
+    volatile unsigned int nSleeping;
+
+    //! The maximum number of elements to steal in one go
     unsigned int nBatchSize;
 
+    /** Take work for the worker in slot nSlot: one check from its own deque, or a batch stolen from another. */
+    bool Take(unsigned int nSlot, std::vector<T>& vBatch)
+    {
+        {
+            WorkerQueue& own = *vQueues[nSlot];
+            boost::unique_lock<boost::mutex> lock(own.mutex);
+            if (!own.checks.empty()) {
+                vBatch.resize(1);
+                vBatch[0].swap(own.checks.back());
+                own.checks.pop_back();
+                __sync_fetch_and_sub(&nQueued, 1);
+                return true;
+            }
+        }
+        for (unsigned int i = 1; i < vQueues.size() && nQueued; i++) {
+            WorkerQueue& victim = *vQueues[(nSlot + i) % vQueues.size()];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            if (victim.checks.empty())
+                continue;
+            unsigned int nSteal = std::min(nBatchSize, (unsigned int)(victim.checks.size() + 1) / 2);
+            vBatch.resize(nSteal);
+            for (unsigned int j = 0; j < nSteal; j++) {
+                vBatch[j].swap(victim.checks.front());
+                victim.checks.pop_front();
+            }
+            __sync_fetch_and_sub(&nQueued, nSteal);
+            return true;
+        }
+        return false;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nSlot = fMaster ? 0 : __sync_fetch_and_add(&nSlots, 1) % vQueues.size();
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+            if (nQueued && Take(nSlot, vChecks)) {
+                // Check whether we need to do work at all
+                bool fOk = fAllOk;
+                BOOST_FOREACH (T& check, vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (__sync_sub_and_fetch(&nTodo, nNow) == 0) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutexSleep);
+                    condMaster.notify_one();
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                continue;
+            }
+
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            if (fMaster) {
+                // Only the master adds work, so once it is waiting nothing
+                // new gets queued; sleep until the workers are done.
+                if (nQueued == 0 && nTodo != 0)
+                    condMaster.wait(lock);
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
+            } else {
+                if (fQuit)
+                    return fAllOk;
+                nSleeping++;
+                // Pairs with the barrier in Add(): either it sees us sleeping
+                // or we see its checks.
+                __sync_synchronize();
+                if (nQueued == 0 && !fQuit)
+                    condWorker.wait(lock); // wait
+                nSleeping--;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkers = 16) : nSlots(1), nNextQueue(0), nQueued(0), nTodo(0), fAllOk(true), fQuit(false), nSleeping(0), nBatchSize(nBatchSizeIn)
+    {
+        vQueues.resize(std::max(1U, nMaxWorkers));
+        for (unsigned int i = 0; i < vQueues.size(); i++)
+            vQueues[i] = new WorkerQueue();
+    }
 
     //! Worker thread
     void Thread()
@@ -145,26 +192,46 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        __sync_fetch_and_add(&nTodo, vChecks.size());
+
+        // Leave the master's own deque empty while there are workers to
+        // pick the checks up, and give each worker a contiguous share.
+        unsigned int nWorkers = std::min((unsigned int)nSlots, (unsigned int)vQueues.size());
+        unsigned int nFirst = nWorkers > 1 ? 1 : 0;
+        unsigned int nTargets = nWorkers - nFirst;
+        size_t nPer = (vChecks.size() + nTargets - 1) / nTargets;
+        for (size_t i = 0; i < vChecks.size(); ) {
+            WorkerQueue& q = *vQueues[nFirst + nNextQueue++ % nTargets];
+            size_t nEnd = std::min(vChecks.size(), i + nPer);
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            __sync_fetch_and_add(&nQueued, nEnd - i);
+            for (; i < nEnd; i++) {
+                q.checks.push_back(T());
+                vChecks[i].swap(q.checks.back());
+            }
+        }
+
+        __sync_synchronize();
+        if (nSleeping) {
+            boost::unique_lock<boost::mutex> lock(mutexSleep);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
     }
 
     ~CCheckQueue()
     {
+        for (unsigned int i = 0; i < vQueues.size(); i++)
+            delete vQueues[i];
     }
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && nQueued == 0 && fAllOk == true);
     }
 
 };
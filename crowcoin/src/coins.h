@@ -21,6 +21,10 @@
 /** 
  * Pruned version of CTransaction: only retains metadata and unspent transaction outputs
  *
+ * The coins cache and the coin database keep a Coin per output instead; this
+ * per-transaction form remains for UTXO set snapshots and for the chainstate
+ * format from before one record per output.
+ *
  * Serialized format:
  * - VARINT(nVersion)
  * - VARINT(nCode)
@@ -264,6 +268,90 @@ public:
     }
 };
 
+/**
+ * A UTXO entry: one unspent transaction output, plus the information about
+ * its transaction that the consensus rules need.
+ *
+ * Serialized format (the value of a coin database record):
+ * - VARINT(nHeight * 2 + fCoinBase)
+ * - VARINT(nVersion)
+ * - the output, in CTxOutCompressor format
+ */
+class Coin
+{
+public:
+    //! unspent transaction output; spent coins are .IsNull()
+    CTxOut out;
+
+    //! whether the containing transaction is a coinbase
+    bool fCoinBase;
+
+    //! at which height the containing transaction was included in the active block chain
+    int nHeight;
+
+    //! version of the containing transaction
+    int nVersion;
+
+    //! empty constructor
+    Coin() : fCoinBase(false), nHeight(0), nVersion(0) { }
+
+    Coin(const CTxOut &outIn, int nHeightIn, bool fCoinBaseIn, int nVersionIn) : out(outIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), nVersion(nVersionIn) { }
+
+    void Clear() {
+        out.SetNull();
+        fCoinBase = false;
+        nHeight = 0;
+        nVersion = 0;
+    }
+
+    void swap(Coin &to) {
+        std::swap(to.out.nValue, out.nValue);
+        to.out.scriptPubKey.swap(out.scriptPubKey);
+        std::swap(to.fCoinBase, fCoinBase);
+        std::swap(to.nHeight, nHeight);
+        std::swap(to.nVersion, nVersion);
+    }
+
+    //! equality test
+    friend bool operator==(const Coin &a, const Coin &b) {
+        // Spent coins are always equal.
+        if (a.IsSpent() && b.IsSpent())
+            return true;
+        return a.fCoinBase == b.fCoinBase &&
+               a.nHeight == b.nHeight &&
+               a.nVersion == b.nVersion &&
+               a.out == b.out;
+    }
+    friend bool operator!=(const Coin &a, const Coin &b) {
+        return !(a == b);
+    }
+
+    bool IsCoinBase() const {
+        return fCoinBase;
+    }
+
+    bool IsSpent() const {
+        return out.IsNull();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersionIn) {
+        assert(ser_action.ForRead() || !IsSpent());
+        unsigned int nCode = nHeight * 2 + (fCoinBase ? 1 : 0);
+        READWRITE(VARINT(nCode));
+        nHeight = nCode / 2;
+        fCoinBase = nCode & 1;
+        READWRITE(VARINT(nVersion));
+        READWRITE(REF(CTxOutCompressor(REF(out))));
+    }
+
+    size_t DynamicMemoryUsage() const {
+        return RecursiveDynamicUsage(out.scriptPubKey);
+    }
+};
+
 class CCoinsKeyHasher
 {
 private:
@@ -277,25 +365,33 @@ public:
      * unordered_map will behave unpredictably if the custom hasher returns a
      * uint64_t, resulting in failures when syncing the chain (#4634).
      */
-    size_t operator()(const uint256& key) const {
-        return key.GetHash(salt);
+    size_t operator()(const COutPoint& key) const {
+        // The salted hash is random in all bits, so adding the output index
+        // keeps the outputs of one transaction apart.
+        return key.hash.GetHash(salt) + key.n;
     }
 };
 
 struct CCoinsCacheEntry
 {
-    CCoins coins; // The actual cached data.
+    Coin coin; // The actual cached data.
     unsigned char flags;
+    uint32_t nEpoch; // The cache's epoch (see CCoinsViewCache::Sync) when this entry was last used; fits in the padding after flags.
 
     enum Flags {
         DIRTY = (1 << 0), // This cache entry is potentially different from the version in the parent view.
-        FRESH = (1 << 1), // The parent view does not have this entry (or it is pruned).
+        FRESH = (1 << 1), // The parent view does not have this entry (or it is spent).
+        /* Note that FRESH is a performance optimization with which we can
+         * erase coins that are fully spent if we know we do not need to
+         * flush the changes to the parent cache.  It is always safe to
+         * not mark FRESH if that condition is not guaranteed.
+         */
     };
 
-    CCoinsCacheEntry() : coins(), flags(0) {}
+    CCoinsCacheEntry() : coin(), flags(0), nEpoch(0) {}
 };
 
-typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+typedef boost::unordered_map<COutPoint, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
 
 struct CCoinsStats
 {
@@ -310,25 +406,42 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+/** Usage counters of a CCoinsViewCache */
+struct CCoinsCacheStats
+{
+    uint64_t nHits;            //! Lookups answered from the cache
+    uint64_t nMisses;          //! Lookups that had to ask the backing view
+    size_t nDirtyUsage;        //! Dynamic memory usage of modified entries
+    uint64_t nSyncs;           //! Number of Sync() calls
+    size_t nLastSyncWritten;   //! Entries written by the last Sync()
+    size_t nLastTrimEvicted;   //! Entries evicted by the last Trim()
+
+    CCoinsCacheStats() : nHits(0), nMisses(0), nDirtyUsage(0), nSyncs(0), nLastSyncWritten(0), nLastTrimEvicted(0) {}
+};
+
 
 /** Abstract view on the open txout dataset. */
 class CCoinsView
 {
 public:
-    //! Retrieve the CCoins (unspent transaction outputs) for a given txid
-    virtual bool GetCoins(const uint256 &txid, CCoins &coins) const;
+    //! Retrieve the Coin (unspent transaction output) for a given outpoint.
+    //! Returns true only when an unspent coin was found.
+    virtual bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
 
-    //! Just check whether we have data for a given txid.
-    //! This may (but cannot always) return true for fully spent transactions
-    virtual bool HaveCoins(const uint256 &txid) const;
+    //! Just check whether a given outpoint is unspent.
+    virtual bool HaveCoin(const COutPoint &outpoint) const;
 
     //! Retrieve the block hash whose state this CCoinsView currently represents
     virtual uint256 GetBestBlock() const;
 
-    //! Do a bulk modification (multiple CCoins changes + BestBlock change).
+    //! Do a bulk modification (multiple Coin changes + BestBlock change).
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Like BatchWrite, but leaves mapCoins as it is. The default hands a copy
+    //! of the modified entries to BatchWrite.
+    virtual bool BatchWriteConst(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+
     //! Calculate statistics about the unspent transaction output set
     virtual bool GetStats(CCoinsStats &stats) const;
 
@@ -345,45 +458,20 @@ protected:
 
 public:
     CCoinsViewBacked(CCoinsView *viewIn);
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWriteConst(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
 };
 
 
-class CCoinsViewCache;
-
-/** 
- * A reference to a mutable cache entry. Encapsulating it allows us to run
- *  cleanup code after the modification is finished, and keeping track of
- *  concurrent modifications. 
- */
-class CCoinsModifier
-{
-private:
-    CCoinsViewCache& cache;
-    CCoinsMap::iterator it;
-    size_t cachedCoinUsage; // Cached memory usage of the CCoins object before modification
-    CCoinsModifier(CCoinsViewCache& cache_, CCoinsMap::iterator it_, size_t usage);
-
-public:
-    CCoins* operator->() { return &it->second.coins; }
-    CCoins& operator*() { return it->second.coins; }
-    ~CCoinsModifier();
-    friend class CCoinsViewCache;
-};
-
-/** CCoinsView that adds a memory cache for transactions to another CCoinsView */
+/** CCoinsView that adds a memory cache for transaction outputs to another CCoinsView */
 class CCoinsViewCache : public CCoinsViewBacked
 {
 protected:
-    /* Whether this cache has an active modifier. */
-    bool hasModifier;
-
-
     /**
      * Make mutable so that we can "fill the cache" even from Get-methods
      * declared as "const".  
@@ -391,51 +479,59 @@ protected:
     mutable uint256 hashBlock;
     mutable CCoinsMap cacheCoins;
 
-    /* Cached dynamic memory usage for the inner CCoins objects. */
+    /* Cached dynamic memory usage for the inner Coin objects. */
     mutable size_t cachedCoinsUsage;
 
+    /* Cached dynamic memory usage for the inner Coin objects of DIRTY entries. */
+    size_t cachedDirtyUsage;
+
+    /* Current epoch, advanced by every Sync(); entries remember the epoch they were last used in. */
+    uint32_t nEpoch;
+
+    /* Usage counters; see GetCacheStats(). */
+    mutable CCoinsCacheStats stats;
+
 public:
     CCoinsViewCache(CCoinsView *baseIn);
-    ~CCoinsViewCache();
 
     // Standard CCoinsView methods
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     void SetBestBlock(const uint256 &hashBlock);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWriteConst(const CCoinsMap &mapCoins, const uint256 &hashBlock);
 
     /**
-     * Check if we have the given tx already loaded in this cache.
-     * The semantics are the same as HaveCoins(), but no calls to
+     * Check if we have the given utxo already loaded in this cache.
+     * The semantics are the same as HaveCoin(), but no calls to
      * the backing CCoinsView are made.
      */
-    bool HaveCoinsInCache(const uint256 &txid) const;
+    bool HaveCoinInCache(const COutPoint &outpoint) const;
 
     /**
-     * Return a pointer to CCoins in the cache, or NULL if not found. This is
-     * more efficient than GetCoins. Modifications to other cache entries are
-     * allowed while accessing the returned pointer.
+     * Return a reference to Coin in the cache, or a spent coin if not found.
+     * This is more efficient than GetCoin. Modifications to other cache
+     * entries are allowed while accessing the returned reference, but adding
+     * or spending the same outpoint invalidates it.
      */
-    const CCoins* AccessCoins(const uint256 &txid) const;
+    const Coin& AccessCoin(const COutPoint &outpoint) const;
 
     /**
-     * Return a modifiable reference to a CCoins. If no entry with the given
-     * txid exists, a new one is created. Simultaneous modifications are not
-     * allowed.
+     * Add a coin. Set possible_overwrite to true if an unspent version may
+     * already exist in the cache. Otherwise the new coin is marked FRESH
+     * where possible, which saves a database write and erase if it is spent
+     * before the next flush. This should not be false for the 2 historical
+     * coinbase duplicate pairs, as a spent FRESH coin would not properly
+     * overwrite the first coinbase of the pair.
      */
-    CCoinsModifier ModifyCoins(const uint256 &txid);
+    void AddCoin(const COutPoint &outpoint, const Coin &coin, bool possible_overwrite);
 
     /**
-     * Return a modifiable reference to a CCoins. Assumes that no entry with the given
-     * txid exists and creates a new one. This saves a database access in the case where
-     * the coins were to be wiped out by FromTx anyway.  This should not be called with
-     * the 2 historical coinbase duplicate pairs because the new coins are marked fresh, and
-     * in the event the duplicate coinbase was spent before a flush, the now pruned coins
-     * would not properly overwrite the first coinbase of the pair. Simultaneous modifications
-     * are not allowed.
+     * Spend a coin. Pass moveout in order to get the spent coin back.
+     * Returns false if the coin was not unspent.
      */
-    CCoinsModifier ModifyNewCoins(const uint256 &txid);
+    bool SpendCoin(const COutPoint &outpoint, Coin *moveout = NULL);
 
     /**
      * Push the modifications applied to this cache to its base.
@@ -445,17 +541,36 @@ public:
     bool Flush();
 
     /**
-     * Removes the transaction with the given hash from the cache, if it is
+     * Push the modifications applied to this cache to its base, like Flush(),
+     * but keep every entry that still exists in the cache, now unmodified.
+     * This keeps the cache warm across periodic writes; use Trim() to bound
+     * its size. If false is returned, the state of this cache (and its
+     * backing view) will be undefined.
+     */
+    bool Sync();
+
+    /**
+     * Evict unmodified entries, least recently used (by Sync() epoch) first,
+     * until the dynamic memory usage is at most nMaxUsage or only modified
+     * entries remain. Returns the number of entries evicted.
+     */
+    size_t Trim(size_t nMaxUsage);
+
+    /**
+     * Removes the UTXO with the given outpoint from the cache, if it is
      * not modified.
      */
-    void Uncache(const uint256 &txid);
+    void Uncache(const COutPoint &outpoint);
 
-    //! Calculate the size of the cache (in number of transactions)
+    //! Calculate the size of the cache (in number of transaction outputs)
     unsigned int GetCacheSize() const;
 
     //! Calculate the size of the cache (in bytes)
     size_t DynamicMemoryUsage() const;
 
+    //! Return the cache's usage counters
+    CCoinsCacheStats GetCacheStats() const;
+
     /** 
      * Amount of crowcoins coming in to a transaction
      * Note that lightweight clients may not know anything besides the hash of previous transactions,
@@ -478,11 +593,8 @@ public:
 
     const CTxOut &GetOutputFor(const CTxIn& input) const;
 
-    friend class CCoinsModifier;
-
 private:
-    CCoinsMap::iterator FetchCoins(const uint256 &txid);
-    CCoinsMap::const_iterator FetchCoins(const uint256 &txid) const;
+    CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 
     /**
      * By making the copy constructor private, we prevent accidentally using it when one intends to create a cache on top of a base cache.
@@ -490,4 +602,15 @@ private:
     CCoinsViewCache(const CCoinsViewCache &);
 };
 
+//! Add all of a transaction's outputs to a cache.
+//! With fCheck false, this assumes that only coinbase transactions can
+//! overwrite existing outputs; with fCheck true, the view is asked whether
+//! an output already exists.
+void AddCoins(CCoinsViewCache& cache, const CTransaction &tx, int nHeight, bool fCheck = false);
+
+//! Find any unspent output of the transaction with the given txid, or return
+//! a spent coin. This looks up every possible output index in turn, so it is
+//! slow for transactions without unspent outputs.
+const Coin& AccessByTxid(const CCoinsViewCache& view, const uint256& txid);
+
 #endif // CROWCOIN_COINS_H
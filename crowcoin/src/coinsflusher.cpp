@@ -0,0 +1,188 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsflusher.h"
+
+#include "main.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <stdexcept>
+
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+CCoinsViewFlusher::CCoinsViewFlusher(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), state(IDLE), fFailed(false), nWriters(0), nLastWriteDuration(0) {}
+
+void CCoinsViewFlusher::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nWriters++;
+    try {
+        while (true) {
+            while (state != QUEUED)
+                condWriter.wait(lock);
+            state = WRITING;
+            if (!WriteLocked(lock))
+                AbortLocked(lock);
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Don't leave a batch behind that was already handed over.
+        if (state == QUEUED) {
+            state = WRITING;
+            if (!WriteLocked(lock))
+                AbortLocked(lock);
+        }
+        nWriters--;
+        throw;
+    }
+}
+
+bool CCoinsViewFlusher::WriteLocked(boost::unique_lock<boost::mutex>& lock)
+{
+    // Readers keep looking at mapWriting until the write is done, so the
+    // base must leave it alone. Nothing modifies mapWriting while WRITING, so
+    // it can be written without the lock.
+    lock.unlock();
+    int64_t nStart = GetTimeMicros();
+    bool fOk = false;
+    try {
+        fOk = base->BatchWriteConst(mapWriting, hashWriting);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (!fOk)
+        LogPrintf("%s: failed to write to coin database\n", __func__);
+    int64_t nDuration = GetTimeMicros() - nStart;
+    lock.lock();
+
+    // After a failed write the database is behind the caches above, which
+    // already dropped the spent entries, so keep answering reads from the
+    // batch rather than from stale records on disk.
+    if (fOk) {
+        mapWriting.clear();
+        hashWriting.SetNull();
+    }
+    state = IDLE;
+    fFailed |= !fOk;
+    nLastWriteDuration = nDuration;
+    condDone.notify_all();
+    return fOk;
+}
+
+void CCoinsViewFlusher::AbortLocked(boost::unique_lock<boost::mutex>& lock)
+{
+    lock.unlock();
+    AbortNode("Failed to write to coin database");
+    lock.lock();
+}
+
+bool CCoinsViewFlusher::Wait() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (state != IDLE)
+        condDone.wait(lock);
+    return !fFailed;
+}
+
+int64_t CCoinsViewFlusher::GetLastWriteDuration() const
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    return nLastWriteDuration;
+}
+
+bool CCoinsViewFlusher::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapWriting.find(outpoint);
+        if (it != mapWriting.end()) {
+            // Spent coins are not going to be in the database.
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewFlusher::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        CCoinsMap::const_iterator it = mapWriting.find(outpoint);
+        if (it != mapWriting.end())
+            return !it->second.coin.IsSpent();
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewFlusher::GetBestBlock() const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!hashWriting.IsNull())
+            return hashWriting;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewFlusher::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (state != IDLE)
+        condDone.wait(lock);
+    if (fFailed)
+        return false;
+
+    // Take over the whole map, which leaves the caller with the empty one
+    // mapWriting is when idle, and drop the unmodified entries, which are of
+    // no interest to the base.
+    mapWriting.swap(mapCoins);
+    for (CCoinsMap::iterator it = mapWriting.begin(); it != mapWriting.end();) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            ++it;
+        else
+            mapWriting.erase(it++);
+    }
+    return QueueLocked(lock, hashBlock);
+}
+
+bool CCoinsViewFlusher::BatchWriteConst(const CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    while (state != IDLE)
+        condDone.wait(lock);
+    if (fFailed)
+        return false;
+
+    // The caller keeps using its entries, so the write needs its own copy.
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            mapWriting.insert(*it);
+    }
+    return QueueLocked(lock, hashBlock);
+}
+
+bool CCoinsViewFlusher::QueueLocked(boost::unique_lock<boost::mutex>& lock, const uint256& hashBlock)
+{
+    hashWriting = hashBlock;
+
+    if (nWriters == 0) {
+        state = WRITING;
+        return WriteLocked(lock);
+    }
+    state = QUEUED;
+    condWriter.notify_one();
+    return true;
+}
+
+bool CCoinsViewFlusher::GetStats(CCoinsStats& stats) const
+{
+    // Statistics come from the database itself, so let it catch up first.
+    if (!Wait())
+        return false;
+    return base->GetStats(stats);
+}
@@ -0,0 +1,99 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_COINSFLUSHER_H
+#define CROWCOIN_COINSFLUSHER_H
+
+#include "coins.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** -asyncflush default (write the chainstate to disk from a background thread) */
+static const bool DEFAULT_ASYNC_FLUSH = true;
+
+/**
+ * CCoinsView layer that writes to its backing view in the background.
+ *
+ * BatchWrite() only takes over the modified entries and returns, leaving the
+ * actual write (normally a coin database batch, including the best block
+ * marker, so the database on disk always describes a single block) to a
+ * writer thread. Until that write completed, reads through this view are
+ * answered from the entries being written. A batch handed over while the
+ * previous one is still being written waits for it first, so there is at
+ * most one batch in flight.
+ *
+ * Without a running writer thread (e.g. during shutdown) BatchWrite() writes
+ * synchronously.
+ *
+ * A failed write is fatal: the writer thread aborts the node, and the failed
+ * batch keeps answering reads, as the caches above have already forgotten
+ * what it changed.
+ */
+class CCoinsViewFlusher : public CCoinsViewBacked
+{
+private:
+    enum State {
+        IDLE,
+        QUEUED,
+        WRITING
+    };
+
+    //! Protects all state below.
+    mutable boost::mutex cs;
+
+    //! The writer blocks on this when out of work
+    boost::condition_variable condWriter;
+
+    //! Signalled whenever a write finished
+    mutable boost::condition_variable condDone;
+
+    State state;
+
+    //! The entries (and best block) being written, if not IDLE, or that failed to be written.
+    CCoinsMap mapWriting;
+    uint256 hashWriting;
+
+    //! Whether a write to the backing view failed; it is not retried.
+    bool fFailed;
+
+    //! Number of writer threads running.
+    int nWriters;
+
+    //! How long the last write took, in microseconds.
+    int64_t nLastWriteDuration;
+
+    //! Write mapWriting to the backing view, with cs released in the meantime.
+    bool WriteLocked(boost::unique_lock<boost::mutex>& lock);
+
+    //! Shut the node down after a failed write, with cs released in the meantime.
+    void AbortLocked(boost::unique_lock<boost::mutex>& lock);
+
+    //! Hand mapWriting over to the writer thread, or write it right away without one.
+    bool QueueLocked(boost::unique_lock<boost::mutex>& lock, const uint256& hashBlock);
+
+public:
+    CCoinsViewFlusher(CCoinsView* viewIn);
+
+    //! Writer thread
+    void Thread();
+
+    /** Wait until everything handed over was written. Returns false if any write failed. */
+    bool Wait() const;
+
+    //! How long the last write to the backing view took, in microseconds
+    int64_t GetLastWriteDuration() const;
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
+    uint256 GetBestBlock() const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWriteConst(const CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool GetStats(CCoinsStats& stats) const;
+};
+
+#endif // CROWCOIN_COINSFLUSHER_H
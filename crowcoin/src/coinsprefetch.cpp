@@ -0,0 +1,117 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "coinsprefetch.h"
+
+#include <boost/foreach.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/thread.hpp>
+
+CCoinsViewPrefetch::CCoinsViewPrefetch(CCoinsView* viewIn) : CCoinsViewBacked(viewIn), nFetching(0), nWorkers(0) {}
+
+void CCoinsViewPrefetch::Thread()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    nWorkers++;
+    try {
+        while (true) {
+            while (queue.empty())
+                condWorker.wait(lock);
+            COutPoint outpoint = queue.front();
+            queue.pop_front();
+            std::map<COutPoint, Entry>::iterator it = mapEntries.find(outpoint);
+            if (it == mapEntries.end() || it->second.state != QUEUED)
+                continue;
+            it->second.state = FETCHING;
+            nFetching++;
+
+            // Entries are only erased once they are DONE, so the iterator
+            // stays valid while the lock is released.
+            Entry& entry = it->second;
+            lock.unlock();
+            bool fFound = base->GetCoin(outpoint, entry.coin);
+            lock.lock();
+            entry.fFound = fFound;
+            entry.state = DONE;
+            nFetching--;
+            condFetched.notify_all();
+        }
+    } catch (const boost::thread_interrupted&) {
+        nWorkers--;
+        throw;
+    }
+}
+
+void CCoinsViewPrefetch::Prefetch(const std::vector<COutPoint>& vOutPoint)
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    ClearLocked(lock);
+    if (nWorkers == 0)
+        return;
+    BOOST_FOREACH(const COutPoint& outpoint, vOutPoint) {
+        if (mapEntries.insert(std::make_pair(outpoint, Entry())).second)
+            queue.push_back(outpoint);
+    }
+    condWorker.notify_all();
+}
+
+void CCoinsViewPrefetch::ClearLocked(boost::unique_lock<boost::mutex>& lock)
+{
+    queue.clear();
+    while (nFetching)
+        condFetched.wait(lock);
+    mapEntries.clear();
+}
+
+void CCoinsViewPrefetch::Clear()
+{
+    boost::unique_lock<boost::mutex> lock(cs);
+    ClearLocked(lock);
+}
+
+bool CCoinsViewPrefetch::GetCoin(const COutPoint& outpoint, Coin& coin) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::map<COutPoint, Entry>::iterator it = mapEntries.find(outpoint);
+        if (it != mapEntries.end()) {
+            // A worker is reading this right now; waiting is cheaper than
+            // reading it a second time.
+            while (it->second.state == FETCHING)
+                condFetched.wait(lock);
+            if (it->second.state == DONE) {
+                bool fFound = it->second.fFound;
+                coin.swap(it->second.coin);
+                mapEntries.erase(it);
+                return fFound;
+            }
+            // Nobody picked this one up yet; read it ourselves.
+            mapEntries.erase(it);
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewPrefetch::HaveCoin(const COutPoint& outpoint) const
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::map<COutPoint, Entry>::const_iterator it = mapEntries.find(outpoint);
+        if (it != mapEntries.end() && it->second.state == DONE)
+            return it->second.fFound;
+    }
+    return base->HaveCoin(outpoint);
+}
+
+bool CCoinsViewPrefetch::BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    Clear();
+    return base->BatchWrite(mapCoins, hashBlock);
+}
+
+bool CCoinsViewPrefetch::BatchWriteConst(const CCoinsMap& mapCoins, const uint256& hashBlock)
+{
+    Clear();
+    return base->BatchWriteConst(mapCoins, hashBlock);
+}
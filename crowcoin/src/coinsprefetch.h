@@ -0,0 +1,95 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_COINSPREFETCH_H
+#define CROWCOIN_COINSPREFETCH_H
+
+#include "coins.h"
+#include "primitives/transaction.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/** -prefetchthreads default (number of threads reading block inputs ahead of ConnectBlock) */
+static const int DEFAULT_PREFETCH_THREADS = 4;
+/** Maximum number of coin prefetch threads allowed */
+static const int MAX_PREFETCH_THREADS = 64;
+
+/**
+ * CCoinsView layer that reads coins from its backing view ahead of time.
+ *
+ * Prefetch() hands a list of outpoints to a pool of worker threads, which
+ * read them from the backing view (normally the coin database) in parallel.
+ * A GetCoin() call for one of those outpoints then returns the prefetched
+ * coin, waits for a read that is in flight, or reads the coin itself if no
+ * worker got to it yet. Everything else is passed straight to the backing
+ * view.
+ *
+ * Prefetched coins are handed out once, as the cache above keeps them from
+ * then on, and are dropped whenever anything is written through this view.
+ */
+class CCoinsViewPrefetch : public CCoinsViewBacked
+{
+private:
+    enum EntryState {
+        QUEUED,
+        FETCHING,
+        DONE
+    };
+
+    struct Entry {
+        EntryState state;
+        bool fFound;
+        Coin coin;
+
+        Entry() : state(QUEUED), fFound(false) {}
+    };
+
+    //! Protects all state below.
+    mutable boost::mutex cs;
+
+    //! Workers block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Readers block on this while a worker is fetching their coin
+    mutable boost::condition_variable condFetched;
+
+    //! The coins of the current batch, by outpoint.
+    mutable std::map<COutPoint, Entry> mapEntries;
+
+    //! Outpoints of the current batch that no worker has picked up yet.
+    std::deque<COutPoint> queue;
+
+    //! Number of entries in the FETCHING state.
+    mutable int nFetching;
+
+    //! Number of worker threads running.
+    int nWorkers;
+
+    //! Wait until no fetches are in flight and drop the current batch.
+    void ClearLocked(boost::unique_lock<boost::mutex>& lock);
+
+public:
+    CCoinsViewPrefetch(CCoinsView* viewIn);
+
+    //! Worker thread
+    void Thread();
+
+    /** Start reading the given coins, replacing any earlier batch. */
+    void Prefetch(const std::vector<COutPoint>& vOutPoint);
+
+    /** Drop the current batch, waiting for reads that are in flight. */
+    void Clear();
+
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const;
+    bool HaveCoin(const COutPoint& outpoint) const;
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock);
+    bool BatchWriteConst(const CCoinsMap& mapCoins, const uint256& hashBlock);
+};
+
+#endif // CROWCOIN_COINSPREFETCH_H
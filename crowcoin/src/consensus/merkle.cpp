@@ -1,5 +1,6 @@
 #include "merkle.h"
 #include "hash.h"
+#include "crypto/sha256.h"
 #include "utilstrencodings.h"
 
 /*     WARNING! If you're reading this because you're learning about crypto
@@ -126,10 +127,44 @@ static void MerkleComputation(const std::vector<uint256>& leaves, uint256* proot
     if (proot) *proot = h;
 }
 
+/* Replace each pair of adjacent hashes by their double-SHA256, a whole tree level
+ * at a time, so that the batched (multi-lane) SHA256D64 can be used. An odd last
+ * entry is paired with itself. */
+static void MerkleLevelUp(std::vector<uint256>& hashes, bool* pmutated) {
+    if (pmutated) {
+        for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+            if (hashes[pos] == hashes[pos + 1]) *pmutated = true;
+        }
+    }
+    if (hashes.size() & 1) {
+        hashes.push_back(hashes.back());
+    }
+    SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+    hashes.resize(hashes.size() / 2);
+}
+
+static uint256 ComputeMerkleRootInPlace(std::vector<uint256>& hashes, bool* pmutated) {
+    bool mutation = false;
+    while (hashes.size() > 1) {
+        MerkleLevelUp(hashes, pmutated ? &mutation : NULL);
+    }
+    if (pmutated) *pmutated = mutation;
+    if (hashes.size() == 0) return uint256();
+    return hashes[0];
+}
+
 uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, NULL);
-    return hash;
+    std::vector<uint256> hashes(leaves);
+    return ComputeMerkleRootInPlace(hashes, mutated);
+}
+
+void ComputeMerkleTree(const std::vector<uint256>& leaves, std::vector<std::vector<uint256> >& levels) {
+    levels.clear();
+    levels.push_back(leaves);
+    while (levels.back().size() > 1) {
+        levels.push_back(levels.back());
+        MerkleLevelUp(levels.back(), NULL);
+    }
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position) {
@@ -154,11 +189,12 @@ uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint2
 uint256 BlockMerkleRoot(const CBlock& block, bool* mutated)
 {
     std::vector<uint256> leaves;
+    leaves.reserve((block.vtx.size() + 1) & ~(size_t)1); // Room for the odd-level duplicate
     leaves.resize(block.vtx.size());
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s].GetHash();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRootInPlace(leaves, mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock& block, uint32_t position)
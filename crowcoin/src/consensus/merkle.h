@@ -16,6 +16,14 @@ uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NU
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
+/*
+ * Compute all levels of the Merkle tree over the given leaves. levels[0] is a
+ * copy of the leaves, and each following level holds the parents of the
+ * previous one, the last level being the root. The last node of an odd-sized
+ * level is paired with itself, as in ComputeMerkleRoot.
+ */
+void ComputeMerkleTree(const std::vector<uint256>& leaves, std::vector<std::vector<uint256> >& levels);
+
 /*
  * Compute the Merkle root of the transactions in a block.
  * *mutated is set to true if a duplicated subtree was found.
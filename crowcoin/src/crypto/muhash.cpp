@@ -0,0 +1,177 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/muhash.h"
+
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+
+#include <string.h>
+
+namespace {
+
+typedef Num3072::limb_t limb_t;
+typedef Num3072::double_limb_t double_limb_t;
+
+/** 2^3072 - 1103717 is the largest 3072-bit safe prime. */
+const limb_t MAX_PRIME_DIFF = 1103717;
+const limb_t MAX_LIMB = (limb_t)-1;
+
+/** Add v to the number in r; return what carries out of the top limb. */
+limb_t AddSmall(limb_t* r, double_limb_t v)
+{
+    for (int i = 0; i < Num3072::LIMBS && v; i++) {
+        double_limb_t cur = (double_limb_t)r[i] + (limb_t)v;
+        r[i] = (limb_t)cur;
+        v = (v >> Num3072::LIMB_SIZE) + (cur >> Num3072::LIMB_SIZE);
+    }
+    return (limb_t)v;
+}
+
+/** Whether the number in r is at least the prime, i.e. not fully reduced. */
+bool IsOverflow(const limb_t* r)
+{
+    if (r[0] <= MAX_LIMB - MAX_PRIME_DIFF)
+        return false;
+    for (int i = 1; i < Num3072::LIMBS; i++) {
+        if (r[i] != MAX_LIMB)
+            return false;
+    }
+    return true;
+}
+
+/** Bring a number below 2^3072 below the prime. */
+void FullReduce(limb_t* r)
+{
+    // Subtracting the prime is adding MAX_PRIME_DIFF and dropping 2^3072.
+    if (IsOverflow(r))
+        AddSmall(r, MAX_PRIME_DIFF);
+}
+
+Num3072 GetInverse(const Num3072& a)
+{
+    // a^(p-2) by square and multiply; the limbs of p-2 are all ones except for the lowest.
+    Num3072 r;
+    for (int i = Num3072::LIMBS - 1; i >= 0; i--) {
+        limb_t e = i == 0 ? MAX_LIMB - MAX_PRIME_DIFF - 1 : MAX_LIMB;
+        for (int b = Num3072::LIMB_SIZE - 1; b >= 0; b--) {
+            r.Multiply(r);
+            if ((e >> b) & 1)
+                r.Multiply(a);
+        }
+    }
+    return r;
+}
+
+Num3072 ToNum3072(const unsigned char* data, size_t len)
+{
+    unsigned char seed[CSHA256::OUTPUT_SIZE];
+    CSHA256().Write(data, len).Finalize(seed);
+    unsigned char buf[Num3072::BYTE_SIZE];
+    for (uint32_t i = 0; i < Num3072::BYTE_SIZE / CSHA256::OUTPUT_SIZE; i++) {
+        unsigned char counter[4];
+        WriteLE32(counter, i);
+        CSHA256().Write(seed, sizeof(seed)).Write(counter, sizeof(counter)).Finalize(buf + i * CSHA256::OUTPUT_SIZE);
+    }
+    return Num3072(buf);
+}
+
+}
+
+Num3072::Num3072()
+{
+    limbs[0] = 1;
+    for (int i = 1; i < LIMBS; i++)
+        limbs[i] = 0;
+}
+
+Num3072::Num3072(const unsigned char* data)
+{
+    for (int i = 0; i < LIMBS; i++) {
+        limbs[i] = 0;
+        for (size_t b = 0; b < sizeof(limb_t); b++)
+            limbs[i] |= (limb_t)data[i * sizeof(limb_t) + b] << (8 * b);
+    }
+    FullReduce(limbs);
+}
+
+void Num3072::ToBytes(unsigned char* out) const
+{
+    for (int i = 0; i < LIMBS; i++) {
+        for (size_t b = 0; b < sizeof(limb_t); b++)
+            out[i * sizeof(limb_t) + b] = limbs[i] >> (8 * b);
+    }
+}
+
+void Num3072::Multiply(const Num3072& a)
+{
+    limb_t t[2 * LIMBS];
+    memset(t, 0, sizeof(t));
+    for (int i = 0; i < LIMBS; i++) {
+        limb_t carry = 0;
+        for (int j = 0; j < LIMBS; j++) {
+            double_limb_t cur = (double_limb_t)limbs[i] * a.limbs[j] + t[i + j] + carry;
+            t[i + j] = (limb_t)cur;
+            carry = cur >> LIMB_SIZE;
+        }
+        t[i + LIMBS] = carry;
+    }
+
+    // The upper half is worth MAX_PRIME_DIFF times as much modulo the prime,
+    // which leaves a small carry to fold in the same way.
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++) {
+        double_limb_t cur = (double_limb_t)t[i + LIMBS] * MAX_PRIME_DIFF + t[i] + carry;
+        limbs[i] = (limb_t)cur;
+        carry = cur >> LIMB_SIZE;
+    }
+    while (carry)
+        carry = AddSmall(limbs, (double_limb_t)carry * MAX_PRIME_DIFF);
+    FullReduce(limbs);
+}
+
+void Num3072::Divide(const Num3072& a)
+{
+    Multiply(GetInverse(a));
+}
+
+bool Num3072::operator==(const Num3072& other) const
+{
+    return memcmp(limbs, other.limbs, sizeof(limbs)) == 0;
+}
+
+MuHash3072& MuHash3072::Insert(const unsigned char* data, size_t len)
+{
+    numerator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::Remove(const unsigned char* data, size_t len)
+{
+    denominator.Multiply(ToNum3072(data, len));
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator*=(const MuHash3072& other)
+{
+    numerator.Multiply(other.numerator);
+    denominator.Multiply(other.denominator);
+    return *this;
+}
+
+MuHash3072& MuHash3072::operator/=(const MuHash3072& other)
+{
+    numerator.Multiply(other.denominator);
+    denominator.Multiply(other.numerator);
+    return *this;
+}
+
+void MuHash3072::Finalize(unsigned char hash[OUTPUT_SIZE]) const
+{
+    Num3072 result(numerator);
+    result.Divide(denominator);
+    unsigned char buf[Num3072::BYTE_SIZE];
+    result.ToBytes(buf);
+    CSHA256().Write(buf, sizeof(buf)).Finalize(hash);
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_CRYPTO_MUHASH_H
+#define CROWCOIN_CRYPTO_MUHASH_H
+
+#if defined(HAVE_CONFIG_H)
+#include "crowcoin-config.h"
+#endif
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/** A number modulo the prime 2^3072 - 1103717. */
+class Num3072
+{
+public:
+#ifdef __SIZEOF_INT128__
+    typedef uint64_t limb_t;
+    __extension__ typedef unsigned __int128 double_limb_t;
+#else
+    typedef uint32_t limb_t;
+    typedef uint64_t double_limb_t;
+#endif
+    static const size_t BYTE_SIZE = 384;
+    static const int LIMB_SIZE = sizeof(limb_t) * 8;
+    static const int LIMBS = 3072 / LIMB_SIZE;
+
+    limb_t limbs[LIMBS];
+
+    //! Initialize to 1.
+    Num3072();
+    //! Initialize from BYTE_SIZE little-endian bytes, reduced modulo the prime.
+    explicit Num3072(const unsigned char* data);
+
+    void ToBytes(unsigned char* out) const;
+    void Multiply(const Num3072& a);
+    //! Multiply by the inverse of a, which must not be 0.
+    void Divide(const Num3072& a);
+
+    bool operator==(const Num3072& other) const;
+};
+
+/**
+ * A hash of a set of byte strings that can be updated by adding and removing
+ * elements in any order.
+ *
+ * Every element is hashed to a number modulo a 3072-bit prime (with SHA256 in
+ * counter mode), and the set is represented by the product of its elements'
+ * numbers. Removal multiplies by the inverse, which is deferred by keeping
+ * the numerator and denominator of that product apart; only Finalize() pays
+ * for a modular inversion.
+ */
+class MuHash3072
+{
+private:
+    Num3072 numerator;
+    Num3072 denominator;
+
+public:
+    static const size_t OUTPUT_SIZE = 32;
+
+    //! Hash of the empty set.
+    MuHash3072() {}
+
+    MuHash3072& Insert(const unsigned char* data, size_t len);
+    MuHash3072& Remove(const unsigned char* data, size_t len);
+    //! Turn this into the hash of the union of both (multi)sets.
+    MuHash3072& operator*=(const MuHash3072& other);
+    //! Turn this into the hash of the difference of both (multi)sets.
+    MuHash3072& operator/=(const MuHash3072& other);
+
+    //! SHA256 of the set's number; equal sets give equal output regardless of how they were built.
+    void Finalize(unsigned char hash[OUTPUT_SIZE]) const;
+
+    unsigned int GetSerializeSize(int nType, int nVersion) const
+    {
+        return 2 * Num3072::BYTE_SIZE;
+    }
+
+    template <typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const
+    {
+        unsigned char buf[Num3072::BYTE_SIZE];
+        numerator.ToBytes(buf);
+        s.write((const char*)buf, sizeof(buf));
+        denominator.ToBytes(buf);
+        s.write((const char*)buf, sizeof(buf));
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion)
+    {
+        unsigned char buf[Num3072::BYTE_SIZE];
+        s.read((char*)buf, sizeof(buf));
+        numerator = Num3072(buf);
+        s.read((char*)buf, sizeof(buf));
+        denominator = Num3072(buf);
+    }
+};
+
+#endif // CROWCOIN_CRYPTO_MUHASH_H
@@ -6,8 +6,37 @@
 
 #include "crypto/common.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#include <cpuid.h>
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_CROWCOIN_INTERNAL)
+namespace sha256d64_sse41
+{
+void Transform_4way(unsigned char* out, const unsigned char* in);
+int ScanD80_4way(const uint32_t* pre, uint32_t nonce);
+}
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_CROWCOIN_INTERNAL)
+namespace sha256d64_avx2
+{
+void Transform_8way(unsigned char* out, const unsigned char* in);
+int ScanD80_8way(const uint32_t* pre, uint32_t nonce);
+}
+#endif
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_CROWCOIN_INTERNAL)
+namespace sha256_shani
+{
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks);
+}
+#endif
+
 // Internal implementation code.
 namespace
 {
@@ -43,94 +72,330 @@ void inline Initialize(uint32_t* s)
     s[7] = 0x5be0cd19ul;
 }
 
-/** Perform one SHA-256 transformation, processing a 64-byte chunk. */
-void Transform(uint32_t* s, const unsigned char* chunk)
-{
-    uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
-    uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
-
-    Round(a, b, c, d, e, f, g, h, 0x428a2f98, w0 = ReadBE32(chunk + 0));
-    Round(h, a, b, c, d, e, f, g, 0x71374491, w1 = ReadBE32(chunk + 4));
-    Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, w2 = ReadBE32(chunk + 8));
-    Round(f, g, h, a, b, c, d, e, 0xe9b5dba5, w3 = ReadBE32(chunk + 12));
-    Round(e, f, g, h, a, b, c, d, 0x3956c25b, w4 = ReadBE32(chunk + 16));
-    Round(d, e, f, g, h, a, b, c, 0x59f111f1, w5 = ReadBE32(chunk + 20));
-    Round(c, d, e, f, g, h, a, b, 0x923f82a4, w6 = ReadBE32(chunk + 24));
-    Round(b, c, d, e, f, g, h, a, 0xab1c5ed5, w7 = ReadBE32(chunk + 28));
-    Round(a, b, c, d, e, f, g, h, 0xd807aa98, w8 = ReadBE32(chunk + 32));
-    Round(h, a, b, c, d, e, f, g, 0x12835b01, w9 = ReadBE32(chunk + 36));
-    Round(g, h, a, b, c, d, e, f, 0x243185be, w10 = ReadBE32(chunk + 40));
-    Round(f, g, h, a, b, c, d, e, 0x550c7dc3, w11 = ReadBE32(chunk + 44));
-    Round(e, f, g, h, a, b, c, d, 0x72be5d74, w12 = ReadBE32(chunk + 48));
-    Round(d, e, f, g, h, a, b, c, 0x80deb1fe, w13 = ReadBE32(chunk + 52));
-    Round(c, d, e, f, g, h, a, b, 0x9bdc06a7, w14 = ReadBE32(chunk + 56));
-    Round(b, c, d, e, f, g, h, a, 0xc19bf174, w15 = ReadBE32(chunk + 60));
-
-    Round(a, b, c, d, e, f, g, h, 0xe49b69c1, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0xefbe4786, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x0fc19dc6, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x240ca1cc, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x2de92c6f, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x4a7484aa, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x76f988da, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0x983e5152, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0xa831c66d, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0xb00327c8, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0xbf597fc7, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0xc6e00bf3, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xd5a79147, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0x06ca6351, w14 += sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0x14292967, w15 += sigma1(w13) + w8 + sigma0(w0));
-
-    Round(a, b, c, d, e, f, g, h, 0x27b70a85, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0x2e1b2138, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x53380d13, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x650a7354, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x766a0abb, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x81c2c92e, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x92722c85, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0xa81a664b, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0xc24b8b70, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0xc76c51a3, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0xd192e819, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xd6990624, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0xf40e3585, w14 += sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0x106aa070, w15 += sigma1(w13) + w8 + sigma0(w0));
-
-    Round(a, b, c, d, e, f, g, h, 0x19a4c116, w0 += sigma1(w14) + w9 + sigma0(w1));
-    Round(h, a, b, c, d, e, f, g, 0x1e376c08, w1 += sigma1(w15) + w10 + sigma0(w2));
-    Round(g, h, a, b, c, d, e, f, 0x2748774c, w2 += sigma1(w0) + w11 + sigma0(w3));
-    Round(f, g, h, a, b, c, d, e, 0x34b0bcb5, w3 += sigma1(w1) + w12 + sigma0(w4));
-    Round(e, f, g, h, a, b, c, d, 0x391c0cb3, w4 += sigma1(w2) + w13 + sigma0(w5));
-    Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a, w5 += sigma1(w3) + w14 + sigma0(w6));
-    Round(c, d, e, f, g, h, a, b, 0x5b9cca4f, w6 += sigma1(w4) + w15 + sigma0(w7));
-    Round(b, c, d, e, f, g, h, a, 0x682e6ff3, w7 += sigma1(w5) + w0 + sigma0(w8));
-    Round(a, b, c, d, e, f, g, h, 0x748f82ee, w8 += sigma1(w6) + w1 + sigma0(w9));
-    Round(h, a, b, c, d, e, f, g, 0x78a5636f, w9 += sigma1(w7) + w2 + sigma0(w10));
-    Round(g, h, a, b, c, d, e, f, 0x84c87814, w10 += sigma1(w8) + w3 + sigma0(w11));
-    Round(f, g, h, a, b, c, d, e, 0x8cc70208, w11 += sigma1(w9) + w4 + sigma0(w12));
-    Round(e, f, g, h, a, b, c, d, 0x90befffa, w12 += sigma1(w10) + w5 + sigma0(w13));
-    Round(d, e, f, g, h, a, b, c, 0xa4506ceb, w13 += sigma1(w11) + w6 + sigma0(w14));
-    Round(c, d, e, f, g, h, a, b, 0xbef9a3f7, w14 + sigma1(w12) + w7 + sigma0(w15));
-    Round(b, c, d, e, f, g, h, a, 0xc67178f2, w15 + sigma1(w13) + w8 + sigma0(w0));
-
-    s[0] += a;
-    s[1] += b;
-    s[2] += c;
-    s[3] += d;
-    s[4] += e;
-    s[5] += f;
-    s[6] += g;
-    s[7] += h;
+/** Perform a number of SHA-256 transformations, processing 64-byte chunks. */
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    while (blocks--) {
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        uint32_t w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
+
+        Round(a, b, c, d, e, f, g, h, 0x428a2f98, w0 = ReadBE32(chunk + 0));
+        Round(h, a, b, c, d, e, f, g, 0x71374491, w1 = ReadBE32(chunk + 4));
+        Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, w2 = ReadBE32(chunk + 8));
+        Round(f, g, h, a, b, c, d, e, 0xe9b5dba5, w3 = ReadBE32(chunk + 12));
+        Round(e, f, g, h, a, b, c, d, 0x3956c25b, w4 = ReadBE32(chunk + 16));
+        Round(d, e, f, g, h, a, b, c, 0x59f111f1, w5 = ReadBE32(chunk + 20));
+        Round(c, d, e, f, g, h, a, b, 0x923f82a4, w6 = ReadBE32(chunk + 24));
+        Round(b, c, d, e, f, g, h, a, 0xab1c5ed5, w7 = ReadBE32(chunk + 28));
+        Round(a, b, c, d, e, f, g, h, 0xd807aa98, w8 = ReadBE32(chunk + 32));
+        Round(h, a, b, c, d, e, f, g, 0x12835b01, w9 = ReadBE32(chunk + 36));
+        Round(g, h, a, b, c, d, e, f, 0x243185be, w10 = ReadBE32(chunk + 40));
+        Round(f, g, h, a, b, c, d, e, 0x550c7dc3, w11 = ReadBE32(chunk + 44));
+        Round(e, f, g, h, a, b, c, d, 0x72be5d74, w12 = ReadBE32(chunk + 48));
+        Round(d, e, f, g, h, a, b, c, 0x80deb1fe, w13 = ReadBE32(chunk + 52));
+        Round(c, d, e, f, g, h, a, b, 0x9bdc06a7, w14 = ReadBE32(chunk + 56));
+        Round(b, c, d, e, f, g, h, a, 0xc19bf174, w15 = ReadBE32(chunk + 60));
+
+        Round(a, b, c, d, e, f, g, h, 0xe49b69c1, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0xefbe4786, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x0fc19dc6, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x240ca1cc, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x2de92c6f, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x4a7484aa, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x5cb0a9dc, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x76f988da, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0x983e5152, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0xa831c66d, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0xb00327c8, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0xbf597fc7, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0xc6e00bf3, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xd5a79147, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0x06ca6351, w14 += sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0x14292967, w15 += sigma1(w13) + w8 + sigma0(w0));
+
+        Round(a, b, c, d, e, f, g, h, 0x27b70a85, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0x2e1b2138, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x4d2c6dfc, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x53380d13, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x650a7354, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x766a0abb, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x81c2c92e, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x92722c85, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0xa2bfe8a1, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0xa81a664b, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0xc24b8b70, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0xc76c51a3, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0xd192e819, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xd6990624, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0xf40e3585, w14 += sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0x106aa070, w15 += sigma1(w13) + w8 + sigma0(w0));
+
+        Round(a, b, c, d, e, f, g, h, 0x19a4c116, w0 += sigma1(w14) + w9 + sigma0(w1));
+        Round(h, a, b, c, d, e, f, g, 0x1e376c08, w1 += sigma1(w15) + w10 + sigma0(w2));
+        Round(g, h, a, b, c, d, e, f, 0x2748774c, w2 += sigma1(w0) + w11 + sigma0(w3));
+        Round(f, g, h, a, b, c, d, e, 0x34b0bcb5, w3 += sigma1(w1) + w12 + sigma0(w4));
+        Round(e, f, g, h, a, b, c, d, 0x391c0cb3, w4 += sigma1(w2) + w13 + sigma0(w5));
+        Round(d, e, f, g, h, a, b, c, 0x4ed8aa4a, w5 += sigma1(w3) + w14 + sigma0(w6));
+        Round(c, d, e, f, g, h, a, b, 0x5b9cca4f, w6 += sigma1(w4) + w15 + sigma0(w7));
+        Round(b, c, d, e, f, g, h, a, 0x682e6ff3, w7 += sigma1(w5) + w0 + sigma0(w8));
+        Round(a, b, c, d, e, f, g, h, 0x748f82ee, w8 += sigma1(w6) + w1 + sigma0(w9));
+        Round(h, a, b, c, d, e, f, g, 0x78a5636f, w9 += sigma1(w7) + w2 + sigma0(w10));
+        Round(g, h, a, b, c, d, e, f, 0x84c87814, w10 += sigma1(w8) + w3 + sigma0(w11));
+        Round(f, g, h, a, b, c, d, e, 0x8cc70208, w11 += sigma1(w9) + w4 + sigma0(w12));
+        Round(e, f, g, h, a, b, c, d, 0x90befffa, w12 += sigma1(w10) + w5 + sigma0(w13));
+        Round(d, e, f, g, h, a, b, c, 0xa4506ceb, w13 += sigma1(w11) + w6 + sigma0(w14));
+        Round(c, d, e, f, g, h, a, b, 0xbef9a3f7, w14 + sigma1(w12) + w7 + sigma0(w15));
+        Round(b, c, d, e, f, g, h, a, 0xc67178f2, w15 + sigma1(w13) + w8 + sigma0(w0));
+
+        s[0] += a;
+        s[1] += b;
+        s[2] += c;
+        s[3] += d;
+        s[4] += e;
+        s[5] += f;
+        s[6] += g;
+        s[7] += h;
+        chunk += 64;
+    }
 }
 
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t*, const unsigned char*, size_t);
+typedef void (*TransformD64Type)(unsigned char*, const unsigned char*);
+typedef int (*ScanD80Type)(const uint32_t*, uint32_t);
+
+/** Compute the double SHA-256 of a single 64-byte input using a given single-buffer transform. */
+template<TransformType tr>
+void TransformD64Wrapper(unsigned char* out, const unsigned char* in)
+{
+    uint32_t s[8];
+    static const unsigned char padding1[64] = {
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(out + 4 * i, s[i]);
+}
+
+/** Test a single nonce of an 80-byte block header using a given single-buffer transform; see SHA256D80Scan for the layout of pre. */
+template<TransformType tr>
+int ScanD80Wrapper(const uint32_t* pre, uint32_t nonce)
+{
+    uint32_t s[8];
+    unsigned char buffer1[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 0x80
+    };
+    unsigned char buffer2[64] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0
+    };
+    memcpy(s, pre, sizeof(s));
+    WriteBE32(buffer1, pre[16]);
+    WriteBE32(buffer1 + 4, pre[17]);
+    WriteBE32(buffer1 + 8, pre[18]);
+    WriteLE32(buffer1 + 12, nonce);
+    tr(s, buffer1, 1);
+    for (int i = 0; i < 8; i++)
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    return (s[7] & 0xffff) == 0;
+}
+
+/** Implementations selected by SHA256AutoDetect(). The multi-way ones stay NULL when unavailable. */
+TransformType Transform = sha256::Transform;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::Transform>;
+TransformD64Type TransformD64_4way = NULL;
+TransformD64Type TransformD64_8way = NULL;
+ScanD80Type ScanD80 = ScanD80Wrapper<sha256::Transform>;
+ScanD80Type ScanD80_4way = NULL;
+ScanD80Type ScanD80_8way = NULL;
+
+bool SelfTest() {
+    // Input state (equal to the initial SHA256 state)
+    static const uint32_t init[8] = {
+        0x6a09e667ul, 0xbb67ae85ul, 0x3c6ef372ul, 0xa54ff53aul, 0x510e527ful, 0x9b05688cul, 0x1f83d9abul, 0x5be0cd19ul
+    };
+    // Some input data to test with; the leading "-" makes every 64-byte chunk start unaligned
+    static const unsigned char data[] =
+        "-The quick brown fox jumps over the lazy dog. The quick brown fo"
+        "x jumps over the lazy dog. The quick brown fox jumps over the la"
+        "zy dog. The quick brown fox jumps over the lazy dog. The quick b"
+        "rown fox jumps over the lazy dog. The quick brown fox jumps over"
+        " the lazy dog. The quick brown fox jumps over the lazy dog. The "
+        "quick brown fox jumps over the lazy dog. The quick brown fox jum"
+        "ps over the lazy dog. The quick brown fox jumps over the lazy do"
+        "g. The quick brown fox jumps over the lazy dog. The quick brown "
+        "f";
+    // Expected output state for transforming the first 1, 4 and 8 chunks of data, starting from init
+    static const uint32_t result[3][8] = {
+        {0x5c000caeul, 0x8ed21952ul, 0x8a344222ul, 0xc75adb61ul, 0x7a8c8794ul, 0xfcbcdaa0ul, 0x85995fa1ul, 0x325753fcul},
+        {0x992b5384ul, 0x0931a5e9ul, 0x1c310ed3ul, 0xe939554aul, 0x28bf12e2ul, 0x0977b9a0ul, 0xc24d8720ul, 0xd61c87acul},
+        {0xf1a41e89ul, 0xff2ad85bul, 0x4fa2faa7ul, 0xfc98a3a7ul, 0xd0c53e66ul, 0x3de3aa4ful, 0x5b593ef8ul, 0x5d7160aful},
+    };
+    // Expected double-SHA256 of each of the 8 chunks of data
+    static const unsigned char result_d64[256] = {
+        0x42, 0x5f, 0x72, 0x23, 0xd2, 0x52, 0xcb, 0xdc, 0x11, 0x69, 0x5c, 0xcc, 0xd5, 0x73, 0xcd, 0x23,
+        0x9e, 0xa3, 0xc0, 0xef, 0xbb, 0xcf, 0xcf, 0xf5, 0xc5, 0x08, 0x37, 0xef, 0xac, 0x9a, 0x61, 0x82,
+        0x19, 0xd5, 0x1a, 0x9c, 0x00, 0x7e, 0xfe, 0x52, 0x66, 0x6e, 0x0d, 0x62, 0x3e, 0xa2, 0xe5, 0x3e,
+        0xc3, 0x8b, 0x79, 0x1c, 0xae, 0xb1, 0x72, 0x84, 0x2b, 0x51, 0x01, 0x91, 0x54, 0x9c, 0x94, 0x64,
+        0xe1, 0x7b, 0x3e, 0x6e, 0x72, 0x7b, 0x17, 0xa6, 0xe2, 0x0c, 0x6c, 0x10, 0x54, 0xc7, 0xfd, 0xa1,
+        0x4c, 0x21, 0x55, 0xf5, 0x57, 0x28, 0x53, 0xf6, 0x88, 0xee, 0xd3, 0xe6, 0xde, 0x37, 0x27, 0x15,
+        0xd8, 0x58, 0x97, 0x0d, 0x0d, 0xf4, 0x56, 0x75, 0x2e, 0x68, 0x13, 0x1c, 0x68, 0xc6, 0x8e, 0x36,
+        0x16, 0x04, 0x33, 0x50, 0xe9, 0x15, 0x8d, 0xcd, 0x63, 0x4c, 0xb3, 0x15, 0x4d, 0x6e, 0x5f, 0x56,
+        0x83, 0xf6, 0x3e, 0x99, 0xdb, 0x9a, 0xad, 0x7c, 0x8e, 0xd7, 0x3e, 0x30, 0x36, 0x3b, 0x14, 0x5c,
+        0x05, 0x63, 0xcd, 0x4b, 0xe1, 0x00, 0xbb, 0xbe, 0xe9, 0xc3, 0xcf, 0x3c, 0x62, 0x69, 0x50, 0x5f,
+        0x2f, 0x0d, 0x0d, 0x8b, 0x6a, 0x82, 0x52, 0x0e, 0x49, 0xea, 0x84, 0xd6, 0xa2, 0xd4, 0x2f, 0x54,
+        0x88, 0xf4, 0x23, 0xae, 0xa4, 0x80, 0x52, 0xbf, 0xd4, 0x73, 0x4f, 0x51, 0x98, 0xad, 0xd7, 0xef,
+        0xe2, 0x10, 0x01, 0xb1, 0xd6, 0x21, 0x6b, 0xbd, 0xc1, 0x71, 0xcc, 0x9a, 0x73, 0x14, 0x4f, 0xf1,
+        0xee, 0xc3, 0x14, 0x98, 0xd4, 0x11, 0xd2, 0x95, 0x76, 0x49, 0x5d, 0xb4, 0x80, 0xa8, 0xc3, 0xc2,
+        0xbf, 0xf0, 0xc9, 0x58, 0x79, 0x64, 0x2c, 0xb5, 0x63, 0xd3, 0x40, 0x10, 0xa0, 0xd9, 0xf4, 0x4f,
+        0x16, 0xc2, 0xf3, 0x17, 0x05, 0xf1, 0xfa, 0x4f, 0x55, 0xc8, 0xe6, 0xbe, 0x76, 0x14, 0x3b, 0xb4,
+    };
+
+    // Test Transform() for 1, 4 and 8 chunks at once.
+    static const size_t blocks[3] = {1, 4, 8};
+    for (int i = 0; i < 3; i++) {
+        uint32_t state[8];
+        memcpy(state, init, sizeof(state));
+        Transform(state, data + 1, blocks[i]);
+        if (memcmp(state, result[i], sizeof(state))) return false;
+    }
+
+    // Test TransformD64 on every chunk.
+    unsigned char out[256];
+    for (int i = 0; i < 8; i++) {
+        TransformD64(out, data + 1 + 64 * i);
+        if (memcmp(out, result_d64 + 32 * i, 32)) return false;
+    }
+
+    // Test the multi-way implementations, if available.
+    if (TransformD64_4way) {
+        TransformD64_4way(out, data + 1);
+        if (memcmp(out, result_d64, 128)) return false;
+    }
+    if (TransformD64_8way) {
+        TransformD64_8way(out, data + 1);
+        if (memcmp(out, result_d64, 256)) return false;
+    }
+
+    return true;
+}
+
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+/** Execute CPUID with the given leaf and subleaf. */
+void inline cpuid(uint32_t leaf, uint32_t subleaf, uint32_t& a, uint32_t& b, uint32_t& c, uint32_t& d)
+{
+    __cpuid_count(leaf, subleaf, a, b, c, d);
+}
+
+#if defined(ENABLE_SHANI) && !defined(BUILD_CROWCOIN_INTERNAL)
+/** Check for the SHA extensions, and SSE4.1 which the SHA-NI transform also uses. */
+bool HaveSHANI()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    if (eax < 7) return false;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    const bool have_sse4 = (ecx >> 19) & 1;
+    cpuid(7, 0, eax, ebx, ecx, edx);
+    return have_sse4 && ((ebx >> 29) & 1);
+}
+#endif
+
+#if defined(ENABLE_SSE41) && !defined(BUILD_CROWCOIN_INTERNAL)
+/** Check for SSE4.1. */
+bool HaveSSE41()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    return (ecx >> 19) & 1;
+}
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_CROWCOIN_INTERNAL)
+/** Check for AVX2, and that the OS has enabled saving of the AVX (YMM) register state. */
+bool HaveAVX2()
+{
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(0, 0, eax, ebx, ecx, edx);
+    if (eax < 7) return false;
+    cpuid(1, 0, eax, ebx, ecx, edx);
+    const bool have_xsave = (ecx >> 27) & 1;
+    const bool have_avx = (ecx >> 28) & 1;
+    if (!have_xsave || !have_avx) return false;
+    uint32_t a, d;
+    __asm__("xgetbv" : "=a"(a), "=d"(d) : "c"(0));
+    if ((a & 6) != 6) return false;
+    cpuid(7, 0, eax, ebx, ecx, edx);
+    return (ebx >> 5) & 1;
+}
+#endif
+#endif
 } // namespace
 
 
+std::string SHA256AutoDetect()
+{
+    std::string ret = "standard";
+#if defined(USE_ASM) && (defined(__x86_64__) || defined(__amd64__) || defined(__i386__))
+#if defined(ENABLE_SHANI) && !defined(BUILD_CROWCOIN_INTERNAL)
+    if (HaveSHANI()) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        ScanD80 = ScanD80Wrapper<sha256_shani::Transform>;
+        ret = "shani(1way)";
+    }
+#endif
+
+    // The dedicated instructions beat the multi-way code paths, so those are
+    // only used on top of the standard transform.
+#if defined(ENABLE_SSE41) && !defined(BUILD_CROWCOIN_INTERNAL)
+    if (Transform == sha256::Transform && HaveSSE41()) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ScanD80_4way = sha256d64_sse41::ScanD80_4way;
+        ret += ",sse41(4way)";
+    }
+#endif
+
+#if defined(ENABLE_AVX2) && !defined(BUILD_CROWCOIN_INTERNAL)
+    if (Transform == sha256::Transform && HaveAVX2()) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ScanD80_8way = sha256d64_avx2::ScanD80_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+#endif
+
+    // Always run the self-test, also in builds with NDEBUG
+    if (!SelfTest()) {
+        fprintf(stderr, "SHA256AutoDetect: self-test of the selected SHA-256 implementation failed\n");
+        abort();
+    }
+    return ret;
+}
+
 ////// SHA-256
 
 CSHA256::CSHA256() : bytes(0)
@@ -147,14 +412,15 @@ CSHA256& CSHA256::Write(const unsigned char* data, size_t len)
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
+        size_t blocks = (end - data) / 64;
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -187,3 +453,78 @@ CSHA256& CSHA256::Reset()
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(unsigned char* out, const unsigned char* in, size_t blocks)
+{
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
+
+bool SHA256D80Scan(const unsigned char* header, uint32_t& nonce, uint32_t count)
+{
+    // Everything the per-nonce kernels need that does not depend on the nonce:
+    // pre[0..7]:   the SHA-256 state after the first 64 bytes of the header (the midstate)
+    // pre[8..15]:  the working variables a..h after rounds 0-2 of the second chunk
+    // pre[16..18]: message words 0-2 of the second chunk (the header bytes 64-75)
+    uint32_t pre[19];
+    sha256::Initialize(pre);
+    Transform(pre, header, 1);
+    uint32_t a = pre[0], b = pre[1], c = pre[2], d = pre[3], e = pre[4], f = pre[5], g = pre[6], h = pre[7];
+    sha256::Round(a, b, c, d, e, f, g, h, 0x428a2f98, pre[16] = ReadBE32(header + 64));
+    sha256::Round(h, a, b, c, d, e, f, g, 0x71374491, pre[17] = ReadBE32(header + 68));
+    sha256::Round(g, h, a, b, c, d, e, f, 0xb5c0fbcf, pre[18] = ReadBE32(header + 72));
+    pre[8] = f;
+    pre[9] = g;
+    pre[10] = h;
+    pre[11] = a;
+    pre[12] = b;
+    pre[13] = c;
+    pre[14] = d;
+    pre[15] = e;
+
+    while (count) {
+        int mask;
+        uint32_t lanes;
+        if (ScanD80_8way && count >= 8) {
+            mask = ScanD80_8way(pre, nonce);
+            lanes = 8;
+        } else if (ScanD80_4way && count >= 4) {
+            mask = ScanD80_4way(pre, nonce);
+            lanes = 4;
+        } else {
+            mask = ScanD80(pre, nonce);
+            lanes = 1;
+        }
+        if (mask) {
+            while (!(mask & 1)) {
+                mask >>= 1;
+                ++nonce;
+            }
+            return true;
+        }
+        nonce += lanes;
+        count -= lanes;
+    }
+    --nonce;
+    return false;
+}
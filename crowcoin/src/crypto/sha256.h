@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +26,27 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA256 implementation, self-test it, and
+ *  return a description of what was selected.
+ */
+std::string SHA256AutoDetect();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  The output may alias the start of the input.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
+/** Scan the nonces of an 80-byte block header for proof-of-work candidates.
+ *  header: pointer to the 80-byte serialized header; its nonce field is ignored.
+ *  nonce:  the first nonce to try.
+ *  count:  the number of consecutive nonces to try (wrapping around at 2^32).
+ *  Returns true and sets nonce to the first nonce for which the double-SHA256 of the
+ *  header ends in two zero bytes. Otherwise returns false and sets nonce to the last
+ *  nonce tried.
+ */
+bool SHA256D80Scan(const unsigned char* header, uint32_t& nonce, uint32_t count);
+
 #endif // CROWCOIN_CRYPTO_SHA256_H
@@ -0,0 +1,234 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <stdint.h>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_avx2 {
+namespace {
+
+/** SHA-256 round constants. */
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+/** Round constants plus the fully expanded message schedule of the padding chunk of a 64-byte input. */
+const uint32_t KPAD[64] = {
+    0xc28a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf374,
+    0x649b69c1, 0xf0fe4786, 0x0fe1edc6, 0x240cf254, 0x4fe9346f, 0x6cc984be, 0x61b9411e, 0x16f988fa,
+    0xf2c65152, 0xa88e5a6d, 0xb019fc65, 0xb9d99ec7, 0x9a1231c3, 0xe70eeaa0, 0xfdb1232b, 0xc7353eb0,
+    0x3069bad5, 0xcb976d5f, 0x5a0f118f, 0xdc1eeefd, 0x0a35b689, 0xde0b7a04, 0x58f4ca9d, 0xe15d5b16,
+    0x007f3e86, 0x37088980, 0xa507ea32, 0x6fab9537, 0x17406110, 0x0d8cd6f1, 0xcdaa3b6d, 0xc0bbbe37,
+    0x83613bda, 0xdb48a363, 0x0b02e931, 0x6fd15ca7, 0x521afaca, 0x31338431, 0x6ed41a95, 0x6d437890,
+    0xc39c91f2, 0x9eccabbd, 0xb5c9a0e6, 0x532fb63c, 0xd2c741c6, 0x07237ea3, 0xa4954b68, 0x4c191d76,
+};
+
+__m256i inline K8(uint32_t x) { return _mm256_set1_epi32(x); }
+
+__m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi32(x, y); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z) { return Add(Add(x, y), z); }
+__m256i inline Add(__m256i x, __m256i y, __m256i z, __m256i w) { return Add(Add(x, y), Add(z, w)); }
+__m256i inline Inc(__m256i& x, __m256i y) { x = Add(x, y); return x; }
+__m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+__m256i inline Xor(__m256i x, __m256i y, __m256i z) { return Xor(Xor(x, y), z); }
+__m256i inline Or(__m256i x, __m256i y) { return _mm256_or_si256(x, y); }
+__m256i inline And(__m256i x, __m256i y) { return _mm256_and_si256(x, y); }
+__m256i inline ShR(__m256i x, int n) { return _mm256_srli_epi32(x, n); }
+__m256i inline ShL(__m256i x, int n) { return _mm256_slli_epi32(x, n); }
+__m256i inline RotR(__m256i x, int n) { return Or(ShR(x, n), ShL(x, 32 - n)); }
+__m256i inline BSwap(__m256i x) { return _mm256_shuffle_epi8(x, _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                              12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3)); }
+
+__m256i inline Ch(__m256i x, __m256i y, __m256i z) { return Xor(z, And(x, Xor(y, z))); }
+__m256i inline Maj(__m256i x, __m256i y, __m256i z) { return Or(And(x, y), And(z, Or(x, y))); }
+__m256i inline Sigma0(__m256i x) { return Xor(RotR(x, 2), RotR(x, 13), RotR(x, 22)); }
+__m256i inline Sigma1(__m256i x) { return Xor(RotR(x, 6), RotR(x, 11), RotR(x, 25)); }
+__m256i inline sigma0(__m256i x) { return Xor(RotR(x, 7), RotR(x, 18), ShR(x, 3)); }
+__m256i inline sigma1(__m256i x) { return Xor(RotR(x, 17), RotR(x, 19), ShR(x, 10)); }
+
+/** One round of SHA-256 over the working variables a..h, where wk holds the message word plus the round constant. */
+void inline Round(__m256i& a, __m256i& b, __m256i& c, __m256i& d, __m256i& e, __m256i& f, __m256i& g, __m256i& h, __m256i wk)
+{
+    const __m256i t1 = Add(h, Sigma1(e), Ch(e, f, g), wk);
+    const __m256i t2 = Add(Sigma0(a), Maj(a, b, c));
+    h = g;
+    g = f;
+    f = e;
+    e = Add(d, t1);
+    d = c;
+    c = b;
+    b = a;
+    a = Add(t1, t2);
+}
+
+/** Run 64 rounds over the state s, where wk[i] holds message word i plus round constant i. */
+void inline Rounds(__m256i* s, const __m256i* wk)
+{
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        Round(a, b, c, d, e, f, g, h, wk[i]);
+    }
+    Inc(s[0], a);
+    Inc(s[1], b);
+    Inc(s[2], c);
+    Inc(s[3], d);
+    Inc(s[4], e);
+    Inc(s[5], f);
+    Inc(s[6], g);
+    Inc(s[7], h);
+}
+
+/** Expand the 16 message words in w[0..15] into w[0..63], then add the round constants. */
+void inline Expand(__m256i* w)
+{
+    for (int i = 16; i < 64; i++) {
+        w[i] = Add(sigma1(w[i - 2]), w[i - 7], sigma0(w[i - 15]), w[i - 16]);
+    }
+    for (int i = 0; i < 64; i++) {
+        Inc(w[i], K8(K[i]));
+    }
+}
+
+/** Initialize the state of all lanes to the SHA-256 IV. */
+void inline Initialize(__m256i* s)
+{
+    s[0] = K8(0x6a09e667ul);
+    s[1] = K8(0xbb67ae85ul);
+    s[2] = K8(0x3c6ef372ul);
+    s[3] = K8(0xa54ff53aul);
+    s[4] = K8(0x510e527ful);
+    s[5] = K8(0x9b05688cul);
+    s[6] = K8(0x1f83d9abul);
+    s[7] = K8(0x5be0cd19ul);
+}
+
+/** Gather big-endian word 'offset' of each of the eight 64-byte inputs into one vector. */
+__m256i inline Read8(const unsigned char* in, int offset)
+{
+    return _mm256_set_epi32(ReadBE32(in + 448 + offset), ReadBE32(in + 384 + offset), ReadBE32(in + 320 + offset), ReadBE32(in + 256 + offset),
+                            ReadBE32(in + 192 + offset), ReadBE32(in + 128 + offset), ReadBE32(in + 64 + offset), ReadBE32(in + offset));
+}
+
+/** Scatter one vector as big-endian word 'offset' of each of the eight 32-byte outputs. */
+void inline Write8(unsigned char* out, int offset, __m256i v)
+{
+    WriteBE32(out + offset, _mm256_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm256_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm256_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm256_extract_epi32(v, 3));
+    WriteBE32(out + 128 + offset, _mm256_extract_epi32(v, 4));
+    WriteBE32(out + 160 + offset, _mm256_extract_epi32(v, 5));
+    WriteBE32(out + 192 + offset, _mm256_extract_epi32(v, 6));
+    WriteBE32(out + 224 + offset, _mm256_extract_epi32(v, 7));
+}
+
+}
+
+/** Compute the double SHA-256 of eight independent 64-byte inputs, one per lane. */
+void Transform_8way(unsigned char* out, const unsigned char* in)
+{
+    __m256i s[8], t[8], w[64];
+
+    // Transform 1: the 64 bytes of input.
+    Initialize(s);
+    for (int i = 0; i < 16; i++) {
+        w[i] = Read8(in, 4 * i);
+    }
+    Expand(w);
+    Rounds(s, w);
+
+    // Transform 2: the padding chunk, whose message schedule is constant.
+    for (int i = 0; i < 64; i++) {
+        w[i] = K8(KPAD[i]);
+    }
+    Rounds(s, w);
+
+    // Transform 3: the 32-byte hash from above, padded.
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+    }
+    w[8] = K8(0x80000000ul);
+    for (int i = 9; i < 15; i++) {
+        w[i] = K8(0);
+    }
+    w[15] = K8(0x100ul);
+    Expand(w);
+    Initialize(t);
+    Rounds(t, w);
+
+    for (int i = 0; i < 8; i++) {
+        Write8(out, 4 * i, t[i]);
+    }
+}
+
+/** Test eight consecutive nonces of an 80-byte block header for a double SHA-256 ending in
+ *  16 zero bits, starting from the precomputed state in pre (see SHA256D80Scan). Returns a
+ *  bitmask with bit i set if nonce + i is such a candidate.
+ */
+int ScanD80_8way(const uint32_t* pre, uint32_t nonce)
+{
+    __m256i s[8], w[64];
+
+    // Transform 2: the last 16 bytes of the header plus padding. Rounds 0-2 do not depend on
+    // the nonce and were done by the caller.
+    for (int i = 0; i < 3; i++) {
+        w[i] = K8(pre[16 + i]);
+    }
+    w[3] = BSwap(Add(K8(nonce), _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0)));
+    w[4] = K8(0x80000000ul);
+    for (int i = 5; i < 15; i++) {
+        w[i] = K8(0);
+    }
+    w[15] = K8(0x280ul);
+    Expand(w);
+    __m256i a = K8(pre[8]), b = K8(pre[9]), c = K8(pre[10]), d = K8(pre[11]);
+    __m256i e = K8(pre[12]), f = K8(pre[13]), g = K8(pre[14]), h = K8(pre[15]);
+    for (int i = 3; i < 64; i++) {
+        Round(a, b, c, d, e, f, g, h, w[i]);
+    }
+
+    // Transform 3: the 32-byte hash from above, padded. Only the final word of the result
+    // matters, and that is known after round 60.
+    w[0] = Add(K8(pre[0]), a);
+    w[1] = Add(K8(pre[1]), b);
+    w[2] = Add(K8(pre[2]), c);
+    w[3] = Add(K8(pre[3]), d);
+    w[4] = Add(K8(pre[4]), e);
+    w[5] = Add(K8(pre[5]), f);
+    w[6] = Add(K8(pre[6]), g);
+    w[7] = Add(K8(pre[7]), h);
+    w[8] = K8(0x80000000ul);
+    for (int i = 9; i < 15; i++) {
+        w[i] = K8(0);
+    }
+    w[15] = K8(0x100ul);
+    for (int i = 16; i < 61; i++) {
+        w[i] = Add(sigma1(w[i - 2]), w[i - 7], sigma0(w[i - 15]), w[i - 16]);
+    }
+    Initialize(s);
+    a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+    for (int i = 0; i < 61; i++) {
+        Round(a, b, c, d, e, f, g, h, Add(w[i], K8(K[i])));
+    }
+
+    // The e after round 60 ends up as h after round 63, so it gives the final word.
+    const __m256i x = _mm256_cmpeq_epi32(And(Add(e, K8(0x5be0cd19ul)), K8(0xffff)), K8(0));
+    return _mm256_movemask_ps(_mm256_castsi256_ps(x));
+}
+
+}
+
+#endif
@@ -259,6 +259,15 @@ public:
         return new CDBIterator(pdb->NewIterator(iteroptions), &obfuscate_key);
     }
 
+    /**
+     * Return an iterator for short range lookups: unlike NewIterator(), the
+     * blocks it reads are kept in the block cache, like those read by Read().
+     */
+    CDBIterator *NewLookupIterator()
+    {
+        return new CDBIterator(pdb->NewIterator(readoptions), &obfuscate_key);
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
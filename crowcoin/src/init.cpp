@@ -9,13 +9,19 @@
 
 #include "init.h"
 
+#include "addressindex.h"
 #include "addrman.h"
 #include "amount.h"
+#include "blockimport.h"
+#include "blocktemplate.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
+#include "coinsflusher.h"
+#include "coinsprefetch.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -28,6 +34,7 @@
 #include "script/sigcache.h"
 #include "scheduler.h"
 #include "txdb.h"
+#include "txindex.h"
 #include "txmempool.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
@@ -77,6 +84,9 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 #endif
 
+static CTxIndexer* ptxindexer = NULL;
+static int64_t nAddressIndexDBCache = 0;
+
 #ifdef WIN32
 // Win32 LevelDB doesn't use filedescriptors, and the ones used for
 // accessing block files don't count towards the fd_set size limit
@@ -142,9 +152,9 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -158,7 +168,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static boost::scoped_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -211,13 +220,38 @@ void Shutdown()
         fFeeEstimatesInitialized = false;
     }
 
+    if (mempool.IsLoaded() && GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        DumpMempool();
+
+    if (pblocktemplatebuilder) {
+        pblocktemplatebuilder->Stop();
+        delete pblocktemplatebuilder;
+        pblocktemplatebuilder = NULL;
+    }
+    if (ptxindexer) {
+        ptxindexer->Stop();
+        delete ptxindexer;
+        ptxindexer = NULL;
+    }
+    if (paddressindexer) {
+        paddressindexer->Stop();
+        delete paddressindexer;
+        paddressindexer = NULL;
+    }
+
     {
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            if (pblocktree != NULL && !WriteBlockIndexSnapshot())
+                LogPrintf("%s: failed to write the block index snapshot\n", __func__);
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
+        delete pcoinsPrefetch;
+        pcoinsPrefetch = NULL;
+        delete pcoinsFlusher;
+        pcoinsFlusher = NULL;
         delete pcoinscatcher;
         pcoinscatcher = NULL;
         delete pcoinsdbview;
@@ -317,12 +351,16 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("This help message"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alerts", strprintf(_("Receive and display P2P network alerts (default: %u)"), DEFAULT_ALERTS));
+    strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain an index of the outputs paying to, and the inputs spending from, every address and script, used by the getaddresshistory rpc call; it is built in the background (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write the chainstate to disk from a background thread instead of while holding up validation (default: %u)"), DEFAULT_ASYNC_FLUSH));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
     strUsage += HelpMessageOpt("-checkblocks=<n>", strprintf(_("How many blocks to check at startup (default: %u, 0 = all)"), DEFAULT_CHECKBLOCKS));
     strUsage += HelpMessageOpt("-checklevel=<n>", strprintf(_("How thorough the block verification of -checkblocks is (0-4, default: %u)"), DEFAULT_CHECKLEVEL));
+    strUsage += HelpMessageOpt("-checkthreads=<n>", strprintf(_("Number of threads reading and checking blocks for -checkblocks (1-%d, default: %d)"), MAX_CHECK_THREADS, DEFAULT_CHECK_THREADS));
+    strUsage += HelpMessageOpt("-checktime=<n>", strprintf(_("Stop verifying -checkblocks blocks at startup after <n> seconds (default: %u, 0 = no limit)"), DEFAULT_CHECK_TIME));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), CROWCOIN_CONF_FILENAME));
     if (mode == HMM_CROWCOIND)
     {
@@ -332,12 +370,20 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of threads checking blocks during -reindex and -loadblock (1 to %d, default: %d)"),
+        MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-loadtxoutset=<file>", _("Start a new chain state from a UTXO set snapshot written by dumptxoutset (requires -prune)"));
+    strUsage += HelpMessageOpt("-mappedblockfiles=<n>", strprintf(_("Keep up to <n> block files mapped into memory to serve blocks from (0 = read them through the file, default: %u)"), DEFAULT_MAPPED_BLOCK_FILES));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-persistmempool", strprintf(_("Whether to save the mempool on shutdown and load on restart (default: %u)"), DEFAULT_PERSIST_MEMPOOL));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-prefetchthreads=<n>", strprintf(_("Set the number of threads reading a block's inputs from disk ahead of validation (0 to %d, default: %d)"),
+        MAX_PREFETCH_THREADS, DEFAULT_PREFETCH_THREADS));
+    strUsage += HelpMessageOpt("-parpin", strprintf(_("Pin each script verification thread to its own CPU, filling one NUMA node before the next (Linux only, default: %u)"), DEFAULT_SCRIPTCHECK_PIN));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), CROWCOIN_PID_FILENAME));
 #endif
@@ -348,7 +394,7 @@ std::string HelpMessage(HelpMessageMode mode)
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
 #endif
-    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call (default: %u)"), DEFAULT_TXINDEX));
+    strUsage += HelpMessageOpt("-txindex", strprintf(_("Maintain a full transaction index, used by the getrawtransaction rpc call; it is built in the background (default: %u)"), DEFAULT_TXINDEX));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -467,7 +513,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
         CURRENCY_UNIT, FormatMoney(DEFAULT_MIN_RELAY_TX_FEE)));
@@ -495,6 +541,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockminsize=<n>", strprintf(_("Set minimum block size in bytes (default: %u)"), DEFAULT_BLOCK_MIN_SIZE));
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", strprintf(_("Set maximum block size in bytes (default: %d)"), DEFAULT_BLOCK_MAX_SIZE));
     strUsage += HelpMessageOpt("-blockprioritysize=<n>", strprintf(_("Set maximum size of high-priority/low-fee transactions in bytes (default: %d)"), DEFAULT_BLOCK_PRIORITY_SIZE));
+    strUsage += HelpMessageOpt("-blocktemplatebuilder", strprintf(_("Keep a block template for getblocktemplate up to date in the background (default: %u)"), DEFAULT_BLOCK_TEMPLATE_BUILDER));
+    strUsage += HelpMessageOpt("-blocktemplatefeedelta=<amt>", strprintf(_("Fee increase (in %s) of the background block template at which longpolling getblocktemplate calls return (default: %s)"),
+        CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_TEMPLATE_FEE_DELTA)));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
 
@@ -654,6 +703,11 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
         LogPrintf("Stopping after block import\n");
         StartShutdown();
     }
+
+    if (GetBoolArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL))
+        LoadMempool();
+    // Until then, saving the mempool would overwrite what is still to be loaded
+    mempool.SetIsLoaded(!ShutdownRequested());
 }
 
 /** Sanity checks
@@ -850,6 +904,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
     if (GetArg("-prune", 0)) {
         if (GetBoolArg("-txindex", DEFAULT_TXINDEX))
             return InitError(_("Prune mode is incompatible with -txindex."));
+        if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+            return InitError(_("Prune mode is incompatible with -addressindex."));
 #ifdef ENABLE_WALLET
         if (GetBoolArg("-rescan", false)) {
             return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
@@ -910,6 +966,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
     if (nMempoolSizeMax < 0 || nMempoolSizeMax < nMempoolSizeMin)
         return InitError(strprintf(_("-maxmempool must be at least %d MB"), std::ceil(nMempoolSizeMin / 1000000.0)));
 
+    nImportThreads = std::max(1, std::min((int)GetArg("-importthreads", DEFAULT_IMPORT_THREADS), MAX_IMPORT_THREADS));
+    blockFileMapper.SetMaxFiles(std::max((int64_t)0, GetArg("-mappedblockfiles", DEFAULT_MAPPED_BLOCK_FILES)));
+
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
@@ -935,6 +994,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
         fPruneMode = true;
     }
 
+    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
+
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
 #endif
@@ -1039,6 +1100,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    // Select and self-test the fastest SHA256 implementation for this CPU
+    std::string sha256_algo = SHA256AutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start(); // Բ߱
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1083,15 +1147,30 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
     LogPrintf("Using data directory %s\n", strDataDir);
     LogPrintf("Using config file %s\n", GetConfigFile().string());
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
 
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
+        bool fPin = GetBoolArg("-parpin", DEFAULT_SCRIPTCHECK_PIN);
         for (int i=0; i<nScriptCheckThreads-1; i++)
-            threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(boost::bind(&ThreadScriptCheck, fPin ? i : -1));
     }
 
+    // The prefetch and flush layers outlive reloads of the coin database below; only their backend changes.
+    pcoinsFlusher = new CCoinsViewFlusher(NULL);
+    if (GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH))
+        threadGroup.create_thread(&ThreadCoinsFlush);
+    pcoinsPrefetch = new CCoinsViewPrefetch(pcoinsFlusher);
+    int nPrefetchThreads = std::max(0, std::min((int)GetArg("-prefetchthreads", DEFAULT_PREFETCH_THREADS), MAX_PREFETCH_THREADS));
+    LogPrintf("Using %u threads for coin prefetching\n", nPrefetchThreads);
+    for (int i=0; i<nPrefetchThreads; i++)
+        threadGroup.create_thread(&ThreadCoinsPrefetch);
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler); // Function/bind
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop)); // create_thread
@@ -1298,12 +1377,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
     if (nBlockTreeDBCache > (1 << 21) && !GetBoolArg("-txindex", DEFAULT_TXINDEX))
         nBlockTreeDBCache = (1 << 21); // block tree db cache shouldn't be larger than 2 MiB
     nTotalCache -= nBlockTreeDBCache;
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        nAddressIndexDBCache = nTotalCache / 8;
+        nTotalCache -= nAddressIndexDBCache;
+    }
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nTotalCache -= nCoinDBCache;
     nCoinCacheUsage = nTotalCache; // the rest goes to in-memory cache
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nAddressIndexDBCache)
+        LogPrintf("* Using %.1fMiB for address index database\n", nAddressIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
     bool fLoaded = false;
@@ -1317,6 +1402,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
         do {
             try {
                 UnloadBlockIndex();
+                pcoinsFlusher->Wait();
                 delete pcoinsTip;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
@@ -1324,8 +1410,20 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
+                bool fLoadingTxOutSet;
+                pcoinsdbview->ReadLoadingTxOutSet(fLoadingTxOutSet);
+                if (fLoadingTxOutSet) {
+                    strLoadError = _("The chain state database only holds part of a UTXO set snapshot");
+                    break;
+                }
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsPrefetch->Clear();
+                pcoinsFlusher->SetBackend(*pcoinscatcher);
+                pcoinsTip = new CCoinsViewCache(pcoinsPrefetch);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -1350,10 +1448,15 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
                     break;
                 }
 
-                // Check for changed -txindex state
-                if (fTxIndex != GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
-                    strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
-                    break;
+                // Start from a UTXO set snapshot (no-op if the chain is past the genesis block)
+                if (mapArgs.count("-loadtxoutset")) {
+                    boost::filesystem::path pathSnapshot(mapArgs["-loadtxoutset"]);
+                    if (!pathSnapshot.is_complete())
+                        pathSnapshot = GetDataDir() / pathSnapshot;
+                    if (!LoadTxOutSet(chainparams, pathSnapshot)) {
+                        strLoadError = _("Error loading UTXO set snapshot");
+                        break;
+                    }
                 }
 
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
@@ -1380,8 +1483,10 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
                     }
                 }
 
-                if (!CVerifyDB().VerifyDB(chainparams, pcoinsdbview, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
-                              GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
+                // Verify through pcoinsPrefetch, so that reconnecting blocks reads their inputs ahead
+                if (!CVerifyDB().VerifyDB(chainparams, pcoinsPrefetch, GetArg("-checklevel", DEFAULT_CHECKLEVEL),
+                              GetArg("-checkblocks", DEFAULT_CHECKBLOCKS), GetArg("-checkthreads", DEFAULT_CHECK_THREADS),
+                              GetArg("-checktime", DEFAULT_CHECK_TIME))) {
                     strLoadError = _("Corrupted block database detected");
                     break;
                 }
@@ -1394,7 +1499,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
             fLoaded = true;
         } while(false);
 
-        if (!fLoaded) {
+        if (!fLoaded && !fRequestShutdown) {
             // first suggest a reindex
             if (!fReset) {
                 bool fRet = uiInterface.ThreadSafeMessageBox(
@@ -1430,6 +1535,23 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler) //3.11
         mempool.ReadFeeEstimates(est_filein);
     fFeeEstimatesInitialized = true;
 
+    // The transaction index catches up with the chain in the background
+    if (fTxIndex) {
+        ptxindexer = new CTxIndexer(chainparams);
+        ptxindexer->Start();
+    }
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        paddressindexer = new CAddressIndexer(chainparams, nAddressIndexDBCache, false, fReindex);
+        paddressindexer->Start();
+    }
+    if (GetBoolArg("-blocktemplatebuilder", DEFAULT_BLOCK_TEMPLATE_BUILDER)) {
+        CAmount nFeeDelta = DEFAULT_BLOCK_TEMPLATE_FEE_DELTA;
+        if (mapArgs.count("-blocktemplatefeedelta") && !ParseMoney(mapArgs["-blocktemplatefeedelta"], nFeeDelta))
+            return InitError(strprintf(_("Invalid amount for -blocktemplatefeedelta=<amount>: '%s'"), mapArgs["-blocktemplatefeedelta"]));
+        pblocktemplatebuilder = new CBlockTemplateBuilder(chainparams, nFeeDelta);
+        pblocktemplatebuilder->Start();
+    }
+
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
     if (fDisableWallet) {
@@ -8,12 +8,18 @@
 #include "addrman.h"
 #include "alert.h"
 #include "arith_uint256.h"
+#include "blockimport.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
+#include "coinsflusher.h"
+#include "coinsprefetch.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "init.h"
 #include "merkleblock.h"
@@ -59,10 +65,12 @@ CCriticalSection cs_main;
 BlockMap mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
+CBlockFileMapper blockFileMapper;
 int64_t nTimeBestReceived = 0;
 CWaitableCriticalSection csBestBlock;
 CConditionVariable cvBlockChange;
 int nScriptCheckThreads = 0;
+int nImportThreads = DEFAULT_IMPORT_THREADS;
 bool fImporting = false;
 bool fReindex = false;
 bool fTxIndex = false;
@@ -74,6 +82,8 @@ unsigned int nBytesPerSigOp = DEFAULT_BYTES_PER_SIGOP;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
 size_t nCoinCacheUsage = 5000 * 300;
+int64_t nLastCoinsFlushTime = 0;
+int64_t nLastCoinsFlushDuration = 0;
 uint64_t nPruneTarget = 0;
 bool fAlerts = DEFAULT_ALERTS;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
@@ -84,7 +94,7 @@ CFeeRate minRelayTxFee = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CTxMemPool mempool(::minRelayTxFee);
 
 struct COrphanTx {
-    CTransaction tx;
+    CTransactionRef tx;
     NodeId fromPeer;
 };
 map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(cs_main);;
@@ -97,6 +107,7 @@ void EraseOrphansFor(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
  */
 static bool IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned nRequired, const Consensus::Params& consensusParams);
 static void CheckBlockIndex(const Consensus::Params& consensusParams);
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 
 /** Constant stuff for coinbase transactions we create: */
 CScript COINBASE_FLAGS;
@@ -594,6 +605,9 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewPrefetch *pcoinsPrefetch = NULL;
+CCoinsViewFlusher *pcoinsFlusher = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -601,8 +615,9 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions
 //
 
-bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool AddOrphanTx(const CTransactionRef& ptx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
+    const CTransaction& tx = *ptx;
     uint256 hash = tx.GetHash();
     if (mapOrphanTransactions.count(hash))
         return false;
@@ -621,7 +636,7 @@ bool AddOrphanTx(const CTransaction& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(c
         return false;
     }
 
-    mapOrphanTransactions[hash].tx = tx;
+    mapOrphanTransactions[hash].tx = ptx;
     mapOrphanTransactions[hash].fromPeer = peer;
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
         mapOrphanTransactionsByPrev[txin.prevout.hash].insert(hash);
@@ -636,7 +651,7 @@ void static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
     map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
     if (it == mapOrphanTransactions.end())
         return;
-    BOOST_FOREACH(const CTxIn& txin, it->second.tx.vin)
+    BOOST_FOREACH(const CTxIn& txin, it->second.tx->vin)
     {
         map<uint256, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout.hash);
         if (itPrev == mapOrphanTransactionsByPrev.end())
@@ -657,7 +672,7 @@ void EraseOrphansFor(NodeId peer)
         map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
         if (maybeErase->second.fromPeer == peer)
         {
-            EraseOrphanTx(maybeErase->second.tx.GetHash());
+            EraseOrphanTx(maybeErase->second.tx->GetHash());
             ++nErased;
         }
     }
@@ -856,15 +871,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
         prevheights.resize(tx.vin.size());
         for (size_t txinIndex = 0; txinIndex < tx.vin.size(); txinIndex++) {
             const CTxIn& txin = tx.vin[txinIndex];
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -987,9 +1002,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -1002,10 +1017,11 @@ std::string FormatStateMessage(const CValidationState &state)
         state.GetRejectCode());
 }
 
-bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                              bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
-                              std::vector<uint256>& vHashTxnToUncache)
+bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const CTransactionRef &ptx, bool fLimitFree,
+                              bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee,
+                              std::vector<COutPoint>& vCoinsToUncache)
 {
+    const CTransaction& tx = *ptx;
     AssertLockHeld(cs_main);
     if (pfMissingInputs)
         *pfMissingInputs = false;
@@ -1097,20 +1113,29 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         view.SetBackend(viewMemPool);
 
         // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            COutPoint outpoint(hash, i);
+            bool fHadCoinInCache = pcoinsTip->HaveCoinInCache(outpoint);
+            if (view.HaveCoin(outpoint)) {
+                if (!fHadCoinInCache)
+                    vCoinsToUncache.push_back(outpoint);
+                return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+            }
         }
 
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
+        // A spent input cannot be told apart from a missing one, so this
+        // also sets pfMissingInputs for spent inputs.
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout))
+                vCoinsToUncache.push_back(txin.prevout);
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx? Only
+                // look in the cache, which has the outputs of recent blocks.
+                for (unsigned int i = 0; i < tx.vout.size(); i++) {
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, i)))
+                        return state.Invalid(false, REJECT_DUPLICATE, "txn-already-known");
+                }
                 if (pfMissingInputs)
                     *pfMissingInputs = true;
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
@@ -1159,14 +1184,14 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
         // during reorgs to ensure COINBASE_MATURITY is still met.
         bool fSpendsCoinbase = false;
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase()) {
                 fSpendsCoinbase = true;
                 break;
             }
         }
 
-        CTxMemPoolEntry entry(tx, nFees, GetTime(), dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
+        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, dPriority, chainActive.Height(), pool.HasNoInputsOf(tx), inChainInputValue, fSpendsCoinbase, nSigOps, lp);
         unsigned int nSize = entry.GetTxSize();
 
         // Check that the transaction doesn't have an excessive number of
@@ -1267,20 +1292,6 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                 // Save these to avoid repeated lookups
                 setIterConflicting.insert(mi);
 
-                // If this entry is "dirty", then we don't have descendant
-                // state for this transaction, which means we probably have
-                // lots of in-mempool descendants.
-                // Don't allow replacements of dirty transactions, to ensure
-                // that we don't spend too much time walking descendants.
-                // This should be rare.
-                if (mi->IsDirty()) {
-                    return state.DoS(0,
-                            error("AcceptToMemoryPool: rejecting replacement %s; cannot replace tx %s with untracked descendants",
-                                hash.ToString(),
-                                mi->GetTx().GetHash().ToString()),
-                            REJECT_NONSTANDARD, "too many potential replacements");
-                }
-
                 // Don't allow the replacement to reduce the feerate of the
                 // mempool.
                 //
@@ -1381,19 +1392,23 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true))
+        if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false))
             return false;
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
+        // Check again against the consensus-critical script verification
+        // flags of the current tip, in case of bugs in the standard flags that
+        // cause transactions to pass as valid when they're actually invalid.
+        // For instance the STRICTENC flag was incorrectly allowing certain
         // CHECKSIG NOT scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
         // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true))
+        //
+        // These are the flags the next block will most likely be validated
+        // with, so the result is cached for ConnectBlock to skip the scripts.
+        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        if (!CheckInputs(tx, state, view, true, currentBlockScriptVerifyFlags, true, true))
         {
             return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
@@ -1408,7 +1423,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
                     FormatMoney(nModifiedFees - nConflictingFees),
                     (int)nSize - (int)nConflictingSize);
         }
-        pool.RemoveStaged(allConflicting);
+        pool.RemoveStaged(allConflicting, false);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, !IsInitialBlockDownload());
@@ -1426,18 +1441,24 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState &state, const C
     return true;
 }
 
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
-                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee)
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit, bool fRejectAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, fOverrideMempoolLimit, fRejectAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> vCoinsToUncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, fOverrideMempoolLimit, fRejectAbsurdFee, vCoinsToUncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
-            pcoinsTip->Uncache(hashTx);
+        BOOST_FOREACH(const COutPoint& outpoint, vCoinsToUncache)
+            pcoinsTip->Uncache(outpoint);
     }
     return res;
 }
 
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
+                        bool* pfMissingInputs, bool fOverrideMempoolLimit, bool fRejectAbsurdFee)
+{
+    return AcceptToMemoryPoolWithTime(pool, state, tx, fLimitFree, pfMissingInputs, GetTime(), fOverrideMempoolLimit, fRejectAbsurdFee);
+}
+
 /** Return transaction in tx, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1474,10 +1495,9 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, const Consensus::P
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            CCoinsViewCache &view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
@@ -1530,18 +1550,48 @@ bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHea
     return true;
 }
 
+bool ReadRawBlockFromDisk(CBlockFileView& view, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    // The block is preceded by the message start and its size.
+    static const unsigned int nHeaderSize = MESSAGE_START_SIZE + sizeof(uint32_t);
+    if (pos.IsNull() || pos.nPos < nHeaderSize)
+        return error("%s: invalid position %s", __func__, pos.ToString());
+    boost::filesystem::path path = GetBlockPosFilename(pos, "blk");
+    CBlockFileView header;
+    if (!blockFileMapper.GetView(pos.nFile, path, pos.nPos - nHeaderSize, nHeaderSize, header))
+        return error("%s: unable to read %s", __func__, pos.ToString());
+    if (memcmp(header.begin(), messageStart, MESSAGE_START_SIZE) != 0)
+        return error("%s: message start mismatch at %s", __func__, pos.ToString());
+    unsigned int nSize = ReadLE32((const unsigned char*)header.begin() + MESSAGE_START_SIZE);
+    if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+        return error("%s: invalid block size %u at %s", __func__, nSize, pos.ToString());
+    if (!blockFileMapper.GetView(pos.nFile, path, pos.nPos, nSize, view))
+        return error("%s: unable to read %u bytes at %s", __func__, nSize, pos.ToString());
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CBlockFileView& view, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    if (!ReadRawBlockFromDisk(view, pindex->GetBlockPos(), messageStart))
+        return false;
+    // The block hash only covers the 80-byte header.
+    if (Hash(view.begin(), view.begin() + 80) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(CBlockFileView&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), pindex->GetBlockPos().ToString());
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams)
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+    CBlockFileView view;
+    if (!ReadRawBlockFromDisk(view, pos, Params().MessageStart()))
+        return false;
 
-    // Read block
+    // Read block straight out of the mapped file
     try {
-        filein >> block;
+        CMemoryReader(view.begin(), view.end(), SER_DISK, CLIENT_VERSION) >> block;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1736,32 +1786,18 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
     if (!tx.IsCoinBase()) {
         txundo.vprevout.reserve(tx.vin.size());
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-            unsigned nPos = txin.prevout.n;
-
-            if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
+            // mark an outpoint spent, and construct undo information, which
+            // always has the metadata as other outputs of the transaction
+            // may be spent separately
+            Coin coin;
+            if (!inputs.SpendCoin(txin.prevout, &coin))
                 assert(false);
-            // mark an outpoint spent, and construct undo information
-            txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-            coins->Spend(nPos);
-            if (coins->vout.size() == 0) {
-                CTxInUndo& undo = txundo.vprevout.back();
-                undo.nHeight = coins->nHeight;
-                undo.fCoinBase = coins->fCoinBase;
-                undo.nVersion = coins->nVersion;
-            }
+            txundo.vprevout.push_back(CTxInUndo(coin.out, coin.fCoinBase, coin.nHeight, coin.nVersion));
         }
-        // add outputs
-        inputs.ModifyNewCoins(tx.GetHash())->FromTx(tx, nHeight);
-    }
-    else {
-        // add outputs for coinbase tx
-        // In this case call the full ModifyCoins which will do a database
-        // lookup to be sure the coins do not already exist otherwise we do not
-        // know whether to mark them fresh or not.  We want the duplicate coinbases
-        // before BIP30 to still be properly overwritten.
-        inputs.ModifyCoins(tx.GetHash())->FromTx(tx, nHeight);
     }
+    // add outputs; AddCoins lets coinbase outputs overwrite, so that the
+    // duplicate coinbases before BIP30 are still properly overwritten
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight)
@@ -1798,20 +1834,20 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
         for (unsigned int i = 0; i < tx.vin.size(); i++)
         {
             const COutPoint &prevout = tx.vin[i].prevout;
-            const CCoins *coins = inputs.AccessCoins(prevout.hash);
-            assert(coins);
+            const Coin &coin = inputs.AccessCoin(prevout);
+            assert(!coin.IsSpent());
 
             // If prev is coinbase, check that it's matured
-            if (coins->IsCoinBase()) {
-                if (nSpendHeight - coins->nHeight < COINBASE_MATURITY)
+            if (coin.IsCoinBase()) {
+                if (nSpendHeight - coin.nHeight < COINBASE_MATURITY)
                     return state.Invalid(false,
                         REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                        strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
             }
 
             // Check for negative or overflow input values
-            nValueIn += coins->vout[prevout.n].nValue;
-            if (!MoneyRange(coins->vout[prevout.n].nValue) || !MoneyRange(nValueIn))
+            nValueIn += coin.out.nValue;
+            if (!MoneyRange(coin.out.nValue) || !MoneyRange(nValueIn))
                 return state.DoS(100, false, REJECT_INVALID, "bad-txns-inputvalues-outofrange");
 
         }
@@ -1831,7 +1867,33 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks)
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+/** False when -maxsigcachesize=0 turned the script execution cache off */
+static bool fScriptExecutionCacheEnabled = true;
+
+/** The scriptExecutionCache entry for running all of tx's scripts with the given flags */
+static uint256 GetScriptExecutionCacheKey(const CTransaction& tx, unsigned int flags)
+{
+    uint256 hashCacheEntry;
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 32).Write(tx.GetHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+void InitScriptExecutionCache()
+{
+    size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20) / 2;
+    // A zero size still sets up the minimal table, so lookups stay safe, but
+    // nothing is ever inserted
+    fScriptExecutionCacheEnabled = nMaxCacheSize > 0;
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    if (!fScriptExecutionCacheEnabled)
+        nElems = 0;
+    LogPrintf("Using %zu MiB out of %zu/2 requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck> *pvChecks)
 {
     if (!tx.IsCoinBase())
     {
@@ -1849,13 +1911,25 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // before the last block chain checkpoint. This is safe because block merkle hashes are
         // still computed and checked, and any change will be caught at the next checkpoint.
         if (fScriptChecks) {
+            // First check if script executions have been cached with the same
+            // flags. Note that this assumes that the inputs provided are
+            // correct (ie that the transaction hash which is in tx's prevouts
+            // properly commits to the scriptPubKey in the inputs view of that
+            // transaction). The transaction hash covers every scriptSig, so
+            // it identifies exactly the scripts that were run.
+            uint256 hashCacheEntry = GetScriptExecutionCacheKey(tx, flags);
+            AssertLockHeld(cs_main);
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore)) {
+                return true;
+            }
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
-                const CCoins* coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore);
+                CScriptCheck check(coin.out.scriptPubKey, tx, i, flags, cacheSigStore);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1867,8 +1941,8 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore);
+                        CScriptCheck check2(coin.out.scriptPubKey, tx, i,
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1882,6 +1956,12 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks && fScriptExecutionCacheEnabled) {
+                // We executed all of the provided scripts, and were told to
+                // cache the result. Do so now.
+                scriptExecutionCache.insert(hashCacheEntry);
+            }
         }
     }
 
@@ -1917,6 +1997,8 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
     return true;
 }
 
+} // anon namespace
+
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
@@ -1944,8 +2026,7 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
     return true;
 }
 
-/** Abort with a message */
-bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
+bool AbortNode(const std::string& strMessage, const std::string& userMessage)
 {
     strMiscWarning = strMessage;
     LogPrintf("*** %s\n", strMessage);
@@ -1956,9 +2037,11 @@ bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
     return false;
 }
 
+namespace {
+
 bool AbortNode(CValidationState& state, const std::string& strMessage, const std::string& userMessage="")
 {
-    AbortNode(strMessage, userMessage);
+    ::AbortNode(strMessage, userMessage);
     return state.Error(strMessage);
 }
 
@@ -1975,24 +2058,24 @@ static bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const CO
 {
     bool fClean = true;
 
-    CCoinsModifier coins = view.ModifyCoins(out.hash);
-    if (undo.nHeight != 0) {
-        // undo data contains height: this is the last output of the prevout tx being spent
-        if (!coins->IsPruned())
-            fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-        coins->Clear();
-        coins->fCoinBase = undo.fCoinBase;
-        coins->nHeight = undo.nHeight;
-        coins->nVersion = undo.nVersion;
-    } else {
-        if (coins->IsPruned())
-            fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-    }
-    if (coins->IsAvailable(out.n))
+    if (view.HaveCoin(out))
         fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-    if (coins->vout.size() < out.n+1)
-        coins->vout.resize(out.n+1);
-    coins->vout[out.n] = undo.txout;
+
+    Coin coin(undo.txout, undo.nHeight, undo.fCoinBase, undo.nVersion);
+    if (undo.nHeight == 0) {
+        // Older undo data only has the metadata for the last output of the
+        // prevout tx being spent; take it from another of its outputs.
+        const Coin& alternate = AccessByTxid(view, out.hash);
+        if (alternate.IsSpent())
+            return error("%s: undo data adding output to missing transaction", __func__);
+        coin.fCoinBase = alternate.fCoinBase;
+        coin.nHeight = alternate.nHeight;
+        coin.nVersion = alternate.nVersion;
+    }
+    // The spend may already have been written to disk, so the coin must not
+    // be marked FRESH. The coin database relies on this: a transaction whose
+    // modified outputs are all FRESH has nothing on disk.
+    view.AddCoin(out, coin, true);
 
     return fClean;
 }
@@ -2022,22 +2105,17 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        // exactly, and remove them.
+        for (unsigned int o = 0; o < tx.vout.size(); o++) {
+            if (tx.vout[o].scriptPubKey.IsUnspendable())
+                continue;
+            Coin coin;
+            bool fSpent = view.SpendCoin(COutPoint(hash, o), &coin);
+            // The Coin serialization does not serialize negative numbers.
+            // No network rules currently depend on the version here, so an inconsistency is harmless
+            // but it must be corrected before txout nversion ever influences a network rule.
+            if (!fSpent || coin.out != tx.vout[o] || coin.nHeight != pindex->nHeight || coin.fCoinBase != tx.IsCoinBase() || (tx.nVersion >= 0 && coin.nVersion != tx.nVersion))
+                fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
         }
 
         // restore inputs
@@ -2073,8 +2151,11 @@ void static FlushBlockFile(bool fFinalize = false)
 
     FILE *fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
+        if (fFinalize) {
+            // Don't keep a mapping that reaches past the new end of the file.
+            blockFileMapper.Forget(nLastBlockFile);
             TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        }
         FileCommit(fileOld);
         fclose(fileOld);
     }
@@ -2090,13 +2171,75 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128, MAX_SCRIPTCHECK_THREADS);
 
-void ThreadScriptCheck() {
+void ThreadScriptCheck(int nPinIndex) {
     RenameThread("crowcoin-scriptch");
+    if (nPinIndex >= 0 && !PinThreadToCPU(nPinIndex))
+        LogPrintf("Could not pin script verification thread to CPU %d\n", nPinIndex);
     scriptcheckqueue.Thread();
 }
 
+void ThreadCoinsPrefetch() {
+    RenameThread("crowcoin-prefetch");
+    pcoinsPrefetch->Thread();
+}
+
+void ThreadCoinsFlush() {
+    RenameThread("crowcoin-coinsflush");
+    pcoinsFlusher->Thread();
+}
+
+/**
+ * Start reading the coins spent by a block from disk, so that the lookups in
+ * ConnectBlock find them ready instead of hitting the database one at a time.
+ * Only coins that neither view has cached and that the block does not create
+ * itself are requested.
+ */
+static void PrefetchBlockInputs(const CBlock& block, const CCoinsViewCache& view)
+{
+    if (pcoinsPrefetch == NULL)
+        return;
+    std::vector<COutPoint> vOutPoint;
+    std::set<uint256> setInBlock;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                const COutPoint& prevout = txin.prevout;
+                if (!setInBlock.count(prevout.hash) && !view.HaveCoinInCache(prevout) && !pcoinsTip->HaveCoinInCache(prevout))
+                    vOutPoint.push_back(prevout);
+            }
+        }
+        setInBlock.insert(tx.GetHash());
+    }
+    pcoinsPrefetch->Prefetch(vOutPoint);
+}
+
+/**
+ * Start reading the coins DisconnectBlock() modifies: the outputs the block
+ * created, and the ones it spent, which get restored.
+ */
+static void PrefetchDisconnectCoins(const CBlock& block, const CCoinsViewCache& view)
+{
+    if (pcoinsPrefetch == NULL)
+        return;
+    std::vector<COutPoint> vOutPoint;
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        for (unsigned int i = 0; i < tx.vout.size(); i++) {
+            COutPoint outpoint(tx.GetHash(), i);
+            if (!tx.vout[i].scriptPubKey.IsUnspendable() && !view.HaveCoinInCache(outpoint) && !pcoinsTip->HaveCoinInCache(outpoint))
+                vOutPoint.push_back(outpoint);
+        }
+        if (!tx.IsCoinBase()) {
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!view.HaveCoinInCache(txin.prevout) && !pcoinsTip->HaveCoinInCache(txin.prevout))
+                    vOutPoint.push_back(txin.prevout);
+            }
+        }
+    }
+    pcoinsPrefetch->Prefetch(vOutPoint);
+}
+
 //
 // Called periodically asynchronously; alerts if it smells like
 // we're being fed a bad chain (blocks being generated much
@@ -2204,6 +2347,37 @@ public:
 // Protected by cs_main
 static ThresholdConditionCache warningcache[VERSIONBITS_NUM_BITS];
 
+/** Compute the script verification flags a block at pindex is validated with. */
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindex, const Consensus::Params& consensusparams)
+{
+    AssertLockHeld(cs_main);
+
+    // BIP16 didn't become active until Apr 1 2012
+    int64_t nBIP16SwitchTime = 1333238400;
+    bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
+
+    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
+    // when 75% of the network has upgraded:
+    if (pindex->nVersion >= 3 && IsSuperMajority(3, pindex->pprev, consensusparams.nMajorityEnforceBlockUpgrade, consensusparams)) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
+    // blocks, when 75% of the network has upgraded:
+    if (pindex->nVersion >= 4 && IsSuperMajority(4, pindex->pprev, consensusparams.nMajorityEnforceBlockUpgrade, consensusparams)) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindex->pprev, consensusparams, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    return flags;
+}
+
 static int64_t nTimeCheck = 0;
 static int64_t nTimeForks = 0;
 static int64_t nTimeVerify = 0;
@@ -2247,6 +2421,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
     LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
+    // Let the prefetch threads read this block's inputs while we work
+    // through it; script checks for early transactions then run while the
+    // coins of later ones are still coming in.
+    PrefetchBlockInputs(block, view);
+
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
     // If such overwrites are allowed, coinbases and transactions depending upon those
@@ -2275,10 +2454,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         BOOST_FOREACH(const CTransaction& tx, block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx.GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (unsigned int o = 0; o < tx.vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx.GetHash(), o)))
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+            }
         }
     }
 
@@ -2286,24 +2466,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     int64_t nBIP16SwitchTime = 1333238400;
     bool fStrictPayToScriptHash = (pindex->GetBlockTime() >= nBIP16SwitchTime);
 
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    // Start enforcing the DERSIG (BIP66) rules, for block.nVersion=3 blocks,
-    // when 75% of the network has upgraded:
-    if (block.nVersion >= 3 && IsSuperMajority(3, pindex->pprev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus())) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4
-    // blocks, when 75% of the network has upgraded:
-    if (block.nVersion >= 4 && IsSuperMajority(4, pindex->pprev, chainparams.GetConsensus().nMajorityEnforceBlockUpgrade, chainparams.GetConsensus())) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
+    // Get the script flags for this block
+    unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) using versionbits logic.
     int nLockTimeFlags = 0;
     if (VersionBitsState(pindex->pprev, chainparams.GetConsensus(), Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
@@ -2318,9 +2486,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     CAmount nFees = 0;
     int nInputs = 0;
     unsigned int nSigOps = 0;
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
@@ -2343,7 +2508,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             // be in ConnectBlock because they require the UTXO set
             prevheights.resize(tx.vin.size());
             for (size_t j = 0; j < tx.vin.size(); j++) {
-                prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
             }
 
             if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
@@ -2366,7 +2531,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -2377,9 +2542,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             blockundo.vtxundo.push_back(CTxUndo());
         }
         UpdateCoins(tx, state, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
-
-        vPos.push_back(std::make_pair(tx.GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
     LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
@@ -2418,10 +2580,6 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (fTxIndex)
-        if (!pblocktree->WriteTxIndex(vPos))
-            return AbortNode(state, "Failed to write transaction index");
-
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -2526,16 +2684,30 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode) {
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Typical Coin structures on disk are around 48 bytes in size.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
         // overwrite one. Still, use a conservative safety factor of 2.
-        if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
+        if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
-        // Flush the chainstate (which may refer to block index entries).
-        if (!pcoinsTip->Flush())
+        // Write the modified chainstate (which may refer to block index
+        // entries), but keep the unmodified part of the cache around so
+        // validation does not go back to disk for every input afterwards.
+        // Only when the cache is over its budget are the least recently
+        // used entries dropped, to leave some room to grow before the next
+        // flush.
+        // The database write itself happens on pcoinsFlusher's thread, so
+        // cs_main is only held for handing over the modified entries, unless
+        // the caller needs the state to be on disk when we return.
+        if (!pcoinsTip->Sync())
             return AbortNode(state, "Failed to write to coin database");
+        if (mode == FLUSH_STATE_ALWAYS && pcoinsFlusher && !pcoinsFlusher->Wait())
+            return AbortNode(state, "Failed to write to coin database");
+        pcoinsTip->Trim(nCoinCacheUsage * COINS_CACHE_TRIM_PERCENT / 100);
+        nLastCoinsFlushTime = GetTime();
+        nLastCoinsFlushDuration = GetTimeMicros() - nNow;
+        LogPrint("coindb", "%s: evicted %u coins from the cache, %.2fms\n", __func__, (unsigned int)pcoinsTip->GetCacheStats().nLastTrimEvicted, nLastCoinsFlushDuration * 0.001);
         nLastFlush = nNow;
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2560,6 +2732,23 @@ void PruneAndFlush() {
     FlushStateToDisk(state, FLUSH_STATE_NONE);
 }
 
+bool WriteBlockIndexSnapshot() {
+    LOCK(cs_main);
+    // The snapshot must match the block index database exactly
+    if (!setDirtyBlockIndex.empty() || !setDirtyFileInfo.empty())
+        return false;
+    vector<pair<int, const CBlockIndex*> > vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vIndex.push_back(make_pair(item.second->nHeight, item.second));
+    sort(vIndex.begin(), vIndex.end());
+    vector<const CBlockIndex*> vSortedByHeight;
+    vSortedByHeight.reserve(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++)
+        vSortedByHeight.push_back(vIndex[i].second);
+    return pblocktree->WriteBlockIndexSnapshot(vSortedByHeight);
+}
+
 /** Update chainActive and related internal data structures. */
 void static UpdateTip(CBlockIndex *pindexNew) {
     const CChainParams& chainParams = Params();
@@ -2643,9 +2832,9 @@ bool static DisconnectTip(CValidationState& state, const Consensus::Params& cons
     std::vector<uint256> vHashUpdate;
     BOOST_FOREACH(const CTransaction &tx, block.vtx) {
         // ignore validation errors in resurrected transactions
-        list<CTransaction> removed;
+        list<CTransactionRef> removed;
         CValidationState stateDummy;
-        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, tx, false, NULL, true)) {
+        if (tx.IsCoinBase() || !AcceptToMemoryPool(mempool, stateDummy, MakeTransactionRef(tx), false, NULL, true)) {
             mempool.remove(tx, removed, true);
         } else if (mempool.exists(tx.GetHash())) {
             vHashUpdate.push_back(tx.GetHash());
@@ -2714,14 +2903,14 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
     LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.
-    list<CTransaction> txConflicted;
+    list<CTransactionRef> txConflicted;
     mempool.removeForBlock(pblock->vtx, pindexNew->nHeight, txConflicted, !IsInitialBlockDownload());
     // Update chainActive & related variables.
     UpdateTip(pindexNew);
     // Tell wallet about transactions that went from mempool
     // to conflicted:
-    BOOST_FOREACH(const CTransaction &tx, txConflicted) {
-        SyncWithWallets(tx, NULL);
+    BOOST_FOREACH(const CTransactionRef &ptx, txConflicted) {
+        SyncWithWallets(*ptx, NULL);
     }
     // ... and about transactions that got confirmed:
     BOOST_FOREACH(const CTransaction &tx, pblock->vtx) {
@@ -3044,14 +3233,11 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = mapBlockIndex.emplace(hash, CBlockIndex(block)).first->second;
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
     BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
@@ -3598,6 +3784,7 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune)
 {
     for (set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMapper.Forget(*it);
         boost::filesystem::remove(GetBlockPosFilename(pos, "blk"));
         boost::filesystem::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3704,38 +3891,30 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     if (hash.IsNull())
         return NULL;
 
-    // Return existing
-    BlockMap::iterator mi = mapBlockIndex.find(hash);
-    if (mi != mapBlockIndex.end())
-        return (*mi).second;
-
-    // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw runtime_error("LoadBlockIndex(): new CBlockIndex failed");
-    mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-
-    return pindexNew;
+    // Return existing, or create new
+    return mapBlockIndex.emplace(hash).first->second;
 }
 
 bool static LoadBlockIndexDB()
 {
     const CChainParams& chainparams = Params();
-    if (!pblocktree->LoadBlockIndexGuts())
-        return false;
+    // The snapshot written at the last clean shutdown comes sorted by height
+    vector<pair<int, CBlockIndex*> > vSortedByHeight;
+    if (!pblocktree->LoadBlockIndexSnapshot(vSortedByHeight)) {
+        if (!pblocktree->LoadBlockIndexGuts())
+            return false;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+    }
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
-    vector<pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
     BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
     {
         CBlockIndex* pindex = item.second;
@@ -3809,16 +3988,26 @@ bool static LoadBlockIndexDB()
     pblocktree->ReadReindexing(fReindexing);
     fReindex |= fReindexing;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
         return true;
     chainActive.SetTip(it->second);
 
+    // A transaction index written inline by an older version is complete up
+    // to the tip; let the indexer carry on from there.
+    bool fLegacyTxIndex = false;
+    CBlockLocator locatorTxIndex;
+    if (pblocktree->ReadFlag("txindex", fLegacyTxIndex) && fLegacyTxIndex) {
+        if (!pblocktree->ReadTxIndexBest(locatorTxIndex)) {
+            std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+            if (!pblocktree->WriteTxIndex(vPos, chainActive.GetLocator()))
+                return error("%s: failed to write the transaction index locator", __func__);
+        }
+        pblocktree->WriteFlag("txindex", false);
+        LogPrintf("%s: transaction index upgraded at height %d\n", __func__, chainActive.Height());
+    }
+
     PruneBlockIndexCandidates();
 
     LogPrintf("%s: hashBestChain=%s height=%d date=%s progress=%f\n", __func__,
@@ -3839,7 +4028,82 @@ CVerifyDB::~CVerifyDB()
     uiInterface.ShowProgress("", 100);
 }
 
-bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth)
+namespace {
+
+/** Closure reading one block for VerifyDB and running check levels 0 to 2 on it */
+class CVerifyBlockCheck
+{
+private:
+    CBlockIndex* pindex;
+    int nCheckLevel;
+    const Consensus::Params* pconsensus;
+    //! Where the block goes if it is needed afterwards, or NULL
+    CBlock* pblock;
+    //! Receives the reason if a check fails
+    std::string* pstrError;
+
+public:
+    CVerifyBlockCheck() : pindex(NULL), nCheckLevel(0), pconsensus(NULL), pblock(NULL), pstrError(NULL) {}
+    CVerifyBlockCheck(CBlockIndex* pindexIn, int nCheckLevelIn, const Consensus::Params& consensus, CBlock* pblockIn, std::string* pstrErrorIn) :
+        pindex(pindexIn), nCheckLevel(nCheckLevelIn), pconsensus(&consensus), pblock(pblockIn), pstrError(pstrErrorIn) {}
+
+    bool operator()()
+    {
+        CBlock blockTmp;
+        CBlock& block = pblock ? *pblock : blockTmp;
+        // check level 0: read from disk
+        if (!ReadBlockFromDisk(block, pindex, *pconsensus)) {
+            *pstrError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return false;
+        }
+        // check level 1: verify block validity
+        CValidationState state;
+        if (nCheckLevel >= 1 && !CheckBlock(block, state)) {
+            *pstrError = strprintf("found bad block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            return false;
+        }
+        // check level 2: verify undo validity
+        if (nCheckLevel >= 2) {
+            CBlockUndo undo;
+            CDiskBlockPos pos = pindex->GetUndoPos();
+            if (!pos.IsNull()) {
+                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash())) {
+                    *pstrError = strprintf("found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    void swap(CVerifyBlockCheck& check)
+    {
+        std::swap(pindex, check.pindex);
+        std::swap(nCheckLevel, check.nCheckLevel);
+        std::swap(pconsensus, check.pconsensus);
+        std::swap(pblock, check.pblock);
+        std::swap(pstrError, check.pstrError);
+    }
+};
+
+/** Stops, and waits for, a group of threads when it goes out of scope */
+class CThreadGroupStopper
+{
+private:
+    boost::thread_group& threads;
+
+public:
+    CThreadGroupStopper(boost::thread_group& threadsIn) : threads(threadsIn) {}
+    ~CThreadGroupStopper()
+    {
+        threads.interrupt_all();
+        threads.join_all();
+    }
+};
+
+}
+
+bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, int nThreads, int64_t nTimeLimit)
 {
     LOCK(cs_main);
     if (chainActive.Tip() == NULL || chainActive.Tip()->pprev == NULL)
@@ -3851,37 +4115,76 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     if (nCheckDepth > chainActive.Height())
         nCheckDepth = chainActive.Height();
     nCheckLevel = std::max(0, std::min(4, nCheckLevel));
-    LogPrintf("Verifying last %i blocks at level %i\n", nCheckDepth, nCheckLevel);
+    nThreads = std::max(1, std::min(MAX_CHECK_THREADS, nThreads));
+    LogPrintf("Verifying last %i blocks at level %i with %i threads\n", nCheckDepth, nCheckLevel, nThreads);
+    const int64_t nTimeStart = GetTime();
+
+    std::vector<CBlockIndex*> vIndex;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    {
+        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+            break;
+        // Nothing to check below a loaded snapshot or pruned blocks
+        if (fHavePruned && !(pindex->nStatus & BLOCK_HAVE_DATA))
+            break;
+        vIndex.push_back(pindex);
+    }
+
+    // Levels 0 to 2 don't depend on the order of the blocks, so batches of
+    // blocks go to a pool of threads. Level 3 then disconnects each batch,
+    // in order, from the blocks the threads read; only then are the blocks
+    // kept in memory, so those batches are smaller.
+    CCheckQueue<CVerifyBlockCheck> queue(1, nThreads);
+    boost::thread_group threads;
+    CThreadGroupStopper stopper(threads);
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CVerifyBlockCheck>::Thread, &queue));
+    const size_t nBatchSize = (nCheckLevel >= 3 ? 4 : 64) * nThreads;
+
     CCoinsViewCache coins(coinsview);
     CBlockIndex* pindexState = chainActive.Tip();
     CBlockIndex* pindexFailure = NULL;
     int nGoodTransactions = 0;
+    bool fTimeUp = false;
     CValidationState state;
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev)
+    std::vector<CBlock> vBlocks;
+    std::vector<std::string> vErrors;
+    for (size_t nBegin = 0; nBegin < vIndex.size(); nBegin += nBatchSize)
     {
         boost::this_thread::interruption_point();
-        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100)))));
-        if (pindex->nHeight < chainActive.Height()-nCheckDepth)
+        if (nTimeLimit > 0 && GetTime() - nTimeStart >= nTimeLimit) {
+            LogPrintf("VerifyDB(): time limit of %d seconds reached after %u blocks\n", nTimeLimit, nBegin);
+            fTimeUp = true;
             break;
-        CBlock block;
-        // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state))
-            return error("VerifyDB(): *** found bad block at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-        // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
-            CBlockUndo undo;
-            CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
         }
+        uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, (int)((double)nBegin / (double)vIndex.size() * (nCheckLevel >= 4 ? 50 : 100)))));
+        const size_t nEnd = std::min(vIndex.size(), nBegin + nBatchSize);
+
+        vErrors.assign(nEnd - nBegin, std::string());
+        vBlocks.assign(nCheckLevel >= 3 ? nEnd - nBegin : 0, CBlock());
+        std::vector<CVerifyBlockCheck> vChecks;
+        vChecks.reserve(nEnd - nBegin);
+        for (size_t i = nBegin; i < nEnd; i++)
+            vChecks.push_back(CVerifyBlockCheck(vIndex[i], nCheckLevel, chainparams.GetConsensus(), vBlocks.empty() ? NULL : &vBlocks[i - nBegin], &vErrors[i - nBegin]));
+        CCheckQueueControl<CVerifyBlockCheck> control(&queue);
+        control.Add(vChecks);
+        if (!control.Wait()) {
+            // Report the first failure in the batch; checks after another
+            // failed may not have run at all
+            for (size_t i = 0; i < vErrors.size(); i++)
+                if (!vErrors[i].empty())
+                    return error("VerifyDB(): *** %s", vErrors[i]);
+            return error("VerifyDB(): *** check failed");
+        }
+
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+        for (size_t i = nBegin; i < nEnd && nCheckLevel >= 3; i++) {
+            CBlockIndex* pindex = vIndex[i];
+            if (pindex != pindexState || (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) > nCoinCacheUsage)
+                break;
+            const CBlock& block = vBlocks[i - nBegin];
             bool fClean = true;
+            PrefetchDisconnectCoins(block, coins);
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
             pindexState = pindex->pprev;
@@ -3898,15 +4201,20 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         return error("VerifyDB(): *** coin database inconsistencies found (last %i blocks, %i good transactions before that)\n", chainActive.Height() - pindexFailure->nHeight + 1, nGoodTransactions);
 
     // check level 4: try reconnecting blocks
-    if (nCheckLevel >= 4) {
+    if (nCheckLevel >= 4 && !fTimeUp) {
         CBlockIndex *pindex = pindexState;
         while (pindex != chainActive.Tip()) {
             boost::this_thread::interruption_point();
+            if (nTimeLimit > 0 && GetTime() - nTimeStart >= nTimeLimit) {
+                LogPrintf("VerifyDB(): time limit of %d seconds reached while reconnecting at height %d\n", nTimeLimit, pindex->nHeight);
+                break;
+            }
             uiInterface.ShowProgress(_("Verifying blocks..."), std::max(1, std::min(99, 100 - (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * 50))));
             pindex = chainActive.Next(pindex);
             CBlock block;
             if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
                 return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+            // ConnectBlock prefetches the block's inputs through pcoinsPrefetch
             if (!ConnectBlock(block, state, pindex, coins))
                 return error("VerifyDB(): *** found unconnectable block at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
@@ -3944,9 +4252,6 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
     fHavePruned = false;
 }
@@ -3970,9 +4275,6 @@ bool InitBlockIndex(const CChainParams& chainparams)
     if (chainActive.Genesis() != NULL)
         return true;
 
-    // Use the provided setting for -txindex in the new database
-    fTxIndex = GetBoolArg("-txindex", DEFAULT_TXINDEX);
-    pblocktree->WriteFlag("txindex", fTxIndex);
     LogPrintf("Initializing databases...\n");
 
     // Only add the genesis block if not reindexing (in which case we reuse the one already on disk)
@@ -4002,105 +4304,345 @@ bool InitBlockIndex(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
-{
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
-    int64_t nStart = GetTimeMillis();
+/**
+ * UTXO set snapshot file format:
+ * - TXOUTSET_MAGIC and TXOUTSET_VERSION
+ * - the hash of the block the snapshot was taken at
+ * - the number of blocks after the genesis block up to that block, followed
+ *   by each of their headers and VARINT(nTx)
+ * - for every transaction with unspent outputs, its txid and CCoins, in
+ *   database order, terminated by a null txid
+ * - the SHA256d checksum of everything after the version
+ */
+static const char TXOUTSET_MAGIC[4] = {'u', 't', 'x', 'o'};
+static const uint32_t TXOUTSET_VERSION = 1;
+//! Number of transactions written to the coin database per batch when loading a snapshot
+static const size_t TXOUTSET_LOAD_BATCH_SIZE = 50000;
 
-    int nLoaded = 0;
+bool DumpTxOutSet(const boost::filesystem::path& path, CTxOutSetSnapshot& snapshot)
+{
+    std::vector<const CBlockIndex*> vChain;
+    boost::scoped_ptr<CDBIterator> pcursor;
+    {
+        LOCK(cs_main);
+        // Get the database to describe the tip, and open a cursor on it
+        // before anything can change it again.
+        FlushStateToDisk();
+        snapshot.hashBlock = chainActive.Tip()->GetBlockHash();
+        snapshot.nHeight = chainActive.Height();
+        if (pcoinsdbview->GetBestBlock() != snapshot.hashBlock)
+            return error("%s: coin database is not at the tip", __func__);
+        pcursor.reset(pcoinsdbview->NewCoinsCursor());
+        for (int nHeight = 1; nHeight <= chainActive.Height(); nHeight++)
+            vChain.push_back(chainActive[nHeight]);
+    }
+
+    boost::filesystem::path pathTmp(path.string() + ".incomplete");
+    CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: failed to open %s", __func__, pathTmp.string());
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SIZE, MAX_BLOCK_SIZE+8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        file.write(TXOUTSET_MAGIC, sizeof(TXOUTSET_MAGIC));
+        file << TXOUTSET_VERSION;
+        file << snapshot.hashBlock;
+        hasher << snapshot.hashBlock;
+        unsigned int nHeaders = vChain.size();
+        file << VARINT(nHeaders);
+        hasher << VARINT(nHeaders);
+        BOOST_FOREACH(const CBlockIndex* pindex, vChain) {
+            CBlockHeader header = pindex->GetBlockHeader();
+            unsigned int nTx = pindex->nTx;
+            file << header << VARINT(nTx);
+            hasher << header << VARINT(nTx);
+        }
+        uint256 txid;
+        CCoins coins;
+        while (CCoinsViewDB::ReadCoins(pcursor.get(), txid, coins)) {
             boost::this_thread::interruption_point();
+            file << txid << coins;
+            hasher << txid << coins;
+            snapshot.nTransactions++;
+            for (unsigned int i = 0; i < coins.vout.size(); i++)
+                snapshot.nTransactionOutputs += !coins.vout[i].IsNull();
+        }
+        file << uint256();
+        hasher << uint256();
+        snapshot.hashChecksum = hasher.GetHash();
+        file << snapshot.hashChecksum;
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    file.fclose();
+    if (!RenameOver(pathTmp, path))
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    LogPrintf("%s: wrote %u transactions at block %s to %s\n", __func__, snapshot.nTransactions, snapshot.hashBlock.ToString(), path.string());
+    return true;
+}
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
+/** Read the part of a snapshot file before the checksummed data. */
+static bool ReadTxOutSetHeader(const boost::filesystem::path& path, CAutoFile& file, uint256& hashBlock)
+{
+    if (file.IsNull())
+        return error("%s: failed to open %s", __func__, path.string());
+    char magic[sizeof(TXOUTSET_MAGIC)];
+    uint32_t nVersion;
+    file.read(magic, sizeof(magic));
+    file >> nVersion;
+    if (memcmp(magic, TXOUTSET_MAGIC, sizeof(magic)) || nVersion != TXOUTSET_VERSION)
+        return error("%s: %s is not a UTXO set snapshot of a known version", __func__, path.string());
+    file >> hashBlock;
+    return true;
+}
+
+bool LoadTxOutSet(const CChainParams& chainparams, const boost::filesystem::path& path)
+{
+    LOCK(cs_main);
+    if (chainActive.Height() > 0) {
+        LogPrintf("%s: the chain is past the genesis block already; not loading %s\n", __func__, path.string());
+        return true;
+    }
+    if (fTxIndex)
+        return error("%s: cannot start from a snapshot with -txindex", __func__);
+    if (!fPruneMode)
+        return error("%s: starting from a snapshot requires -prune", __func__);
+
+    try {
+        // First check the whole file against its checksum, so that nothing
+        // is touched unless it loads completely.
+        uint256 hashBlock, hashChecksum;
+        {
+            CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+            if (!ReadTxOutSetHeader(path, file, hashBlock))
+                return false;
+            MapTxOutSetSnapshots::const_iterator itPinned = chainparams.TxOutSetSnapshots().find(hashBlock);
+            if (itPinned == chainparams.TxOutSetSnapshots().end() && chainparams.NetworkIDString() != CBaseChainParams::REGTEST)
+                return error("%s: no snapshot at block %s is known", __func__, hashBlock.ToString());
+            uiInterface.InitMessage(_("Verifying UTXO set snapshot..."));
+            CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+            hasher << hashBlock;
+            unsigned int nHeaders;
+            file >> VARINT(nHeaders);
+            hasher << VARINT(nHeaders);
+            for (unsigned int i = 0; i < nHeaders; i++) {
+                CBlockHeader header;
+                unsigned int nTx;
+                file >> header >> VARINT(nTx);
+                hasher << header << VARINT(nTx);
+            }
+            while (true) {
+                uint256 txid;
+                file >> txid;
+                hasher << txid;
+                if (txid.IsNull())
+                    break;
+                CCoins coins;
+                file >> coins;
+                hasher << coins;
+            }
+            file >> hashChecksum;
+            if (hashChecksum != hasher.GetHash())
+                return error("%s: %s is corrupted", __func__, path.string());
+            if (itPinned != chainparams.TxOutSetSnapshots().end() && hashChecksum != itPinned->second)
+                return error("%s: snapshot checksum %s does not match the known one", __func__, hashChecksum.ToString());
+        }
+
+        uiInterface.InitMessage(_("Loading UTXO set snapshot..."));
+        CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        if (!ReadTxOutSetHeader(path, file, hashBlock))
+            return false;
+
+        // Add the chain up to the snapshot's block to the block index, as
+        // validated blocks whose data has been pruned.
+        CBlockIndex* pindexPrev = chainActive.Tip();
+        unsigned int nHeaders;
+        file >> VARINT(nHeaders);
+        for (unsigned int i = 0; i < nHeaders; i++) {
+            CBlockHeader header;
+            unsigned int nTx;
+            file >> header >> VARINT(nTx);
+            if (header.hashPrevBlock != pindexPrev->GetBlockHash() || nTx == 0)
+                return error("%s: snapshot headers do not form a chain", __func__);
+            CBlockIndex* pindex = AddToBlockIndex(header);
+            pindex->nTx = nTx;
+            pindex->nChainTx = pindexPrev->nChainTx + nTx;
+            pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+            setDirtyBlockIndex.insert(pindex);
+            {
+                LOCK(cs_nBlockSequenceId);
+                pindex->nSequenceId = nBlockSequenceId++;
+            }
+            pindexPrev = pindex;
+        }
+        if (pindexPrev->GetBlockHash() != hashBlock)
+            return error("%s: snapshot headers do not lead to block %s", __func__, hashBlock.ToString());
+
+        // Write the coins in the order they come in, which is the database's.
+        // They go to disk in several batches, the first of them before the
+        // best block and the block index, so mark the database as being
+        // loaded until all of it is written.
+        if ((pcoinsFlusher && !pcoinsFlusher->Wait()) || !pcoinsdbview->WriteLoadingTxOutSet(true))
+            return error("%s: failed to write to coin database", __func__);
+        CCoinsMap mapCoins;
+        uint64_t nTransactions = 0;
+        while (true) {
+            uint256 txid;
+            file >> txid;
+            if (txid.IsNull())
                 break;
+            CCoins coins;
+            file >> coins;
+            for (unsigned int i = 0; i < coins.vout.size(); i++) {
+                if (coins.vout[i].IsNull())
+                    continue;
+                CCoinsCacheEntry& entry = mapCoins[COutPoint(txid, i)];
+                entry.coin = Coin(coins.vout[i], coins.nHeight, coins.fCoinBase, coins.nVersion);
+                entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                CBlock block;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+            if (++nTransactions % TXOUTSET_LOAD_BATCH_SIZE == 0) {
+                if (!pcoinsdbview->BatchWrite(mapCoins, uint256()))
+                    return error("%s: failed to write to coin database", __func__);
+                LogPrintf("%s: %u transactions loaded...\n", __func__, nTransactions);
+            }
+        }
+        if (!pcoinsdbview->BatchWrite(mapCoins, hashBlock))
+            return error("%s: failed to write to coin database", __func__);
+
+        chainActive.SetTip(pindexPrev);
+        setBlockIndexCandidates.insert(pindexPrev);
+        PruneBlockIndexCandidates();
+        pcoinsTip->SetBestBlock(hashBlock);
+        fHavePruned = true;
+        pblocktree->WriteFlag("prunedblockfiles", true);
+        LogPrintf("%s: loaded %u transactions, continuing from block %s at height %d\n", __func__,
+            nTransactions, hashBlock.ToString(), chainActive.Height());
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+
+    CValidationState state;
+    if (!FlushStateToDisk(state, FLUSH_STATE_ALWAYS))
+        return false;
+    if (!pcoinsdbview->WriteLoadingTxOutSet(false))
+        return error("%s: failed to write to coin database", __func__);
+    return true;
+}
+
+/** Keep imported blocks whose parent is not known yet in memory up to this many bytes */
+static const size_t MAX_IMPORT_UNKNOWN_PARENT_BYTES = 64 * MAX_BLOCK_SIZE;
+
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
+{
+    // Blocks with unknown parent. They are kept in memory up to a limit, and
+    // beyond that only by their disk position (which only reindex has).
+    static std::multimap<uint256, CImportedBlock> mapBlocksUnknownParent;
+    static size_t nUnknownParentBytes = 0;
+    int64_t nStart = GetTimeMillis();
+    int64_t nLastProgress = nStart;
+
+    int nLoaded = 0;
+    int nRead = 0;
+    uint64_t nBytesRead = 0;
+    CBlockImportPipeline pipeline(chainparams, fileIn, dbp ? dbp->nFile : -1, nImportThreads);
+    CImportedBlock imported;
+    while (pipeline.Next(imported)) {
+        boost::this_thread::interruption_point();
+        nRead++;
+        nBytesRead += imported.nSize;
+        if (GetTimeMillis() - nLastProgress > 10000) {
+            nLastProgress = GetTimeMillis();
+            int nHeight;
+            {
+                LOCK(cs_main);
+                nHeight = chainActive.Height();
+            }
+            LogPrintf("Block Import: %i blocks read (%.1f MB/s), %i loaded, height %d\n", nRead,
+                nBytesRead / 1000.0 / (nLastProgress - nStart), nLoaded, nHeight);
+        }
+        if (!imported.pblock)
+            continue;
+        const CBlock& block = *imported.pblock;
+        if (dbp)
+            *dbp = imported.pos;
+        try {
+            // detect out of order blocks, and store them for later
+            uint256 hash = block.GetHash();
+            bool fParentKnown, fHaveData;
+            {
+                LOCK(cs_main);
+                fParentKnown = hash == chainparams.GetConsensus().hashGenesisBlock || mapBlockIndex.count(block.hashPrevBlock);
+                BlockMap::iterator mi = mapBlockIndex.find(hash);
+                fHaveData = mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA);
+                if (fHaveData && hash != chainparams.GetConsensus().hashGenesisBlock && mi->second->nHeight % 1000 == 0)
+                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mi->second->nHeight);
+            }
+            if (!fParentKnown) {
+                LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                        block.hashPrevBlock.ToString());
+                if (nUnknownParentBytes + imported.nSize <= MAX_IMPORT_UNKNOWN_PARENT_BYTES) {
+                    nUnknownParentBytes += imported.nSize;
+                } else if (dbp) {
+                    imported.pblock.reset();
+                } else {
                     continue;
                 }
+                mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, imported));
+                continue;
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    CValidationState state;
-                    if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp))
-                        nLoaded++;
-                    if (state.IsError())
-                        break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrintf("Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
-                }
+            // process in case the block isn't known yet
+            if (!fHaveData) {
+                CValidationState state;
+                if (ProcessNewBlock(state, chainparams, NULL, &block, true, dbp))
+                    nLoaded++;
+                if (state.IsError())
+                    break;
+            }
 
-                // Recursively process earlier encountered successors of this block
-                deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        if (ReadBlockFromDisk(block, it->second, chainparams.GetConsensus()))
+            // Recursively process earlier encountered successors of this block
+            deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CImportedBlock>::iterator, std::multimap<uint256, CImportedBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CImportedBlock>::iterator it = range.first;
+                    boost::shared_ptr<CBlock> pchild = it->second.pblock;
+                    if (pchild) {
+                        nUnknownParentBytes -= it->second.nSize;
+                    } else {
+                        pchild.reset(new CBlock());
+                        if (!ReadBlockFromDisk(*pchild, it->second.pos, chainparams.GetConsensus()))
+                            pchild.reset();
+                    }
+                    if (pchild)
+                    {
+                        LogPrintf("%s: Processing out of order child %s of %s\n", __func__, pchild->GetHash().ToString(),
+                                head.ToString());
+                        CValidationState dummy;
+                        if (ProcessNewBlock(dummy, chainparams, NULL, pchild.get(), true, it->second.pos.IsNull() ? NULL : &it->second.pos))
                         {
-                            LogPrintf("%s: Processing out of order child %s of %s\n", __func__, block.GetHash().ToString(),
-                                    head.ToString());
-                            CValidationState dummy;
-                            if (ProcessNewBlock(dummy, chainparams, NULL, &block, true, &it->second))
-                            {
-                                nLoaded++;
-                                queue.push_back(block.GetHash());
-                            }
+                            nLoaded++;
+                            queue.push_back(pchild->GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
         }
-    } catch (const std::runtime_error& e) {
-        AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    std::string strError = pipeline.GetError();
+    if (!strError.empty())
+        AbortNode(std::string("System error: ") + strError);
+    if (nLoaded > 0) {
+        int64_t nTime = std::max(GetTimeMillis() - nStart, (int64_t)1);
+        LogPrintf("Loaded %i blocks from external file in %dms (%.1f MB/s, %.1f blocks/s)\n", nLoaded, nTime,
+            nBytesRead / 1000.0 / nTime, nRead * 1000.0 / nTime);
+    }
     return nLoaded > 0;
 }
 
@@ -4385,7 +4927,8 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
             return recentRejects->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    mapOrphanTransactions.count(inv.hash) ||
-                   pcoinsTip->HaveCoins(inv.hash);
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
+                   pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
         }
     case MSG_BLOCK:
         return mapBlockIndex.count(inv.hash);
@@ -4448,14 +4991,21 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
-                        assert(!"cannot load block from disk");
                     if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage(NetMsgType::BLOCK, block);
+                    {
+                        // Send block from disk as it is stored there, without
+                        // deserializing it
+                        CBlockFileView view;
+                        if (!ReadRawBlockFromDisk(view, (*mi).second, Params().MessageStart()))
+                            assert(!"cannot load block from disk");
+                        pfrom->PushRawMessage(NetMsgType::BLOCK, view);
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
+                        // Send block from disk
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, consensusParams))
+                            assert(!"cannot load block from disk");
                         LOCK(pfrom->cs_filter);
                         if (pfrom->pfilter)
                         {
@@ -4490,27 +5040,21 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
             }
             else if (inv.IsKnownType())
             {
-                // Send stream from relay memory
-                bool pushed = false;
-                {
-                    LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
-                    if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
-                        pushed = true;
-                    }
-                }
-                if (!pushed && inv.type == MSG_TX) {
-                    CTransaction tx;
-                    if (mempool.lookup(inv.hash, tx)) {
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage(NetMsgType::TX, ss);
-                        pushed = true;
+                // Send the transaction from relay memory, or else from the mempool
+                CTransactionRef ptx;
+                if (inv.type == MSG_TX) {
+                    {
+                        LOCK(cs_mapRelay);
+                        map<uint256, CTransactionRef>::iterator mi = mapRelay.find(inv.hash);
+                        if (mi != mapRelay.end())
+                            ptx = mi->second;
                     }
+                    if (!ptx)
+                        ptx = mempool.get(inv.hash);
                 }
-                if (!pushed) {
+                if (ptx) {
+                    pfrom->PushMessage(NetMsgType::TX, *ptx);
+                } else {
                     vNotFound.push_back(inv);
                 }
             }
@@ -4989,8 +5533,9 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
         vector<uint256> vWorkQueue;
         vector<uint256> vEraseQueue;
-        CTransaction tx;
-        vRecv >> tx;
+        CTransactionRef ptx;
+        vRecv >> ptx;
+        const CTransaction& tx = *ptx;
 
         CInv inv(MSG_TX, tx.GetHash());
         pfrom->AddInventoryKnown(inv);
@@ -5003,10 +5548,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->setAskFor.erase(inv.hash);
         mapAlreadyAskedFor.erase(inv);
 
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, tx, true, &fMissingInputs))
+        if (!AlreadyHave(inv) && AcceptToMemoryPool(mempool, state, ptx, true, &fMissingInputs))
         {
             mempool.check(pcoinsTip);
-            RelayTransaction(tx);
+            RelayTransaction(ptx);
             vWorkQueue.push_back(inv.hash);
 
             LogPrint("mempool", "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
@@ -5026,7 +5571,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                      ++mi)
                 {
                     const uint256& orphanHash = *mi;
-                    const CTransaction& orphanTx = mapOrphanTransactions[orphanHash].tx;
+                    CTransactionRef porphanTx = mapOrphanTransactions[orphanHash].tx;
                     NodeId fromPeer = mapOrphanTransactions[orphanHash].fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
@@ -5037,10 +5582,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
                     if (setMisbehaving.count(fromPeer))
                         continue;
-                    if (AcceptToMemoryPool(mempool, stateDummy, orphanTx, true, &fMissingInputs2))
+                    if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, true, &fMissingInputs2))
                     {
                         LogPrint("mempool", "   accepted orphan tx %s\n", orphanHash.ToString());
-                        RelayTransaction(orphanTx);
+                        RelayTransaction(porphanTx);
                         vWorkQueue.push_back(orphanHash);
                         vEraseQueue.push_back(orphanHash);
                     }
@@ -5070,7 +5615,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         }
         else if (fMissingInputs)
         {
-            AddOrphanTx(tx, pfrom->GetId());
+            AddOrphanTx(ptx, pfrom->GetId());
 
             // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
             unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
@@ -5093,7 +5638,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
                 int nDoS = 0;
                 if (!state.IsInvalid(nDoS) || nDoS == 0) {
                     LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->id);
-                    RelayTransaction(tx);
+                    RelayTransaction(ptx);
                 } else {
                     LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->id, FormatStateMessage(state));
                 }
@@ -5963,15 +6508,208 @@ ThresholdState VersionBitsTipState(const Consensus::Params& params, Consensus::D
     return VersionBitsState(chainActive.Tip(), params, pos, versionbitscache);
 }
 
+/**
+ * Mempool dump file format:
+ * - MEMPOOL_DUMP_VERSION
+ * - the number of transactions, followed by each transaction with its entry
+ *   time and priority and fee deltas, parents before their children
+ * - the deltas of transactions that were not in the mempool
+ */
+static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Number of transactions whose scripts are checked together when loading the mempool
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 100;
+
+static bool CompareByAncestorCount(CTxMemPool::txiter a, CTxMemPool::txiter b)
+{
+    // Parents have fewer ancestors than their children
+    return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+}
+
+bool DumpMempool()
+{
+    const int64_t nStart = GetTimeMicros();
+    std::vector<CTransactionRef> vtx;
+    std::vector<int64_t> vTime;
+    std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+    {
+        LOCK(mempool.cs);
+        std::vector<CTxMemPool::txiter> vEntries;
+        vEntries.reserve(mempool.mapTx.size());
+        for (CTxMemPool::txiter it = mempool.mapTx.begin(); it != mempool.mapTx.end(); it++)
+            vEntries.push_back(it);
+        std::sort(vEntries.begin(), vEntries.end(), CompareByAncestorCount);
+        vtx.reserve(vEntries.size());
+        vTime.reserve(vEntries.size());
+        BOOST_FOREACH(CTxMemPool::txiter it, vEntries) {
+            vtx.push_back(it->GetSharedTx());
+            vTime.push_back(it->GetTime());
+        }
+        mapDeltas = mempool.mapDeltas;
+    }
+    const int64_t nMid = GetTimeMicros();
+
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+    CAutoFile file(fopen(pathTmp.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull())
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+    try {
+        file << MEMPOOL_DUMP_VERSION;
+        file << (uint64_t)vtx.size();
+        for (size_t i = 0; i < vtx.size(); i++) {
+            std::pair<double, CAmount> deltas(0.0, 0);
+            std::map<uint256, std::pair<double, CAmount> >::iterator it = mapDeltas.find(vtx[i]->GetHash());
+            if (it != mapDeltas.end()) {
+                deltas = it->second;
+                mapDeltas.erase(it);
+            }
+            file << vtx[i] << vTime[i] << deltas.first << deltas.second;
+        }
+        file << mapDeltas;
+        FileCommit(file.Get());
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    file.fclose();
+    if (!RenameOver(pathTmp, path))
+        return error("%s: failed to rename %s", __func__, pathTmp.string());
+    LogPrintf("%s: wrote %u transactions in %.3fs (copy %.3fs)\n", __func__, vtx.size(),
+              (GetTimeMicros() - nStart) * 0.000001, (nMid - nStart) * 0.000001);
+    return true;
+}
+
+/**
+ * Run the scripts of a batch of transactions about to be loaded on the
+ * queue's threads, with both the standard flags and the tip's block flags
+ * AcceptToMemoryPool checks them with, and remember them as valid for it if
+ * they all are. Otherwise AcceptToMemoryPool checks each of them on its own.
+ */
+static void PrecheckMempoolScripts(CCheckQueue<CScriptCheck>& queue, const std::vector<CTransactionRef>& vtx)
+{
+    std::vector<CScriptCheck> vChecks;
+    std::vector<uint256> vCacheEntries;
+    {
+        LOCK2(cs_main, mempool.cs);
+        std::vector<unsigned int> vFlags(1, STANDARD_SCRIPT_VERIFY_FLAGS);
+        const unsigned int nBlockFlags = GetBlockScriptFlags(chainActive.Tip(), Params().GetConsensus());
+        if (nBlockFlags != STANDARD_SCRIPT_VERIFY_FLAGS)
+            vFlags.push_back(nBlockFlags);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        CCoinsViewCache view(&viewMemPool);
+        BOOST_FOREACH(const CTransactionRef& ptx, vtx) {
+            const CTransaction& tx = *ptx;
+            if (tx.IsCoinBase() || !view.HaveInputs(tx))
+                continue;
+            CValidationState state;
+            std::vector<CScriptCheck> vTxChecks;
+            bool fValid = true;
+            for (size_t i = 0; i < vFlags.size() && fValid; i++)
+                fValid = CheckInputs(tx, state, view, true, vFlags[i], true, false, &vTxChecks);
+            if (!fValid)
+                continue;
+            BOOST_FOREACH(CScriptCheck& check, vTxChecks) {
+                vChecks.push_back(CScriptCheck());
+                check.swap(vChecks.back());
+            }
+            for (size_t i = 0; i < vFlags.size(); i++)
+                vCacheEntries.push_back(GetScriptExecutionCacheKey(tx, vFlags[i]));
+            // Later transactions in the batch may spend this one
+            AddCoins(view, tx, MEMPOOL_HEIGHT, true);
+        }
+    }
+
+    CCheckQueueControl<CScriptCheck> control(&queue);
+    control.Add(vChecks);
+    if (!control.Wait())
+        return;
+    LOCK(cs_main);
+    if (!fScriptExecutionCacheEnabled)
+        return;
+    BOOST_FOREACH(const uint256& hashCacheEntry, vCacheEntries)
+        scriptExecutionCache.insert(hashCacheEntry);
+}
+
+bool LoadMempool()
+{
+    const int64_t nExpiryTimeout = GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    CAutoFile file(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("%s: no mempool to load from %s\n", __func__, path.string());
+        return false;
+    }
+
+    const int nThreads = std::max(1, nScriptCheckThreads);
+    CCheckQueue<CScriptCheck> queue(128, nThreads);
+    boost::thread_group threads;
+    CThreadGroupStopper stopper(threads);
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<CScriptCheck>::Thread, &queue));
+
+    const int64_t nStart = GetTimeMicros();
+    const int64_t nNow = GetTime();
+    unsigned int nLoaded = 0, nFailed = 0, nExpired = 0;
+    try {
+        uint64_t nVersion;
+        file >> nVersion;
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("%s: unknown version %u of %s", __func__, nVersion, path.string());
+        uint64_t nRemaining;
+        file >> nRemaining;
+
+        std::vector<CTransactionRef> vtx;
+        std::vector<int64_t> vTime;
+        while (nRemaining > 0) {
+            boost::this_thread::interruption_point();
+            vtx.clear();
+            vTime.clear();
+            for (; nRemaining > 0 && vtx.size() < MEMPOOL_LOAD_BATCH_SIZE; nRemaining--) {
+                CTransactionRef ptx;
+                int64_t nTime;
+                double dPriorityDelta;
+                CAmount nFeeDelta;
+                file >> ptx >> nTime >> dPriorityDelta >> nFeeDelta;
+                if (dPriorityDelta != 0 || nFeeDelta != 0)
+                    mempool.PrioritiseTransaction(ptx->GetHash(), ptx->GetHash().ToString(), dPriorityDelta, nFeeDelta);
+                if (nTime + nExpiryTimeout <= nNow) {
+                    nExpired++;
+                    continue;
+                }
+                vtx.push_back(ptx);
+                vTime.push_back(nTime);
+            }
+
+            PrecheckMempoolScripts(queue, vtx);
+            for (size_t i = 0; i < vtx.size(); i++) {
+                CValidationState state;
+                LOCK(cs_main);
+                if (AcceptToMemoryPoolWithTime(mempool, state, vtx[i], true, NULL, vTime[i]))
+                    nLoaded++;
+                else
+                    nFailed++;
+            }
+            if (ShutdownRequested())
+                return false;
+        }
+
+        std::map<uint256, std::pair<double, CAmount> > mapDeltas;
+        file >> mapDeltas;
+        for (std::map<uint256, std::pair<double, CAmount> >::const_iterator it = mapDeltas.begin(); it != mapDeltas.end(); it++)
+            mempool.PrioritiseTransaction(it->first, it->first.ToString(), it->second.first, it->second.second);
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    LogPrintf("%s: loaded %u transactions, %u failed, %u expired, in %.3fs with %d script threads\n", __func__,
+              nLoaded, nFailed, nExpired, (GetTimeMicros() - nStart) * 0.000001, nThreads);
+    return true;
+}
+
 class CMainCleanup
 {
 public:
     CMainCleanup() {}
     ~CMainCleanup() {
         // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
         mapBlockIndex.clear();
 
         // orphan transactions
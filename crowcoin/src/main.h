@@ -11,6 +11,8 @@
 #endif
 
 #include "amount.h"
+#include "blockfilemap.h"
+#include "blockindexmap.h"
 #include "chain.h"
 #include "coins.h"
 #include "net.h"
@@ -27,12 +29,15 @@
 #include <utility>
 #include <vector>
 
-#include <boost/unordered_map.hpp>
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CBloomFilter;
 class CChainParams;
+class CCoinsViewDB;
+class CCoinsViewFlusher;
+class CCoinsViewPrefetch;
 class CInv;
 class CScriptCheck;
 class CTxMemPool;
@@ -62,6 +67,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 72;
+/** Default for -persistmempool */
+static const bool DEFAULT_PERSIST_MEMPOOL = true;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -70,9 +77,11 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** -parpin default (pin script-checking threads to CPUs, grouped by NUMA node) */
+static const bool DEFAULT_SCRIPTCHECK_PIN = false;
 /** Number of blocks that can be requested at any given time from a single peer. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
 /** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
@@ -89,6 +98,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Share (in percent) of -dbcache the coins cache is trimmed to after it was written to disk. */
+static const unsigned int COINS_CACHE_TRIM_PERCENT = 75;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -120,15 +131,10 @@ static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Maximum number of headers to announce when relaying blocks with headers message.*/
 static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 
-struct BlockHasher
-{
-    size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
-};
-
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
-typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
+typedef CBlockIndexMap BlockMap;
 extern BlockMap mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
@@ -138,6 +144,8 @@ extern CConditionVariable cvBlockChange;
 extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
+/** Number of threads checking blocks for LoadExternalBlockFile */
+extern int nImportThreads;
 extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
@@ -145,6 +153,9 @@ extern unsigned int nBytesPerSigOp;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
 extern size_t nCoinCacheUsage;
+/** Time (in seconds) the coins cache was last written to disk, and how long that took (in microseconds) */
+extern int64_t nLastCoinsFlushTime;
+extern int64_t nLastCoinsFlushDuration;
 extern CFeeRate minRelayTxFee;
 extern bool fAlerts;
 extern bool fEnableReplacement;
@@ -152,6 +163,9 @@ extern bool fEnableReplacement;
 /** Best header we've seen so far (used for getheaders queries' starting points). */
 extern CBlockIndex *pindexBestHeader;
 
+/** Keeps recently read block files mapped into memory for ReadBlockFromDisk */
+extern CBlockFileMapper blockFileMapper;
+
 /** Minimum disk space required - used in CheckDiskSpace() */
 static const uint64_t nMinDiskSpace = 52428800; // 50MB
 
@@ -167,6 +181,12 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = MIN_BLOCKS_TO_KEEP;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** -checkthreads default (number of threads reading and checking blocks for -checkblocks) */
+static const int DEFAULT_CHECK_THREADS = 4;
+/** Maximum number of -checkblocks threads allowed */
+static const int MAX_CHECK_THREADS = 16;
+/** -checktime default (seconds spent at most on -checkblocks; 0 = no limit) */
+static const int64_t DEFAULT_CHECK_TIME = 0;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -208,6 +228,40 @@ boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
+
+/** Description of a UTXO set snapshot file */
+struct CTxOutSetSnapshot
+{
+    uint256 hashBlock;
+    int nHeight;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint256 hashChecksum;
+
+    CTxOutSetSnapshot() : nHeight(0), nTransactions(0), nTransactionOutputs(0) {}
+};
+
+/**
+ * Write the UTXO set as of the current tip to a snapshot file, along with
+ * the headers of the chain leading up to it. cs_main is only held while
+ * the state to write is pinned down, not while writing it.
+ */
+bool DumpTxOutSet(const boost::filesystem::path& path, CTxOutSetSnapshot& snapshot);
+/**
+ * Start a new chainstate from a snapshot file written by DumpTxOutSet. Only
+ * snapshots pinned in the chain parameters are accepted (any on regtest).
+ * Blocks below the snapshot are treated as pruned afterwards. A load that
+ * does not finish leaves the chainstate marked, for the next start to refuse.
+ */
+bool LoadTxOutSet(const CChainParams& chainparams, const boost::filesystem::path& path);
+/** Write the mempool, with entry times and fee deltas, to mempool.dat in the data directory */
+bool DumpMempool();
+/**
+ * Add the transactions in mempool.dat back to the mempool, in batches whose
+ * scripts are checked in parallel first. cs_main is only held for one
+ * transaction at a time.
+ */
+bool LoadMempool();
 /** Load the block tree and coins database from disk */
 bool LoadBlockIndex();
 /** Unload database information */
@@ -220,8 +274,12 @@ bool ProcessMessages(CNode* pfrom);
  * @param[in]   pto             The node which we are sending messages to.
  */
 bool SendMessages(CNode* pto);
-/** Run an instance of the script checking thread */
-void ThreadScriptCheck();
+/** Run a script verification worker, pinned to CPU nPinIndex (see PinThreadToCPU) unless it is negative. */
+void ThreadScriptCheck(int nPinIndex);
+/** Run a worker reading coins for pcoinsPrefetch */
+void ThreadCoinsPrefetch();
+/** Run the thread writing the chainstate for pcoinsFlusher */
+void ThreadCoinsFlush();
 /** Try to detect Partition (network isolation) attacks against us */
 void PartitionCheck(bool (*initialDownloadCheck)(), CCriticalSection& cs, const CBlockIndex *const &bestHeader, int64_t nPowTargetSpacing);
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
@@ -270,13 +328,21 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
+/** Abort with a message: report a fatal error (e.g. a failed disk write) and shut the node down. Returns false. */
+bool AbortNode(const std::string& strMessage, const std::string& userMessage = "");
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
+/** Write the block index to a snapshot that the next start loads instead of the database; only once everything is flushed. */
+bool WriteBlockIndexSnapshot();
 
 /** (try to) add transaction to memory pool **/
-bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransaction &tx, bool fLimitFree,
+bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false);
 
+/** (try to) add transaction to memory pool, as if it had arrived at nAcceptTime */
+bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
+                                bool* pfMissingInputs, int64_t nAcceptTime, bool fOverrideMempoolLimit=false, bool fRejectAbsurdFee=false);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -337,9 +403,15 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& ma
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ * Successful script execution of the whole transaction with the given flags is remembered if
+ * cacheFullScriptStore is set (and pvChecks is NULL), so a later call with the same flags skips
+ * the scripts entirely. Requires cs_main.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck> *pvChecks = NULL);
+
+/** Initialize the script execution cache, sized from -maxsigcachesize */
+void InitScriptExecutionCache();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCache &inputs, int nHeight);
@@ -402,8 +474,8 @@ private:
 
 public:
     CScriptCheck(): ptxTo(0), nIn(0), nFlags(0), cacheStore(false), error(SCRIPT_ERR_UNKNOWN_ERROR) {}
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey),
+    CScriptCheck(const CScript& scriptPubKeyIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn) :
+        scriptPubKey(scriptPubKeyIn),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), error(SCRIPT_ERR_UNKNOWN_ERROR) { }
 
     bool operator()();
@@ -425,6 +497,14 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/**
+ * Get the serialized bytes of the block at pos without deserializing them,
+ * for callers that only pass them on. The message start in front of the
+ * block is checked, and for a block index also the header's hash.
+ */
+bool ReadRawBlockFromDisk(CBlockFileView& view, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
+bool ReadRawBlockFromDisk(CBlockFileView& view, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -508,7 +588,13 @@ class CVerifyDB {
 public:
     CVerifyDB();
     ~CVerifyDB();
-    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth);
+    /**
+     * Check the last nCheckDepth blocks of the active chain. Check levels 0
+     * to 2 run on nThreads threads; disconnecting and reconnecting the
+     * blocks (levels 3 and 4) goes in chain order. If nTimeLimit is
+     * positive, verification stops, successfully, after that many seconds.
+     */
+    bool VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview, int nCheckLevel, int nCheckDepth, int nThreads = 1, int64_t nTimeLimit = 0);
 };
 
 /** Find the last common block between the parameter chain and a locator. */
@@ -526,6 +612,15 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Reads the coins a block spends ahead of ConnectBlock; sits between pcoinsTip and the database */
+extern CCoinsViewPrefetch *pcoinsPrefetch;
+
+/** Writes the chainstate to the database in the background; sits below pcoinsPrefetch */
+extern CCoinsViewFlusher *pcoinsFlusher;
+
+/** The coin database at the bottom of the pcoinsTip stack (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
@@ -12,6 +12,8 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "main.h"
 #include "net.h"
@@ -25,9 +27,9 @@
 #include "utilmoneystr.h"
 #include "validationinterface.h"
 
+#include <algorithm>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
-#include <queue>
 
 using namespace std;
 
@@ -41,21 +43,309 @@ using namespace std;
 // transactions in the memory pool. When we select transactions from the
 // pool, we select by highest priority or fee rate, so we might consider
 // transactions that depend on transactions that aren't yet in the block.
+//
+// Selecting by fee rate, we look at each transaction together with its
+// in-mempool ancestors (its "package"), by the fee rate of the package, so
+// that a child paying for its parents gets them into the block. Once a
+// package is in the block, the remaining descendants of its transactions
+// only need what's still missing, so they are kept, with their packages
+// adjusted, in a separate set that is looked at side by side with the
+// mempool.
 
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
-class ScoreCompare
+struct update_for_parent_inclusion
 {
-public:
-    ScoreCompare() {}
+    update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
 
-    bool operator()(const CTxMemPool::txiter a, const CTxMemPool::txiter b)
+    void operator() (CTxMemPoolModifiedEntry& e)
     {
-        return CompareTxMemPoolEntryByScore()(*b,*a); // Convert to less than
+        e.nModFeesWithAncestors -= iter->GetModifiedFee();
+        e.nSizeWithAncestors -= iter->GetTxSize();
+        e.nSigOpCountWithAncestors -= iter->GetSigOpCount();
     }
+
+    CTxMemPool::txiter iter;
 };
 
+// Give up on filling the block after this many packages in a row didn't
+// fit, once it is nearly full.
+static const int MAX_CONSECUTIVE_FAILURES = 1000;
+
+BlockAssembler::BlockAssembler(CTxMemPool& poolIn, CBlockTemplate* pblocktemplateIn, int nHeightIn, int64_t nLockTimeCutoffIn) :
+    pool(poolIn), pblocktemplate(pblocktemplateIn), pblock(&pblocktemplateIn->block), nHeight(nHeightIn), nLockTimeCutoff(nLockTimeCutoffIn),
+    nBlockSize(1000), nBlockTx(0), nBlockSigOps(100), nFees(0), lastFewTxs(0), blockFinished(false)
+{
+    // Largest block you're willing to create:
+    nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
+    // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
+    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE-1000), nBlockMaxSize));
+
+    // How much of the block should be dedicated to high-priority transactions,
+    // included regardless of the fees they pay
+    nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
+    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
+
+    // Minimum block size you want to create; block will be filled with free transactions
+    // until there are no more or the block reaches this size:
+    nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
+    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
+
+    fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
+}
+
+void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
+{
+    pblock->vtx.push_back(iter->GetTx());
+    pblocktemplate->vTxFees.push_back(iter->GetFee());
+    pblocktemplate->vTxSigOps.push_back(iter->GetSigOpCount());
+    nBlockSize += iter->GetTxSize();
+    ++nBlockTx;
+    nBlockSigOps += iter->GetSigOpCount();
+    nFees += iter->GetFee();
+    inBlock.insert(iter);
+
+    if (fPrintPriority)
+    {
+        double dPriority = iter->GetPriority(nHeight);
+        CAmount dummy;
+        pool.ApplyDeltas(iter->GetTx().GetHash(), dPriority, dummy);
+        LogPrintf("priority %.1f fee %s txid %s\n",
+                  dPriority, CFeeRate(iter->GetModifiedFee(), iter->GetTxSize()).ToString(), iter->GetTx().GetHash().ToString());
+    }
+}
+
+bool BlockAssembler::IsStillDependent(CTxMemPool::txiter iter) const
+{
+    BOOST_FOREACH(CTxMemPool::txiter parent, pool.GetMemPoolParents(iter))
+    {
+        if (!inBlock.count(parent))
+            return true;
+    }
+    return false;
+}
+
+bool BlockAssembler::TestForBlock(CTxMemPool::txiter iter)
+{
+    if (nBlockSize + iter->GetTxSize() >= nBlockMaxSize) {
+        if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
+            blockFinished = true;
+            return false;
+        }
+        // Once we're within 1000 bytes of a full block, only look at 50 more txs
+        // to try to fill the remaining space.
+        if (nBlockSize > nBlockMaxSize - 1000) {
+            lastFewTxs++;
+        }
+        return false;
+    }
+
+    if (nBlockSigOps + iter->GetSigOpCount() >= MAX_BLOCK_SIGOPS) {
+        if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2) {
+            blockFinished = true;
+        }
+        return false;
+    }
+
+    return IsFinalTx(iter->GetTx(), nHeight, nLockTimeCutoff);
+}
+
+bool BlockAssembler::TestPackage(uint64_t packageSize, unsigned int packageSigOps) const
+{
+    if (nBlockSize + packageSize >= nBlockMaxSize)
+        return false;
+    if (nBlockSigOps + packageSigOps >= MAX_BLOCK_SIGOPS)
+        return false;
+    return true;
+}
+
+bool BlockAssembler::TestPackageFinality(const CTxMemPool::setEntries& package) const
+{
+    BOOST_FOREACH(const CTxMemPool::txiter it, package) {
+        if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
+            return false;
+    }
+    return true;
+}
+
+void BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) const
+{
+    BOOST_FOREACH(const CTxMemPool::txiter it, alreadyAdded) {
+        CTxMemPool::setEntries descendants;
+        pool.CalculateDescendants(it, descendants);
+        BOOST_FOREACH(CTxMemPool::txiter desc, descendants) {
+            if (alreadyAdded.count(desc))
+                continue;
+            modtxiter mit = mapModifiedTx.find(desc);
+            if (mit == mapModifiedTx.end()) {
+                CTxMemPoolModifiedEntry modEntry(desc);
+                modEntry.nSizeWithAncestors -= it->GetTxSize();
+                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
+                modEntry.nSigOpCountWithAncestors -= it->GetSigOpCount();
+                mapModifiedTx.insert(modEntry);
+            } else {
+                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
+            }
+        }
+    }
+}
+
+void BlockAssembler::AddPriorityTxs()
+{
+    if (nBlockPrioritySize == 0)
+        return;
+
+    // This vector will be sorted into a priority queue:
+    vector<TxCoinAgePriority> vecPriority;
+    TxCoinAgePriorityCompare pricomparer;
+    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
+    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
+
+    vecPriority.reserve(pool.mapTx.size());
+    for (CTxMemPool::indexed_transaction_set::iterator mi = pool.mapTx.begin();
+         mi != pool.mapTx.end(); ++mi)
+    {
+        double dPriority = mi->GetPriority(nHeight);
+        CAmount dummy;
+        pool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+        vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
+    }
+    std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+
+    while (!vecPriority.empty() && !blockFinished) {
+        CTxMemPool::txiter iter = vecPriority.front().second;
+        double actualPriority = vecPriority.front().first;
+        std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        vecPriority.pop_back();
+
+        // Wait for the parents to be in the block
+        if (IsStillDependent(iter)) {
+            waitPriMap.insert(std::make_pair(iter, actualPriority));
+            continue;
+        }
+
+        // Past the priority part of the block, or below the free threshold,
+        // transactions have to compete by fee rate
+        if (nBlockSize + iter->GetTxSize() >= nBlockPrioritySize || !AllowFree(actualPriority))
+            break;
+
+        if (!TestForBlock(iter))
+            continue;
+        AddToBlock(iter);
+
+        // Retry transactions that were waiting for this one
+        BOOST_FOREACH(CTxMemPool::txiter child, pool.GetMemPoolChildren(iter))
+        {
+            waitPriIter wpiter = waitPriMap.find(child);
+            if (wpiter != waitPriMap.end()) {
+                vecPriority.push_back(TxCoinAgePriority(wpiter->second, child));
+                std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+                waitPriMap.erase(wpiter);
+            }
+        }
+    }
+}
+
+void BlockAssembler::AddPackageTxs()
+{
+    // Descendants of transactions in the block, with their packages reduced
+    // by what's in the block
+    indexed_modified_transaction_set mapModifiedTx;
+    // Entries of mapModifiedTx that didn't fit, so that they don't get
+    // looked at again when the mempool iteration reaches them
+    CTxMemPool::setEntries failedTx;
+
+    UpdatePackagesForAdded(inBlock, mapModifiedTx);
+
+    CTxMemPool::indexed_transaction_set::nth_index<4>::type::iterator mi = pool.mapTx.get<4>().begin();
+    CTxMemPool::txiter iter;
+    int nConsecutiveFailed = 0;
+
+    while (mi != pool.mapTx.get<4>().end() || !mapModifiedTx.empty())
+    {
+        // Skip mempool entries that are in the block, or whose package
+        // changed; mapModifiedTx has the current one
+        if (mi != pool.mapTx.get<4>().end()) {
+            CTxMemPool::txiter it = pool.mapTx.project<0>(mi);
+            if (inBlock.count(it) || failedTx.count(it) || mapModifiedTx.count(it)) {
+                ++mi;
+                continue;
+            }
+        }
+
+        // Take the better of the next mempool entry and the best modified one
+        bool fUsingModified = false;
+        modtxscoreiter modit = mapModifiedTx.get<1>().begin();
+        if (mi == pool.mapTx.get<4>().end()) {
+            iter = modit->iter;
+            fUsingModified = true;
+        } else {
+            iter = pool.mapTx.project<0>(mi);
+            if (modit != mapModifiedTx.get<1>().end() &&
+                    CompareModifiedEntry()(*modit, CTxMemPoolModifiedEntry(iter))) {
+                iter = modit->iter;
+                fUsingModified = true;
+            } else {
+                ++mi;
+            }
+        }
+
+        assert(!inBlock.count(iter));
+
+        uint64_t packageSize = iter->GetSizeWithAncestors();
+        CAmount packageFees = iter->GetModFeesWithAncestors();
+        unsigned int packageSigOps = iter->GetSigOpCountWithAncestors();
+        if (fUsingModified) {
+            packageSize = modit->nSizeWithAncestors;
+            packageFees = modit->nModFeesWithAncestors;
+            packageSigOps = modit->nSigOpCountWithAncestors;
+        }
+
+        if (packageFees < ::minRelayTxFee.GetFee(packageSize) && nBlockSize >= nBlockMinSize) {
+            // Everything else pays a lower fee rate
+            break;
+        }
+
+        CTxMemPool::setEntries ancestors;
+        bool fFits = TestPackage(packageSize, packageSigOps);
+        if (fFits) {
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            pool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            for (CTxMemPool::setEntries::iterator it = ancestors.begin(); it != ancestors.end(); ) {
+                if (inBlock.count(*it))
+                    ancestors.erase(it++);
+                else
+                    ++it;
+            }
+            ancestors.insert(iter);
+            fFits = TestPackageFinality(ancestors);
+        }
+        if (!fFits) {
+            if (fUsingModified) {
+                // It's the best entry of mapModifiedTx, so it has to go for
+                // the next one to be looked at
+                mapModifiedTx.get<1>().erase(modit);
+                failedTx.insert(iter);
+            }
+            if (++nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockSize > nBlockMaxSize - 4000)
+                break;
+            continue;
+        }
+        nConsecutiveFailed = 0;
+
+        std::vector<CTxMemPool::txiter> sortedEntries(ancestors.begin(), ancestors.end());
+        std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
+        for (size_t i = 0; i < sortedEntries.size(); i++) {
+            AddToBlock(sortedEntries[i]);
+            mapModifiedTx.erase(sortedEntries[i]);
+        }
+
+        UpdatePackagesForAdded(ancestors, mapModifiedTx);
+    }
+}
+
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
 {
     int64_t nOldTime = pblock->nTime;
@@ -71,7 +361,7 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
     return nNewTime - nOldTime;
 }
 
-CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn)
+CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMempool)
 {
     // Create new block
     auto_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate());
@@ -91,40 +381,6 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOps.push_back(-1); // updated at end
 
-    // Largest block you're willing to create:
-    unsigned int nBlockMaxSize = GetArg("-blockmaxsize", DEFAULT_BLOCK_MAX_SIZE);
-    // Limit to between 1K and MAX_BLOCK_SIZE-1K for sanity:
-    nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SIZE-1000), nBlockMaxSize));
-
-    // How much of the block should be dedicated to high-priority transactions,
-    // included regardless of the fees they pay
-    unsigned int nBlockPrioritySize = GetArg("-blockprioritysize", DEFAULT_BLOCK_PRIORITY_SIZE);
-    nBlockPrioritySize = std::min(nBlockMaxSize, nBlockPrioritySize);
-
-    // Minimum block size you want to create; block will be filled with free transactions
-    // until there are no more or the block reaches this size:
-    unsigned int nBlockMinSize = GetArg("-blockminsize", DEFAULT_BLOCK_MIN_SIZE);
-    nBlockMinSize = std::min(nBlockMaxSize, nBlockMinSize);
-
-    // Collect memory pool transactions into the block
-    CTxMemPool::setEntries inBlock;
-    CTxMemPool::setEntries waitSet;
-
-    // This vector will be sorted into a priority queue:
-    vector<TxCoinAgePriority> vecPriority;
-    TxCoinAgePriorityCompare pricomparer;
-    std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash> waitPriMap;
-    typedef std::map<CTxMemPool::txiter, double, CTxMemPool::CompareIteratorByHash>::iterator waitPriIter;
-    double actualPriority = -1;
-
-    std::priority_queue<CTxMemPool::txiter, std::vector<CTxMemPool::txiter>, ScoreCompare> clearedTxs;
-    bool fPrintPriority = GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
-    uint64_t nBlockSize = 1000;
-    uint64_t nBlockTx = 0;
-    unsigned int nBlockSigOps = 100;
-    int lastFewTxs = 0;
-    CAmount nFees = 0;
-
     {
         LOCK2(cs_main, mempool.cs);
         CBlockIndex* pindexPrev = chainActive.Tip();
@@ -142,139 +398,17 @@ CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& s
                                 ? nMedianTimePast
                                 : pblock->GetBlockTime();
 
-        bool fPriorityBlock = nBlockPrioritySize > 0;
-        if (fPriorityBlock) {
-            vecPriority.reserve(mempool.mapTx.size());
-            for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
-                 mi != mempool.mapTx.end(); ++mi)
-            {
-                double dPriority = mi->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
-                vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
-            }
-            std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
+        // Collect memory pool transactions into the block
+        BlockAssembler assembler(mempool, pblocktemplate.get(), nHeight, nLockTimeCutoff);
+        if (fMempool) {
+            assembler.AddPriorityTxs();
+            assembler.AddPackageTxs();
         }
+        CAmount nFees = assembler.GetFees();
 
-        CTxMemPool::indexed_transaction_set::nth_index<3>::type::iterator mi = mempool.mapTx.get<3>().begin();
-        CTxMemPool::txiter iter;
-
-        while (mi != mempool.mapTx.get<3>().end() || !clearedTxs.empty())
-        {
-            bool priorityTx = false;
-            if (fPriorityBlock && !vecPriority.empty()) { // add a tx from priority queue to fill the blockprioritysize
-                priorityTx = true;
-                iter = vecPriority.front().second;
-                actualPriority = vecPriority.front().first;
-                std::pop_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                vecPriority.pop_back();
-            }
-            else if (clearedTxs.empty()) { // add tx with next highest score
-                iter = mempool.mapTx.project<0>(mi);
-                mi++;
-            }
-            else {  // try to add a previously postponed child tx
-                iter = clearedTxs.top();
-                clearedTxs.pop();
-            }
-
-            if (inBlock.count(iter))
-                continue; // could have been added to the priorityBlock
-
-            const CTransaction& tx = iter->GetTx();
-
-            bool fOrphan = false;
-            BOOST_FOREACH(CTxMemPool::txiter parent, mempool.GetMemPoolParents(iter))
-            {
-                if (!inBlock.count(parent)) {
-                    fOrphan = true;
-                    break;
-                }
-            }
-            if (fOrphan) {
-                if (priorityTx)
-                    waitPriMap.insert(std::make_pair(iter,actualPriority));
-                else
-                    waitSet.insert(iter);
-                continue;
-            }
-
-            unsigned int nTxSize = iter->GetTxSize();
-            if (fPriorityBlock &&
-                (nBlockSize + nTxSize >= nBlockPrioritySize || !AllowFree(actualPriority))) {
-                fPriorityBlock = false;
-                waitPriMap.clear();
-            }
-            if (!priorityTx &&
-                (iter->GetModifiedFee() < ::minRelayTxFee.GetFee(nTxSize) && nBlockSize >= nBlockMinSize)) {
-                break;
-            }
-            if (nBlockSize + nTxSize >= nBlockMaxSize) {
-                if (nBlockSize >  nBlockMaxSize - 100 || lastFewTxs > 50) {
-                    break;
-                }
-                // Once we're within 1000 bytes of a full block, only look at 50 more txs
-                // to try to fill the remaining space.
-                if (nBlockSize > nBlockMaxSize - 1000) {
-                    lastFewTxs++;
-                }
-                continue;
-            }
-
-            if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
-                continue;
-
-            unsigned int nTxSigOps = iter->GetSigOpCount();
-            if (nBlockSigOps + nTxSigOps >= MAX_BLOCK_SIGOPS) {
-                if (nBlockSigOps > MAX_BLOCK_SIGOPS - 2) {
-                    break;
-                }
-                continue;
-            }
-
-            CAmount nTxFees = iter->GetFee();
-            // Added
-            pblock->vtx.push_back(tx);
-            pblocktemplate->vTxFees.push_back(nTxFees);
-            pblocktemplate->vTxSigOps.push_back(nTxSigOps);
-            nBlockSize += nTxSize;
-            ++nBlockTx;
-            nBlockSigOps += nTxSigOps;
-            nFees += nTxFees;
-
-            if (fPrintPriority)
-            {
-                double dPriority = iter->GetPriority(nHeight);
-                CAmount dummy;
-                mempool.ApplyDeltas(tx.GetHash(), dPriority, dummy);
-                LogPrintf("priority %.1f fee %s txid %s\n",
-                          dPriority , CFeeRate(iter->GetModifiedFee(), nTxSize).ToString(), tx.GetHash().ToString());
-            }
-
-            inBlock.insert(iter);
-
-            // Add transactions that depend on this one to the priority queue
-            BOOST_FOREACH(CTxMemPool::txiter child, mempool.GetMemPoolChildren(iter))
-            {
-                if (fPriorityBlock) {
-                    waitPriIter wpiter = waitPriMap.find(child);
-                    if (wpiter != waitPriMap.end()) {
-                        vecPriority.push_back(TxCoinAgePriority(wpiter->second,child));
-                        std::push_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
-                        waitPriMap.erase(wpiter);
-                    }
-                }
-                else {
-                    if (waitSet.count(child)) {
-                        clearedTxs.push(child);
-                        waitSet.erase(child);
-                    }
-                }
-            }
-        }
-        nLastBlockTx = nBlockTx;
-        nLastBlockSize = nBlockSize;
-        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nBlockSize, nBlockTx, nFees, nBlockSigOps);
+        nLastBlockTx = assembler.GetBlockTx();
+        nLastBlockSize = assembler.GetBlockSize();
+        LogPrintf("CreateNewBlock(): total size %u txs: %u fees: %ld sigops %d\n", nLastBlockSize, nLastBlockTx, nFees, assembler.GetBlockSigOps());
 
         // Compute final coinbase transaction.
         txNew.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
@@ -322,6 +456,38 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 // Internal miner
 //
 
+static CCriticalSection cs_hashmeter;
+static double dHashesPerSec = 0;
+static int64_t nHashMeterStart = 0;
+static uint64_t nHashMeterCount = 0;
+
+/** Account for hashes tried by a miner thread, and refresh the hash rate every few seconds. */
+static void UpdateHashMeter(uint64_t nHashes)
+{
+    LOCK(cs_hashmeter);
+    int64_t nNow = GetTimeMillis();
+    nHashMeterCount += nHashes;
+    if (nNow - nHashMeterStart >= 4000) {
+        dHashesPerSec = 1000.0 * nHashMeterCount / (nNow - nHashMeterStart);
+        nHashMeterStart = nNow;
+        nHashMeterCount = 0;
+    }
+}
+
+static void ResetHashMeter()
+{
+    LOCK(cs_hashmeter);
+    dHashesPerSec = 0;
+    nHashMeterStart = GetTimeMillis();
+    nHashMeterCount = 0;
+}
+
+double GetHashesPerSec()
+{
+    LOCK(cs_hashmeter);
+    return dHashesPerSec;
+}
+
 //
 // ScanHash scans nonces looking for a hash with at least some zero bits.
 // The nonce is usually preserved between calls, but periodically or if the
@@ -330,29 +496,22 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
 //
 bool static ScanHash(const CBlockHeader *pblock, uint32_t& nNonce, uint256 *phash) // ڿ㷨
 {
-    // Write the first 76 bytes of the block header to a double-SHA256 state.
-    CHash256 hasher;
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
     ss << *pblock;
     assert(ss.size() == 80); // BlockHeader Size: 80 Bytes
-    hasher.Write((unsigned char*)&ss[0], 76); // дǰ 5 ֶΣnVersionhashPrevBlockhashMerkleRootnTimenBitsһֶ nNonce Ϊ
-
-    while (true) {
-        nNonce++;
-
-        // Write the last 4 bytes of the block header (the nonce) to a copy of
-        // the double-SHA256 state, and compute the result.
-        CHash256(hasher).Write((unsigned char*)&nNonce, 4).Finalize((unsigned char*)phash);
 
-        // Return the nonce if the hash has at least some zero bits,
-        // caller will check if it has enough to reach the target
-        if (((uint16_t*)phash)[15] == 0) //  32 ֽڣһԪأ2 ֽڣΪ 0 16 λΪ 0򷵻
-            return true;
-
-        // If nothing found after trying for a while, return -1
-        if ((nNonce & 0xfff) == 0)
-            return false;
-    }
+    // Try the nonces up to the next multiple of 0x1000. The scanner keeps the
+    // midstate of the first 64 bytes and tests several nonces at once.
+    uint32_t nCount = 0x1000 - (nNonce & 0xfff);
+    nNonce++;
+    if (!SHA256D80Scan((unsigned char*)&ss[0], nNonce, nCount))
+        return false;
+
+    // Return the nonce if the hash has at least some zero bits,
+    // caller will check if it has enough to reach the target
+    WriteLE32((unsigned char*)&ss[76], nNonce);
+    CHash256().Write((unsigned char*)&ss[0], 80).Finalize((unsigned char*)phash);
+    return true;
 }
 
 static bool ProcessBlockFound(const CBlock* pblock, const CChainParams& chainparams)
@@ -469,7 +628,10 @@ void static CrowcoinMiner(const CChainParams& chainparams)
             uint32_t nNonce = 0;
             while (true) {
                 // Check if something found
-                if (ScanHash(pblock, nNonce, &hash)) // ڿhash  16 λΪ 0 
+                uint32_t nOldNonce = nNonce;
+                bool fFound = ScanHash(pblock, nNonce, &hash);
+                UpdateHashMeter(nNonce - nOldNonce);
+                if (fFound) // ڿhash  16 λΪ 0 
                 {
 					LogPrintf("Search now\n");
                     if (UintToArith256(hash) <= hashTarget) // תΪСģʽѶĿֵȽϣжǷΪϸĿ
@@ -542,6 +704,7 @@ void GenerateCrowcoins(bool fGenerate, int nThreads, const CChainParams& chainpa
         delete minerThreads;
         minerThreads = NULL;
     }
+    ResetHashMeter();
 
     if (nThreads == 0 || !fGenerate)
         return;
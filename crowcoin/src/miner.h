@@ -7,9 +7,13 @@
 #define CROWCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "txmempool.h"
 
 #include <stdint.h>
 
+#include "boost/multi_index_container.hpp"
+#include "boost/multi_index/ordered_index.hpp"
+
 /** Search the genesis block */
 void getGenesisBlock(CBlock *pblock);
 
@@ -32,12 +36,145 @@ struct CBlockTemplate
     std::vector<int64_t> vTxSigOps;
 };
 
+/** A mempool entry whose package is smaller than in the mempool, as some of its ancestors are in the block already */
+struct CTxMemPoolModifiedEntry
+{
+    CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
+    {
+        iter = entry;
+        nSizeWithAncestors = entry->GetSizeWithAncestors();
+        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
+        nSigOpCountWithAncestors = entry->GetSigOpCountWithAncestors();
+    }
+
+    CTxMemPool::txiter iter;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    unsigned int nSigOpCountWithAncestors;
+};
+
+struct CompareCTxMemPoolIter
+{
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        return &(*a) < &(*b);
+    }
+};
+
+struct modifiedentry_iter
+{
+    typedef CTxMemPool::txiter result_type;
+    result_type operator() (const CTxMemPoolModifiedEntry& entry) const
+    {
+        return entry.iter;
+    }
+};
+
+// The same order as CompareTxMemPoolEntryByAncestorFee, on the modified packages
+struct CompareModifiedEntry
+{
+    bool operator()(const CTxMemPoolModifiedEntry& a, const CTxMemPoolModifiedEntry& b) const
+    {
+        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
+        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        if (f1 == f2) {
+            return a.iter->GetTx().GetHash() < b.iter->GetTx().GetHash();
+        }
+        return f1 > f2;
+    }
+};
+
+// A transaction has more ancestors than any of its ancestors, so this is a
+// valid order to put a package in the block.
+struct CompareTxIterByAncestorCount
+{
+    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
+    {
+        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
+            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+        return CTxMemPool::CompareIteratorByHash()(a, b);
+    }
+};
+
+typedef boost::multi_index_container<
+    CTxMemPoolModifiedEntry,
+    boost::multi_index::indexed_by<
+        // sorted by mempool entry
+        boost::multi_index::ordered_unique<
+            modifiedentry_iter,
+            CompareCTxMemPoolIter
+        >,
+        // sorted by modified fee rate with ancestors
+        boost::multi_index::ordered_non_unique<
+            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
+            CompareModifiedEntry
+        >
+    >
+> indexed_modified_transaction_set;
+
+typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
+typedef indexed_modified_transaction_set::nth_index<1>::type::iterator modtxscoreiter;
+
+/** Collects mempool transactions into a block template. Requires pool.cs. */
+class BlockAssembler
+{
+private:
+    CTxMemPool& pool;
+    CBlockTemplate* pblocktemplate;
+    CBlock* pblock;
+
+    // Limits, from the command line
+    unsigned int nBlockMaxSize;
+    unsigned int nBlockPrioritySize;
+    unsigned int nBlockMinSize;
+    bool fPrintPriority;
+
+    // Chain context for the block
+    const int nHeight;
+    const int64_t nLockTimeCutoff;
+
+    // What is in the block so far
+    CTxMemPool::setEntries inBlock;
+    uint64_t nBlockSize;
+    uint64_t nBlockTx;
+    unsigned int nBlockSigOps;
+    CAmount nFees;
+
+    int lastFewTxs;
+    bool blockFinished;
+
+    void AddToBlock(CTxMemPool::txiter iter);
+    bool IsStillDependent(CTxMemPool::txiter iter) const;
+    /** Test whether a transaction fits in the block; sets blockFinished once nothing more can */
+    bool TestForBlock(CTxMemPool::txiter iter);
+    /** Test whether a package of this size and sig op count fits in the block */
+    bool TestPackage(uint64_t packageSize, unsigned int packageSigOps) const;
+    bool TestPackageFinality(const CTxMemPool::setEntries& package) const;
+    /** Add the descendants of newly added transactions to mapModifiedTx, or update them there */
+    void UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set& mapModifiedTx) const;
+
+public:
+    BlockAssembler(CTxMemPool& poolIn, CBlockTemplate* pblocktemplateIn, int nHeightIn, int64_t nLockTimeCutoffIn);
+
+    /** Fill the priority part of the block, by coin age priority */
+    void AddPriorityTxs();
+    /** Fill the rest of the block by the fee rate of packages */
+    void AddPackageTxs();
+
+    uint64_t GetBlockSize() const { return nBlockSize; }
+    uint64_t GetBlockTx() const { return nBlockTx; }
+    unsigned int GetBlockSigOps() const { return nBlockSigOps; }
+    CAmount GetFees() const { return nFees; }
+};
+
 /** Run the miner threads */
 void GenerateCrowcoins(bool fGenerate, int nThreads, const CChainParams& chainparams);
-/** Generate a new block, without valid proof-of-work */
-CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn);
+/** Generate a new block, without valid proof-of-work, and without mempool transactions unless fMempool */
+CBlockTemplate* CreateNewBlock(const CChainParams& chainparams, const CScript& scriptPubKeyIn, bool fMempool = true);
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
+/** Get the recent hash rate of the internal miner threads, in hashes per second */
+double GetHashesPerSec();
 
 #endif // CROWCOIN_MINER_H
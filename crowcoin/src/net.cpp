@@ -89,8 +89,8 @@ std::string strSubVersion;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
-deque<pair<int64_t, CInv> > vRelayExpiration;
+map<uint256, CTransactionRef> mapRelay;
+deque<pair<int64_t, uint256> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64_t> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -750,12 +750,12 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 // requires LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
+    std::deque<CSendBuffer>::iterator it = pnode->vSendMsg.begin();
 
     while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+        const CSendBuffer &data = *it;
         assert(data.size() > pnode->nSendOffset);
-        int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+        int nBytes = send(pnode->hSocket, data.begin() + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
@@ -2048,16 +2048,9 @@ instance_of_cnetcleanup;
 
 
 
-void RelayTransaction(const CTransaction& tx)
-{
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
-    ss << tx;
-    RelayTransaction(tx, ss);
-}
-
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
+void RelayTransaction(const CTransactionRef& ptx)
 {
+    const CTransaction& tx = *ptx;
     CInv inv(MSG_TX, tx.GetHash());
     {
         LOCK(cs_mapRelay);
@@ -2068,9 +2061,9 @@ void RelayTransaction(const CTransaction& tx, const CDataStream& ss)
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        // Shares the transaction with the mempool rather than keeping a serialized copy
+        mapRelay.insert(std::make_pair(inv.hash, ptx));
+        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv.hash));
     }
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
@@ -2491,8 +2484,8 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
 
     LogPrint("net", "(%d bytes) peer=%d\n", nSize, id);
 
-    std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-    ssSend.GetAndClear(*it);
+    std::deque<CSendBuffer>::iterator it = vSendMsg.insert(vSendMsg.end(), CSendBuffer());
+    ssSend.GetAndClear(it->data);
     nSendSize += (*it).size();
 
     // If write queue empty, attempt "optimistic write"
@@ -2502,6 +2495,30 @@ void CNode::EndMessage() UNLOCK_FUNCTION(cs_vSend)
     LEAVE_CRITICAL_SECTION(cs_vSend);
 }
 
+void CNode::PushRawMessage(const char* pszCommand, const CBlockFileView& payload)
+{
+    assert(payload.size() > 0);
+    uint256 hash = Hash(payload.begin(), payload.end());
+
+    LOCK(cs_vSend);
+    assert(ssSend.size() == 0);
+    CMessageHeader hdr(Params().MessageStart(), pszCommand, payload.size());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    ssSend << hdr;
+    LogPrint("net", "sending: %s (%d bytes) peer=%d\n", SanitizeString(pszCommand), payload.size(), id);
+
+    // Only the header is copied; the payload is sent from where it is.
+    bool fEmpty = vSendMsg.empty();
+    vSendMsg.push_back(CSendBuffer());
+    ssSend.GetAndClear(vSendMsg.back().data);
+    vSendMsg.push_back(CSendBuffer(payload));
+    nSendSize += CMessageHeader::HEADER_SIZE + payload.size();
+
+    // If write queue empty, attempt "optimistic write"
+    if (fEmpty)
+        SocketSendData(this);
+}
+
 //
 // CBanDB
 //
@@ -6,10 +6,12 @@
 #ifndef CROWCOIN_NET_H
 #define CROWCOIN_NET_H
 
+#include "blockfilemap.h"
 #include "bloom.h"
 #include "compat.h"
 #include "limitedmap.h"
 #include "netbase.h"
+#include "primitives/transaction.h"
 #include "protocol.h"
 #include "random.h"
 #include "streams.h"
@@ -161,8 +163,8 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
-extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
+extern std::map<uint256, CTransactionRef> mapRelay;
+extern std::deque<std::pair<int64_t, uint256> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64_t> mapAlreadyAskedFor;
 
@@ -310,6 +312,23 @@ public:
 
 typedef std::map<CSubNet, CBanEntry> banmap_t;
 
+/**
+ * Bytes queued for sending to a peer. Usually they are owned, but a block
+ * can be sent straight from the block file it is stored in.
+ */
+class CSendBuffer
+{
+public:
+    CSerializeData data;
+    CBlockFileView view;
+
+    CSendBuffer() {}
+    explicit CSendBuffer(const CBlockFileView& viewIn) : view(viewIn) {}
+
+    const char* begin() const { return view.IsNull() ? &data[0] : view.begin(); }
+    size_t size() const { return view.IsNull() ? data.size() : view.size(); }
+};
+
 /** Information about a peer */
 class CNode
 {
@@ -321,7 +340,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSendBuffer> vSendMsg;
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
@@ -530,6 +549,12 @@ public:
     // TODO: Document the precondition of this function.  Is cs_vSend locked?
     void EndMessage() UNLOCK_FUNCTION(cs_vSend);
 
+    /**
+     * Send a message whose payload are the bytes of a block file view, e.g.
+     * a block as stored on disk. They are queued without being copied.
+     */
+    void PushRawMessage(const char* pszCommand, const CBlockFileView& payload);
+
     void PushVersion();
 
 
@@ -760,9 +785,8 @@ public:
 
 
 
-class CTransaction;
-void RelayTransaction(const CTransaction& tx);
-void RelayTransaction(const CTransaction& tx, const CDataStream& ss);
+/** Announce a transaction to peers, and keep it around for 15 minutes for them to fetch. */
+void RelayTransaction(const CTransactionRef& ptx);
 
 /** Access to the (IP) address database (peers.dat) */
 class CAddrDB
@@ -11,6 +11,9 @@
 #include "serialize.h"
 #include "uint256.h"
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
 /** An outpoint - a combination of a transaction hash and an index n into its vout */
 class COutPoint
 {
@@ -311,4 +314,12 @@ struct CMutableTransaction
     uint256 GetHash() const;
 };
 
+/**
+ * A transaction shared between the mempool, the relay map, the orphan pool
+ * and whoever else holds on to it, instead of each having its own copy.
+ */
+typedef boost::shared_ptr<const CTransaction> CTransactionRef;
+static inline CTransactionRef MakeTransactionRef() { return boost::make_shared<const CTransaction>(); }
+template <typename Tx> static inline CTransactionRef MakeTransactionRef(const Tx& txIn) { return boost::make_shared<const CTransaction>(txIn); }
+
 #endif // CROWCOIN_PRIMITIVES_TRANSACTION_H
@@ -3,6 +3,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
@@ -64,6 +65,7 @@ extern UniValue mempoolInfoToJSON();
 extern UniValue mempoolToJSON(bool fVerbose = false);
 extern void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 extern UniValue blockheaderToJSON(const CBlockIndex* blockindex);
+extern UniValue addressHistoryToJSON(const std::vector<CAddressIndexEntry>& vEntries, const CBlockIndex* pindexIndexed);
 
 static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message)
 {
@@ -214,6 +216,7 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    CBlockFileView view;
     CBlockIndex* pblockindex = NULL;
     {
         LOCK(cs_main);
@@ -224,23 +227,24 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        // Binary and hex output are the block as it is stored on disk.
+        if (rf == RF_BINARY || rf == RF_HEX) {
+            if (!ReadRawBlockFromDisk(view, pblockindex, Params().MessageStart()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        } else if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-    ssBlock << block;
-
     switch (rf) {
     case RF_BINARY: {
-        string binaryBlock = ssBlock.str();
+        string binaryBlock(view.begin(), view.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        string strHex = HexStr(view.begin(), view.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -512,21 +516,14 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
             view.SetBackend(viewMempool); // switch cache backend to db+mempool in case user likes to query mempool
 
         for (size_t i = 0; i < vOutPoints.size(); i++) {
-            CCoins coins;
-            uint256 hash = vOutPoints[i].hash;
-            if (view.GetCoins(hash, coins)) {
-                mempool.pruneSpent(hash, coins);
-                if (coins.IsAvailable(vOutPoints[i].n)) {
-                    hits[i] = true;
-                    // Safe to index into vout here because IsAvailable checked if it's off the end of the array, or if
-                    // n is valid but points to an already spent output (IsNull).
-                    CCoin coin;
-                    coin.nTxVer = coins.nVersion;
-                    coin.nHeight = coins.nHeight;
-                    coin.out = coins.vout.at(vOutPoints[i].n);
-                    assert(!coin.out.IsNull());
-                    outs.push_back(coin);
-                }
+            Coin coin;
+            if (view.GetCoin(vOutPoints[i], coin) && !mempool.isSpent(vOutPoints[i])) {
+                hits[i] = true;
+                CCoin out;
+                out.nTxVer = coin.nVersion;
+                out.nHeight = coin.nHeight;
+                out.out = coin.out;
+                outs.push_back(out);
             }
 
             bitmapStringRepresentation.append(hits[i] ? "1" : "0"); // form a binary string representation (human-readable for json output)
@@ -596,6 +593,69 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+static bool rest_addresshistory(HTTPRequest* req, const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    if (!paddressindexer)
+        return RESTERR(req, HTTP_NOT_FOUND, "Address index not enabled (use -addressindex)");
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() != 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use /rest/addresshistory/<count>/<skip>/<address or script>.<ext>.");
+
+    long count = strtol(path[0].c_str(), NULL, 10);
+    if (count < 1 || count > (long)MAX_ADDRESS_HISTORY_ENTRIES)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Entry count out of range: " + path[0]);
+    long skip = strtol(path[1].c_str(), NULL, 10);
+    if (skip < 0)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Skip out of range: " + path[1]);
+    CScript scriptPubKey;
+    if (!ParseAddressIndexScript(path[2], scriptPubKey))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address or script: " + path[2]);
+
+    const CBlockIndex* pindexIndexed = paddressindexer->GetBestBlock();
+    std::vector<CAddressIndexEntry> vEntries;
+    if (!paddressindexer->ReadHistory(scriptPubKey, skip, count, vEntries))
+        return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR, "Failed to read the address index");
+
+    switch (rf) {
+    case RF_BINARY: {
+        CDataStream ssHistory(SER_NETWORK, PROTOCOL_VERSION);
+        ssHistory << (pindexIndexed ? pindexIndexed->nHeight : -1) << (pindexIndexed ? pindexIndexed->GetBlockHash() : uint256()) << vEntries;
+        string binaryHistory = ssHistory.str();
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, binaryHistory);
+        return true;
+    }
+
+    case RF_HEX: {
+        CDataStream ssHistory(SER_NETWORK, PROTOCOL_VERSION);
+        ssHistory << (pindexIndexed ? pindexIndexed->nHeight : -1) << (pindexIndexed ? pindexIndexed->GetBlockHash() : uint256()) << vEntries;
+        string strHex = HexStr(ssHistory.begin(), ssHistory.end()) + "\n";
+        req->WriteHeader("Content-Type", "text/plain");
+        req->WriteReply(HTTP_OK, strHex);
+        return true;
+    }
+
+    case RF_JSON: {
+        string strJSON = addressHistoryToJSON(vEntries, pindexIndexed).write() + "\n";
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, strJSON);
+        return true;
+    }
+    default: {
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+    }
+    }
+
+    // not reached
+    return true; // continue to process further HTTP reqs on this cxn
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
@@ -608,6 +668,7 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/addresshistory/", rest_addresshistory},
 };
 
 bool StartREST()
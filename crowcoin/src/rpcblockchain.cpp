@@ -3,11 +3,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "amount.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "coins.h"
+#include "coinsflusher.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "policy/policy.h"
@@ -23,6 +25,8 @@
 
 #include <univalue.h>
 
+#include <boost/filesystem.hpp>
+
 using namespace std;
 
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
@@ -414,17 +418,19 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
-
     if (!fVerbose)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        // The block is stored the way it is serialized, so pass on its bytes.
+        CBlockFileView view;
+        if (!ReadRawBlockFromDisk(view, pblockindex, Params().MessageStart()))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+        std::string strHex = HexStr(view.begin(), view.end());
         return strHex;
     }
 
+    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
     return blockToJSON(block, pblockindex);
 }
 
@@ -434,7 +440,8 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
         throw runtime_error(
             "gettxoutsetinfo\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "These are kept up to date as blocks are connected, so this call only writes out\n"
+            "the changes to the set since it was last flushed to disk.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -442,7 +449,7 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
             "  \"transactions\": n,      (numeric) The number of transactions\n"
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
-            "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"hash_serialized\": \"hash\",   (string) The MuHash3072 hash of the set\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
             "\nExamples:\n"
@@ -466,6 +473,99 @@ UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
     return ret;
 }
 
+UniValue getcoinscacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "\nReturns usage statistics of the in-memory unspent transaction output cache.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": n,            (numeric) Number of cached transactions\n"
+            "  \"usage\": n,              (numeric) Memory usage of the cache in bytes\n"
+            "  \"limit\": n,              (numeric) Maximum memory usage of the cache in bytes (-dbcache)\n"
+            "  \"dirty_usage\": n,        (numeric) Memory used by entries not written to disk yet, in bytes\n"
+            "  \"hits\": n,               (numeric) Lookups answered from the cache\n"
+            "  \"misses\": n,             (numeric) Lookups that had to read from disk\n"
+            "  \"hit_rate\": x.xxx,       (numeric) Share of lookups answered from the cache\n"
+            "  \"flushes\": n,            (numeric) Number of times the cache was written to disk\n"
+            "  \"last_flush_written\": n, (numeric) Transactions written by the last flush\n"
+            "  \"last_flush_evicted\": n, (numeric) Transactions evicted from the cache by the last flush\n"
+            "  \"last_flush_time\": ttt,  (numeric) The time of the last flush in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"last_flush_duration\": x.xxx, (numeric) How long the last flush held up validation, in milliseconds\n"
+            "  \"last_write_duration\": x.xxx  (numeric) How long writing the last flush to disk took, in milliseconds\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcoinscacheinfo", "")
+            + HelpExampleRpc("getcoinscacheinfo", "")
+        );
+
+    LOCK(cs_main);
+    CCoinsCacheStats stats = pcoinsTip->GetCacheStats();
+    uint64_t nLookups = stats.nHits + stats.nMisses;
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("entries", (int64_t)pcoinsTip->GetCacheSize()));
+    ret.push_back(Pair("usage", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    ret.push_back(Pair("limit", (int64_t)nCoinCacheUsage));
+    ret.push_back(Pair("dirty_usage", (int64_t)stats.nDirtyUsage));
+    ret.push_back(Pair("hits", (int64_t)stats.nHits));
+    ret.push_back(Pair("misses", (int64_t)stats.nMisses));
+    ret.push_back(Pair("hit_rate", nLookups ? (double)stats.nHits / nLookups : 0.0));
+    ret.push_back(Pair("flushes", (int64_t)stats.nSyncs));
+    ret.push_back(Pair("last_flush_written", (int64_t)stats.nLastSyncWritten));
+    ret.push_back(Pair("last_flush_evicted", (int64_t)stats.nLastTrimEvicted));
+    ret.push_back(Pair("last_flush_time", nLastCoinsFlushTime));
+    ret.push_back(Pair("last_flush_duration", nLastCoinsFlushDuration * 0.001));
+    if (pcoinsFlusher)
+        ret.push_back(Pair("last_write_duration", pcoinsFlusher->GetLastWriteDuration() * 0.001));
+    return ret;
+}
+
+UniValue dumptxoutset(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "dumptxoutset \"path\"\n"
+            "\nWrites the unspent transaction output set as of the current tip to a file, which\n"
+            "another node can start from with -loadtxoutset.\n"
+            "Note this call may take some time.\n"
+            "\nArguments:\n"
+            "1. \"path\"    (string, required) The file to write, relative to the data directory if not absolute\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"base_hash\": \"hash\",    (string) the hash of the block the set was taken at\n"
+            "  \"base_height\": n,       (numeric) the height of that block\n"
+            "  \"transactions\": n,      (numeric) The number of transactions\n"
+            "  \"txouts\": n,            (numeric) The number of unspent outputs\n"
+            "  \"checksum\": \"hash\",     (string) The checksum of the file\n"
+            "  \"path\": \"path\"          (string) The absolute path of the file\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("dumptxoutset", "\"utxo.dat\"")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+        );
+
+    boost::filesystem::path path(params[0].get_str());
+    if (!path.is_complete())
+        path = GetDataDir() / path;
+    if (boost::filesystem::exists(path))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+
+    CTxOutSetSnapshot snapshot;
+    if (!DumpTxOutSet(path, snapshot))
+        throw JSONRPCError(RPC_MISC_ERROR, "Failed to write UTXO set snapshot");
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("base_hash", snapshot.hashBlock.GetHex()));
+    ret.push_back(Pair("base_height", snapshot.nHeight));
+    ret.push_back(Pair("transactions", (int64_t)snapshot.nTransactions));
+    ret.push_back(Pair("txouts", (int64_t)snapshot.nTransactionOutputs));
+    ret.push_back(Pair("checksum", snapshot.hashChecksum.GetHex()));
+    ret.push_back(Pair("path", path.string()));
+    return ret;
+}
+
 UniValue gettxout(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
@@ -515,37 +615,119 @@ UniValue gettxout(const UniValue& params, bool fHelp)
     if (params.size() > 2)
         fMempool = params[2].get_bool();
 
-    CCoins coins;
+    if (n < 0)
+        return NullUniValue;
+    COutPoint out(hash, n);
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out))
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin))
             return NullUniValue;
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if ((unsigned int)coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue)));
+        ret.push_back(Pair("confirmations", pindex->nHeight - coin.nHeight + 1));
+    ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue)));
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("version", coin.nVersion));
+    ret.push_back(Pair("coinbase", coin.fCoinBase));
 
     return ret;
 }
 
+UniValue addressHistoryToJSON(const std::vector<CAddressIndexEntry>& vEntries, const CBlockIndex* pindexIndexed)
+{
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("height", pindexIndexed ? pindexIndexed->nHeight : -1));
+    ret.push_back(Pair("bestblock", pindexIndexed ? pindexIndexed->GetBlockHash().GetHex() : uint256().GetHex()));
+    UniValue entries(UniValue::VARR);
+    BOOST_FOREACH(const CAddressIndexEntry& entry, vEntries) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("txid", entry.first.txid.GetHex()));
+        obj.push_back(Pair("height", entry.first.nHeight));
+        obj.push_back(Pair(entry.first.fSpending ? "vin" : "vout", (int64_t)entry.first.nIndex));
+        obj.push_back(Pair("spending", entry.first.fSpending));
+        obj.push_back(Pair("value", ValueFromAmount(entry.second.nValue)));
+        if (entry.first.fSpending) {
+            obj.push_back(Pair("prevtxid", entry.second.prevout.hash.GetHex()));
+            obj.push_back(Pair("prevvout", (int64_t)entry.second.prevout.n));
+        }
+        entries.push_back(obj);
+    }
+    ret.push_back(Pair("entries", entries));
+    return ret;
+}
+
+UniValue getaddresshistory(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 3)
+        throw runtime_error(
+            "getaddresshistory \"address\" ( count skip )\n"
+            "\nReturns the outputs paying to an address, and the inputs spending them, oldest first.\n"
+            "Requires -addressindex. The index is built in the background, up to the height returned.\n"
+            "\nArguments:\n"
+            "1. \"address\"   (string, required) The crowcoin address, or a hex-encoded scriptPubKey\n"
+            "2. count       (numeric, optional, default=100) The most entries to return, at most " + strprintf("%u", MAX_ADDRESS_HISTORY_ENTRIES) + "\n"
+            "3. skip        (numeric, optional, default=0) The number of entries to skip\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\" : n,            (numeric) The height the index has been built up to\n"
+            "  \"bestblock\" : \"hash\",   (string) The hash of the block at that height\n"
+            "  \"entries\" : [\n"
+            "    {\n"
+            "      \"txid\" : \"id\",       (string) The transaction id\n"
+            "      \"height\" : n,        (numeric) The height of the block it is in\n"
+            "      \"vout\" : n,          (numeric) The output paying to the address (funding entries)\n"
+            "      \"vin\" : n,           (numeric) The input spending from the address (spending entries)\n"
+            "      \"spending\" : true|false, (boolean) Whether this is a spending entry\n"
+            "      \"value\" : x.xxx,     (numeric) The value of the output in " + CURRENCY_UNIT + "\n"
+            "      \"prevtxid\" : \"id\",   (string) The transaction id of the output spent (spending entries)\n"
+            "      \"prevvout\" : n       (numeric) The index of the output spent (spending entries)\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresshistory", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\" 100 200")
+            + HelpExampleRpc("getaddresshistory", "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\", 100, 200")
+        );
+
+    if (!paddressindexer)
+        throw JSONRPCError(RPC_MISC_ERROR, "The address index is not enabled (use -addressindex)");
+
+    CScript scriptPubKey;
+    if (!ParseAddressIndexScript(params[0].get_str(), scriptPubKey))
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address or script");
+    int nCount = 100;
+    if (params.size() > 1)
+        nCount = params[1].get_int();
+    if (nCount < 0 || nCount > (int)MAX_ADDRESS_HISTORY_ENTRIES)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Count out of range");
+    int nSkip = 0;
+    if (params.size() > 2)
+        nSkip = params[2].get_int();
+    if (nSkip < 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative skip");
+
+    // Read the height first: the entries are at least as recent
+    const CBlockIndex* pindexIndexed = paddressindexer->GetBestBlock();
+    std::vector<CAddressIndexEntry> vEntries;
+    if (!paddressindexer->ReadHistory(scriptPubKey, nSkip, nCount, vEntries))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to read the address index");
+    return addressHistoryToJSON(vEntries, pindexIndexed);
+}
+
 UniValue verifychain(const UniValue& params, bool fHelp)
 {
     int nCheckLevel = GetArg("-checklevel", DEFAULT_CHECKLEVEL);
@@ -571,7 +753,7 @@ UniValue verifychain(const UniValue& params, bool fHelp)
     if (params.size() > 1)
         nCheckDepth = params[1].get_int();
 
-    return CVerifyDB().VerifyDB(Params(), pcoinsTip, nCheckLevel, nCheckDepth);
+    return CVerifyDB().VerifyDB(Params(), pcoinsTip, nCheckLevel, nCheckDepth, GetArg("-checkthreads", DEFAULT_CHECK_THREADS));
 }
 
 /** Implementation of IsSuperMajority with better feedback */
@@ -836,6 +1018,25 @@ UniValue getmempoolinfo(const UniValue& params, bool fHelp)
     return mempoolInfoToJSON();
 }
 
+UniValue savemempool(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "savemempool\n"
+            "\nDumps the mempool to disk, as it is on shutdown, for the next start to load.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("savemempool", "")
+            + HelpExampleRpc("savemempool", "")
+        );
+
+    if (!mempool.IsLoaded())
+        throw JSONRPCError(RPC_MISC_ERROR, "The mempool was not loaded yet");
+    if (!DumpMempool())
+        throw JSONRPCError(RPC_MISC_ERROR, "Unable to dump mempool to disk");
+
+    return NullUniValue;
+}
+
 UniValue invalidateblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -92,6 +92,8 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "importpubkey", 2 },
     { "verifychain", 0 },
     { "verifychain", 1 },
+    { "getaddresshistory", 1 },
+    { "getaddresshistory", 2 },
     { "keypoolrefill", 0 },
     { "getrawmempool", 0 },
     { "estimatefee", 0 },
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "amount.h"
+#include "blocktemplate.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "consensus/consensus.h"
@@ -241,6 +242,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
             "  \"errors\": \"...\"          (string) Current errors\n"
             "  \"generate\": true|false     (boolean) If the generation is on or off (see getgenerate or setgenerate calls)\n"
             "  \"genproclimit\": n          (numeric) The processor limit for generation. -1 if no generation. (see getgenerate or setgenerate calls)\n"
+            "  \"hashespersec\": n          (numeric) The recent hashes per second of the internal miner. 0 if no generation. (see getgenerate or setgenerate calls)\n"
             "  \"pooledtx\": n              (numeric) The size of the mem pool\n"
             "  \"testnet\": true|false      (boolean) If using testnet or not\n"
             "  \"chain\": \"xxxx\",         (string) current network name as defined in BIP70 (main, test, regtest)\n"
@@ -260,6 +262,7 @@ UniValue getmininginfo(const UniValue& params, bool fHelp)
     obj.push_back(Pair("difficulty",       (double)GetDifficulty()));
     obj.push_back(Pair("errors",           GetWarnings("statusbar")));
     obj.push_back(Pair("genproclimit",     (int)GetArg("-genproclimit", DEFAULT_GENERATE_THREADS)));
+    obj.push_back(Pair("hashespersec",     (int64_t)GetHashesPerSec()));
     obj.push_back(Pair("networkhashps",    getnetworkhashps(params, false)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("testnet",          Params().TestnetToBeDeprecatedFieldRPC()));
@@ -441,6 +444,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Crowcoin is downloading blocks...");
 
     static unsigned int nTransactionsUpdatedLast;
+    static CAmount nTemplateFeesLast;
 
     if (!lpval.isNull())
     {
@@ -448,24 +452,46 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         uint256 hashWatchedChain;
         boost::system_time checktxtime;
         unsigned int nTransactionsUpdatedLastLP;
+        CAmount nFeesLastLP;
 
         if (lpval.isStr())
         {
-            // Format: <hashBestChain><nTransactionsUpdatedLast>
+            // Format: <hashBestChain><nTransactionsUpdatedLast>, or <hashBestChain><nTemplateFeesLast>
+            // with the background builder
             std::string lpstr = lpval.get_str();
 
             hashWatchedChain.SetHex(lpstr.substr(0, 64));
             nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            nFeesLastLP = atoi64(lpstr.substr(64));
         }
         else
         {
             // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
             hashWatchedChain = chainActive.Tip()->GetBlockHash();
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            nFeesLastLP = nTemplateFeesLast;
         }
 
         // Release the wallet and main lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
+        if (pblocktemplatebuilder)
+        {
+            // With the background builder the longpollid carries the template's fees:
+            // wait for a template on a new tip, or one paying enough more, or, after
+            // a minute, one paying anything more. A new tip ends the wait even without
+            // a template on it, in case the builder fails to make one.
+            const int64_t nAnyChangeTime = GetTime() + 60;
+            while (IsRPCRunning())
+            {
+                CAmount nFeesMin = nFeesLastLP + (GetTime() < nAnyChangeTime ? pblocktemplatebuilder->GetFeeDelta() : 1);
+                if (pblocktemplatebuilder->WaitForChange(hashWatchedChain, nFeesMin, 1000))
+                    break;
+                boost::unique_lock<boost::mutex> lock(csBestBlock);
+                if (chainActive.Tip()->GetBlockHash() != hashWatchedChain)
+                    break;
+            }
+        }
+        else
         {
             checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
 
@@ -492,8 +518,18 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static CBlockTemplate* pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
+    boost::shared_ptr<const CBlockTemplate> pbuilt;
+    if (pblocktemplatebuilder)
+        pbuilt = pblocktemplatebuilder->GetTemplate(chainActive.Tip());
+    if (pbuilt)
+    {
+        // The background builder has a template ready on the tip
+        delete pblocktemplate;
+        pblocktemplate = new CBlockTemplate(*pbuilt);
+        pindexPrev = chainActive.Tip();
+    }
+    else if (pindexPrev != chainActive.Tip() ||
+        (!pblocktemplatebuilder && mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
         // Clear pindexPrev so future calls make a new block, despite any failures from here on
         pindexPrev = NULL;
@@ -510,7 +546,8 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
             pblocktemplate = NULL;
         }
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = CreateNewBlock(Params(), scriptDummy);
+        // The background builder follows up with the mempool transactions
+        pblocktemplate = CreateNewBlock(Params(), scriptDummy, !pblocktemplatebuilder);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -518,6 +555,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
         pindexPrev = pindexPrevNew;
     }
     CBlock* pblock = &pblocktemplate->block; // pointer for convenience
+    nTemplateFeesLast = -pblocktemplate->vTxFees[0];
 
     // Update nTime
     UpdateTime(pblock, Params().GetConsensus(), pindexPrev);
@@ -576,7 +614,7 @@ UniValue getblocktemplate(const UniValue& params, bool fHelp)
     result.push_back(Pair("transactions", transactions));
     result.push_back(Pair("coinbaseaux", aux));
     result.push_back(Pair("coinbasevalue", (int64_t)pblock->vtx[0].vout[0].nValue));
-    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)));
+    result.push_back(Pair("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(pblocktemplatebuilder ? nTemplateFeesLast : nTransactionsUpdatedLast)));
     result.push_back(Pair("target", hashTarget.GetHex()));
     result.push_back(Pair("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1));
     result.push_back(Pair("mutable", aMutable));
@@ -366,6 +366,41 @@ UniValue verifymessage(const UniValue& params, bool fHelp)
     return (pubkey.GetID() == keyID);
 }
 
+UniValue getmemoryinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "Returns an object containing information about memory usage.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blockindex\": {\n"
+            "    \"entries\": xxxxx,        (numeric) the number of blocks and headers in the block index\n"
+            "    \"usage\": xxxxx,          (numeric) memory used by the block index, in bytes\n"
+            "    \"unpooled\": xxxxx,       (numeric) estimated memory the block index would use with every entry allocated separately, in bytes\n"
+            "    \"saved\": xxxxx           (numeric) the difference between the two, in bytes\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmemoryinfo", "")
+            + HelpExampleRpc("getmemoryinfo", "")
+        );
+
+    LOCK(cs_main);
+
+    UniValue blockindex(UniValue::VOBJ);
+    const int64_t nUsage = mapBlockIndex.DynamicMemoryUsage();
+    const int64_t nUnpooled = mapBlockIndex.UnpooledMemoryUsage();
+    blockindex.push_back(Pair("entries", (int64_t)mapBlockIndex.size()));
+    blockindex.push_back(Pair("usage", nUsage));
+    blockindex.push_back(Pair("unpooled", nUnpooled));
+    blockindex.push_back(Pair("saved", nUnpooled - nUsage));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blockindex", blockindex));
+    return obj;
+}
+
 UniValue setmocktime(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
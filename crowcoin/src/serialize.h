@@ -20,6 +20,9 @@
 #include <utility>
 #include <vector>
 
+#include <boost/make_shared.hpp>
+#include <boost/shared_ptr.hpp>
+
 #include "prevector.h"
 
 static const unsigned int MAX_SIZE = 0x02000000;
@@ -540,6 +543,13 @@ template<typename K, typename Pred, typename A> unsigned int GetSerializeSize(co
 template<typename Stream, typename K, typename Pred, typename A> void Serialize(Stream& os, const std::set<K, Pred, A>& m, int nType, int nVersion);
 template<typename Stream, typename K, typename Pred, typename A> void Unserialize(Stream& is, std::set<K, Pred, A>& m, int nType, int nVersion);
 
+/**
+ * shared_ptr
+ */
+template<typename T> unsigned int GetSerializeSize(const boost::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Serialize(Stream& os, const boost::shared_ptr<const T>& p, int nType, int nVersion);
+template<typename Stream, typename T> void Unserialize(Stream& is, boost::shared_ptr<const T>& p, int nType, int nVersion);
+
 
 
 
@@ -877,6 +887,32 @@ void Unserialize(Stream& is, std::set<K, Pred, A>& m, int nType, int nVersion)
 
 
 
+/**
+ * shared_ptr
+ */
+template<typename T>
+unsigned int GetSerializeSize(const boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    return GetSerializeSize(*p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Serialize(Stream& os, const boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    Serialize(os, *p, nType, nVersion);
+}
+
+template<typename Stream, typename T>
+void Unserialize(Stream& is, boost::shared_ptr<const T>& p, int nType, int nVersion)
+{
+    // Read into a new object, so that others sharing the old one don't see it change
+    boost::shared_ptr<T> pNew = boost::make_shared<T>();
+    Unserialize(is, *pNew, nType, nVersion);
+    p = pNew;
+}
+
+
+
 /**
  * Support for ADD_SERIALIZE_METHODS and READWRITE macro
  */
@@ -441,6 +441,56 @@ public:
     }
 };
 
+/** Stream that deserializes from a range of memory it does not own, such as
+ *  part of a memory-mapped file, without copying it first.
+ */
+class CMemoryReader
+{
+private:
+    int nType;
+    int nVersion;
+
+    const char* pcur;
+    const char* pend;
+
+public:
+    CMemoryReader(const char* pbegin, const char* pendIn, int nTypeIn, int nVersionIn) :
+        nType(nTypeIn), nVersion(nVersionIn), pcur(pbegin), pend(pendIn) {}
+
+    //
+    // Stream subset
+    //
+    int GetType()                { return nType; }
+    int GetVersion()             { return nVersion; }
+    size_t size() const          { return pend - pcur; }
+    bool empty() const           { return pcur == pend; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::read(): end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSize)
+    {
+        if (nSize > size())
+            throw std::ios_base::failure("CMemoryReader::ignore(): end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Non-refcounted RAII wrapper around a FILE* that implements a ring buffer to
  *  deserialize from. It guarantees the ability to rewind a given number of bytes.
  *
@@ -0,0 +1,113 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "main.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "streams.h"
+
+#include "test/test_crowcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(addressindex_key_order)
+{
+    // Entries for a script sort by height, also across byte boundaries
+    uint160 hashScript;
+    CDataStream ss1(SER_DISK, CLIENT_VERSION), ss2(SER_DISK, CLIENT_VERSION);
+    ss1 << CAddressIndexKey(hashScript, 255, uint256S("ff"), 0, false);
+    ss2 << CAddressIndexKey(hashScript, 256, uint256S("01"), 0, false);
+    BOOST_CHECK(ss1.str() < ss2.str());
+
+    CAddressIndexKey key;
+    ss2 >> key;
+    BOOST_CHECK_EQUAL(key.nHeight, 256);
+    BOOST_CHECK(key.txid == uint256S("01"));
+}
+
+BOOST_AUTO_TEST_CASE(addressindex_history)
+{
+    CAddressIndexer indexer(Params(), 1 << 20, true);
+    indexer.Start();
+    BOOST_CHECK(indexer.WaitForSync(10000));
+
+    // Every block's coinbase pays to the same key
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<CAddressIndexEntry> vEntries;
+    BOOST_CHECK(indexer.ReadHistory(scriptPubKey, 0, 1000, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 100U);
+    for (unsigned int i = 0; i < vEntries.size(); i++) {
+        BOOST_CHECK_EQUAL(vEntries[i].first.nHeight, (int)i + 1);
+        BOOST_CHECK(vEntries[i].first.txid == coinbaseTxns[i].GetHash());
+        BOOST_CHECK(!vEntries[i].first.fSpending);
+        BOOST_CHECK_EQUAL(vEntries[i].second.nValue, coinbaseTxns[i].vout[0].nValue);
+    }
+
+    // Pages
+    vEntries.clear();
+    BOOST_CHECK(indexer.ReadHistory(scriptPubKey, 95, 10, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 5U);
+    BOOST_CHECK(vEntries[0].first.txid == coinbaseTxns[95].GetHash());
+
+    // Spend a coinbase to another key
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptDest = GetScriptForDestination(key.GetPubKey().GetID());
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptDest;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(1, spend), scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(indexer.WaitForSync(10000));
+
+    vEntries.clear();
+    BOOST_CHECK(indexer.ReadHistory(scriptDest, 0, 1000, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 1U);
+    BOOST_CHECK(vEntries[0].first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(vEntries[0].first.nHeight, 101);
+    BOOST_CHECK_EQUAL(vEntries[0].second.nValue, 11 * CENT);
+
+    // The spending entry goes after the funding one at height 1, before the rest
+    vEntries.clear();
+    BOOST_CHECK(indexer.ReadHistory(scriptPubKey, 0, 1000, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 102U);
+    BOOST_CHECK(vEntries[100].first.fSpending ^ vEntries[101].first.fSpending);
+    const CAddressIndexEntry& entry = vEntries[100].first.fSpending ? vEntries[100] : vEntries[101];
+    BOOST_CHECK(entry.first.txid == spend.GetHash());
+    BOOST_CHECK_EQUAL(entry.first.nHeight, 101);
+    BOOST_CHECK(entry.second.prevout == spend.vin[0].prevout);
+    BOOST_CHECK_EQUAL(entry.second.nValue, coinbaseTxns[0].vout[0].nValue);
+
+    // Disconnecting the block removes its entries
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params().GetConsensus(), chainActive.Tip()));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+    BOOST_CHECK(indexer.WaitForSync(10000));
+    vEntries.clear();
+    BOOST_CHECK(indexer.ReadHistory(scriptDest, 0, 1000, vEntries));
+    BOOST_CHECK(vEntries.empty());
+    BOOST_CHECK(indexer.ReadHistory(scriptPubKey, 0, 1000, vEntries));
+    BOOST_CHECK_EQUAL(vEntries.size(), 100U);
+
+    indexer.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
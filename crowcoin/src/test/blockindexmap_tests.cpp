@@ -0,0 +1,74 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexmap.h"
+#include "random.h"
+
+#include "test/test_crowcoin.h"
+
+#include <map>
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexmap_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockindexmap_basics)
+{
+    CBlockIndexMap map;
+    std::map<uint256, CBlockIndex*> mapExpected;
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.begin() == map.end());
+
+    // Enough entries for several chunks and rehashes
+    for (int i = 0; i < 5000; i++) {
+        uint256 hash = GetRandHash();
+        CBlockIndex index;
+        index.nHeight = i;
+        std::pair<CBlockIndexMap::iterator, bool> ret = map.emplace(hash, index);
+        BOOST_CHECK(ret.second);
+        BOOST_CHECK(ret.first->first == hash);
+        BOOST_CHECK(ret.first->second->phashBlock == &ret.first->first);
+        BOOST_CHECK_EQUAL(ret.first->second->nHeight, i);
+        mapExpected[hash] = ret.first->second;
+    }
+    BOOST_CHECK_EQUAL(map.size(), mapExpected.size());
+
+    // Entries keep their address, and adding one twice returns the first
+    for (std::map<uint256, CBlockIndex*>::const_iterator it = mapExpected.begin(); it != mapExpected.end(); it++) {
+        BOOST_CHECK(map.find(it->first) != map.end());
+        BOOST_CHECK(map.find(it->first)->second == it->second);
+        BOOST_CHECK(map[it->first] == it->second);
+        BOOST_CHECK_EQUAL(map.count(it->first), 1U);
+        std::pair<CBlockIndexMap::iterator, bool> ret = map.emplace(it->first);
+        BOOST_CHECK(!ret.second);
+        BOOST_CHECK(ret.first->second == it->second);
+    }
+    BOOST_CHECK_EQUAL(map.size(), mapExpected.size());
+
+    // Missing entries aren't found, nor added by operator[]
+    uint256 hashMissing = GetRandHash();
+    BOOST_CHECK(map.find(hashMissing) == map.end());
+    BOOST_CHECK_EQUAL(map.count(hashMissing), 0U);
+    BOOST_CHECK(map[hashMissing] == NULL);
+    BOOST_CHECK_EQUAL(map.size(), mapExpected.size());
+
+    // Iteration visits every entry once, in the order they were added
+    int nHeight = 0;
+    BOOST_FOREACH(const CBlockIndexMap::value_type& item, map) {
+        BOOST_CHECK(mapExpected[item.first] == item.second);
+        BOOST_CHECK_EQUAL(item.second->nHeight, nHeight++);
+    }
+    BOOST_CHECK_EQUAL(nHeight, 5000);
+
+    BOOST_CHECK(map.DynamicMemoryUsage() < map.UnpooledMemoryUsage());
+
+    map.clear();
+    BOOST_CHECK(map.empty());
+    BOOST_CHECK(map.find(mapExpected.begin()->first) == map.end());
+    BOOST_CHECK(map.emplace(hashMissing).second);
+    BOOST_CHECK_EQUAL(map.size(), 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
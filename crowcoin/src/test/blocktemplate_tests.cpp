@@ -0,0 +1,74 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blocktemplate.h"
+#include "chainparams.h"
+#include "key.h"
+#include "main.h"
+#include "miner.h"
+#include "script/sign.h"
+#include "txmempool.h"
+
+#include "test/test_crowcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktemplate_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blocktemplate_builder)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Let the first coinbase mature
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    CBlockTemplateBuilder builder(Params(), 50000);
+    BOOST_CHECK(!builder.GetTemplate(chainActive.Tip()));
+    builder.Start();
+
+    // A template on the tip, with the (empty) mempool
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+    BOOST_CHECK(builder.WaitForChange(uint256(), 0, 10000));
+    BOOST_CHECK(builder.WaitForChange(hashTip, 0, 10000));
+    boost::shared_ptr<const CBlockTemplate> ptemplate = builder.GetTemplate(chainActive.Tip());
+    BOOST_REQUIRE(ptemplate);
+    BOOST_CHECK(ptemplate->block.hashPrevBlock == hashTip);
+    BOOST_CHECK_EQUAL(ptemplate->block.vtx.size(), 1);
+
+    // Picks up transactions added to the mempool
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = coinbaseTxns[0].vout[0].nValue - 100000;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    {
+        LOCK(mempool.cs);
+        TestMemPoolEntryHelper entry;
+        mempool.addUnchecked(tx.GetHash(), entry.Fee(100000).FromTx(tx));
+    }
+    BOOST_CHECK(builder.WaitForChange(hashTip, 100000, 10000));
+    ptemplate = builder.GetTemplate(chainActive.Tip());
+    BOOST_REQUIRE(ptemplate);
+    BOOST_REQUIRE_EQUAL(ptemplate->block.vtx.size(), 2);
+    BOOST_CHECK(ptemplate->block.vtx[1].GetHash() == tx.GetHash());
+    BOOST_CHECK_EQUAL(ptemplate->vTxFees[0], -100000);
+
+    // Moves on to a new tip
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(1, tx), scriptPubKey);
+    BOOST_CHECK(builder.WaitForChange(hashTip, MAX_MONEY, 10000));
+    ptemplate = builder.GetTemplate(chainActive.Tip());
+    BOOST_REQUIRE(ptemplate);
+    BOOST_CHECK(ptemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK(!builder.GetTemplate(chainActive.Tip()->pprev));
+
+    builder.Stop();
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+
+#include "test/test_crowcoin.h"
+
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+/** A check that counts how often it ran and fails on demand. */
+struct CountingCheck
+{
+    volatile unsigned int* pnCount;
+    bool fResult;
+
+    CountingCheck() : pnCount(NULL), fResult(true) {}
+    CountingCheck(volatile unsigned int* pnCountIn, bool fResultIn) : pnCount(pnCountIn), fResult(fResultIn) {}
+
+    bool operator()()
+    {
+        if (pnCount)
+            __sync_fetch_and_add(pnCount, 1);
+        return fResult;
+    }
+
+    void swap(CountingCheck& check)
+    {
+        std::swap(pnCount, check.pnCount);
+        std::swap(fResult, check.fResult);
+    }
+};
+
+static void RunChecks(CCheckQueue<CountingCheck>& queue, bool fFail, volatile unsigned int* pnCount)
+{
+    CCheckQueueControl<CountingCheck> control(&queue);
+    // Batches of various sizes, like the inputs of a block's transactions.
+    for (unsigned int i = 0; i < 1000; i++) {
+        std::vector<CountingCheck> vChecks;
+        for (unsigned int j = 0; j < 1 + i % 7; j++)
+            vChecks.push_back(CountingCheck(pnCount, !(fFail && i == 500 && j == 0)));
+        control.Add(vChecks);
+    }
+    BOOST_CHECK_EQUAL(control.Wait(), !fFail);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_results)
+{
+    const int nThreads[] = {0, 1, 3, 15};
+    for (unsigned int t = 0; t < sizeof(nThreads) / sizeof(nThreads[0]); t++) {
+        CCheckQueue<CountingCheck> queue(16, 8);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads[t]; i++)
+            threads.create_thread(boost::bind(&CCheckQueue<CountingCheck>::Thread, &queue));
+
+        // Every check runs exactly once when all of them succeed.
+        volatile unsigned int nCount = 0;
+        RunChecks(queue, false, &nCount);
+        BOOST_CHECK_EQUAL(nCount, 3997U);
+        BOOST_CHECK(queue.IsIdle());
+
+        // A failure is reported, and does not leak into the next round.
+        RunChecks(queue, true, &nCount);
+        BOOST_CHECK(queue.IsIdle());
+        nCount = 0;
+        RunChecks(queue, false, &nCount);
+        BOOST_CHECK_EQUAL(nCount, 3997U);
+
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
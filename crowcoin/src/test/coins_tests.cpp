@@ -3,43 +3,48 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "coinsflusher.h"
+#include "coinsprefetch.h"
 #include "random.h"
 #include "uint256.h"
 #include "test/test_crowcoin.h"
+#include "txdb.h"
 #include "main.h"
 #include "consensus/validation.h"
 
 #include <vector>
 #include <map>
 
+#include <boost/bind.hpp>
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 namespace
 {
 class CCoinsViewTest : public CCoinsView
 {
     uint256 hashBestBlock_;
-    std::map<uint256, CCoins> map_;
+    std::map<COutPoint, Coin> map_;
 
 public:
-    bool GetCoins(const uint256& txid, CCoins& coins) const
+    bool GetCoin(const COutPoint& outpoint, Coin& coin) const
     {
-        std::map<uint256, CCoins>::const_iterator it = map_.find(txid);
+        std::map<COutPoint, Coin>::const_iterator it = map_.find(outpoint);
         if (it == map_.end()) {
             return false;
         }
-        coins = it->second;
-        if (coins.IsPruned() && insecure_rand() % 2 == 0) {
+        coin = it->second;
+        if (coin.IsSpent() && insecure_rand() % 2 == 0) {
             // Randomly return false in case of an empty entry.
             return false;
         }
         return true;
     }
 
-    bool HaveCoins(const uint256& txid) const
+    bool HaveCoin(const COutPoint& outpoint) const
     {
-        CCoins coins;
-        return GetCoins(txid, coins);
+        Coin coin;
+        return GetCoin(outpoint, coin) && !coin.IsSpent();
     }
 
     uint256 GetBestBlock() const { return hashBestBlock_; }
@@ -49,8 +54,8 @@ public:
         for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); ) {
             if (it->second.flags & CCoinsCacheEntry::DIRTY) {
                 // Same optimization used in CCoinsViewDB is to only write dirty entries.
-                map_[it->first] = it->second.coins;
-                if (it->second.coins.IsPruned() && insecure_rand() % 3 == 0) {
+                map_[it->first] = it->second.coin;
+                if (it->second.coin.IsSpent() && insecure_rand() % 3 == 0) {
                     // Randomly delete empty entries on write.
                     map_.erase(it->first);
                 }
@@ -65,6 +70,18 @@ public:
     bool GetStats(CCoinsStats& stats) const { return false; }
 };
 
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    // Write coins the way chainstates before per-output records did.
+    void WriteOldFormat(const uint256& txid, const CCoins& coins) { db.Write(std::make_pair('c', txid), coins); }
+    bool HaveOldFormat(const uint256& txid) { return db.Exists(std::make_pair('c', txid)); }
+    // Recompute the running totals from scratch.
+    bool RecomputeTotals() { return ComputeTotals(); }
+};
+
 class CCoinsViewCacheTest : public CCoinsViewCache
 {
 public:
@@ -74,12 +91,18 @@ public:
     {
         // Manually recompute the dynamic usage of the whole data, and compare it.
         size_t ret = memusage::DynamicUsage(cacheCoins);
+        size_t dirty = 0;
         for (CCoinsMap::iterator it = cacheCoins.begin(); it != cacheCoins.end(); it++) {
-            ret += it->second.coins.DynamicMemoryUsage();
+            ret += it->second.coin.DynamicMemoryUsage();
+            if (it->second.flags & CCoinsCacheEntry::DIRTY)
+                dirty += it->second.coin.DynamicMemoryUsage();
         }
         BOOST_CHECK_EQUAL(DynamicMemoryUsage(), ret);
+        BOOST_CHECK_EQUAL(GetCacheStats().nDirtyUsage, dirty);
     }
 
+    bool IsCached(const COutPoint& outpoint) const { return cacheCoins.count(outpoint) != 0; }
+
 };
 
 }
@@ -91,9 +114,10 @@ static const unsigned int NUM_SIMULATION_ITERATIONS = 40000;
 // This is a large randomized insert/remove simulation test on a variable-size
 // stack of caches on top of CCoinsViewTest.
 //
-// It will randomly create/update/delete CCoins entries to a tip of caches, with
-// txids picked from a limited list of random 256-bit hashes. Occasionally, a
-// new tip is added to the stack of caches, or the tip is flushed and removed.
+// It will randomly create/update/delete Coin entries to a tip of caches, with
+// outpoints picked from a limited list of random 256-bit hashes and two output
+// indices each. Occasionally, a new tip is added to the stack of caches, or the
+// tip is flushed and removed.
 //
 // During the process, booleans are kept to make sure that the randomized
 // operation hits all branches.
@@ -103,13 +127,15 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     bool removed_all_caches = false;
     bool reached_4_caches = false;
     bool added_an_entry = false;
+    bool added_an_unspendable_entry = false;
     bool removed_an_entry = false;
     bool updated_an_entry = false;
     bool found_an_entry = false;
     bool missed_an_entry = false;
+    bool synced_a_cache = false;
 
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -126,37 +152,56 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS; i++) {
         // Do a random modification.
         {
-            uint256 txid = txids[insecure_rand() % txids.size()]; // txid we're going to modify in this iteration.
-            CCoins& coins = result[txid];
-            CCoinsModifier entry = stack.back()->ModifyCoins(txid);
-            BOOST_CHECK(coins == *entry);
-            if (insecure_rand() % 5 == 0 || coins.IsPruned()) {
-                if (coins.IsPruned()) {
-                    added_an_entry = true;
+            COutPoint outpoint(txids[insecure_rand() % txids.size()], insecure_rand() % 2); // outpoint we're going to modify in this iteration.
+            Coin& coin = result[outpoint];
+            BOOST_CHECK(coin == stack.back()->AccessCoin(outpoint));
+            if (insecure_rand() % 500 == 0) {
+                // Any unspent output of the transaction will do.
+                const Coin& any = AccessByTxid(*stack.back(), outpoint.hash);
+                BOOST_CHECK(any == result[COutPoint(outpoint.hash, 0)] || any == result[COutPoint(outpoint.hash, 1)]);
+            }
+            if (insecure_rand() % 5 == 0 || coin.IsSpent()) {
+                bool fWasSpent = coin.IsSpent();
+                Coin newcoin;
+                newcoin.out.nValue = insecure_rand();
+                newcoin.nHeight = 1;
+                newcoin.nVersion = insecure_rand();
+                if (insecure_rand() % 16 == 0 && fWasSpent) {
+                    newcoin.out.scriptPubKey.assign(1 + (insecure_rand() & 0x3F), OP_RETURN);
+                    BOOST_CHECK(newcoin.out.scriptPubKey.IsUnspendable());
+                    added_an_unspendable_entry = true;
                 } else {
-                    updated_an_entry = true;
+                    // Random sizes so we test the memory usage accounting.
+                    newcoin.out.scriptPubKey.assign(insecure_rand() & 0x3F, 0);
+                    if (fWasSpent) {
+                        added_an_entry = true;
+                    } else {
+                        updated_an_entry = true;
+                    }
+                    coin = newcoin;
                 }
-                coins.nVersion = insecure_rand();
-                coins.vout.resize(1);
-                coins.vout[0].nValue = insecure_rand();
-                *entry = coins;
+                stack.back()->AddCoin(outpoint, newcoin, !fWasSpent || insecure_rand() % 2);
             } else {
-                coins.Clear();
-                entry->Clear();
+                Coin spent;
+                BOOST_CHECK(stack.back()->SpendCoin(outpoint, &spent));
+                BOOST_CHECK(spent == coin);
+                coin.Clear();
                 removed_an_entry = true;
             }
         }
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                    found_an_entry = true;
-                } else {
-                    BOOST_CHECK(it->second.IsPruned());
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                bool fHave = stack.back()->HaveCoin(it->first);
+                const Coin& coin = stack.back()->AccessCoin(it->first);
+                BOOST_CHECK(fHave == !coin.IsSpent());
+                BOOST_CHECK(coin == it->second);
+                if (coin.IsSpent()) {
                     missed_an_entry = true;
+                } else {
+                    BOOST_CHECK(stack.back()->HaveCoinInCache(it->first));
+                    found_an_entry = true;
                 }
             }
             BOOST_FOREACH(const CCoinsViewCacheTest *test, stack) {
@@ -168,7 +213,14 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
             // Every 100 iterations, flush an intermediate cache
             if (stack.size() > 1 && insecure_rand() % 2 == 0) {
                 unsigned int flushIndex = insecure_rand() % (stack.size() - 1);
-                stack[flushIndex]->Flush();
+                if (insecure_rand() % 2 == 0) {
+                    stack[flushIndex]->Flush();
+                } else {
+                    // Write it out, but keep (some of) its entries.
+                    stack[flushIndex]->Sync();
+                    stack[flushIndex]->Trim(stack[flushIndex]->DynamicMemoryUsage() / 2);
+                    synced_a_cache = true;
+                }
             }
         }
         if (insecure_rand() % 100 == 0) {
@@ -205,10 +257,65 @@ BOOST_AUTO_TEST_CASE(coins_cache_simulation_test)
     BOOST_CHECK(removed_all_caches);
     BOOST_CHECK(reached_4_caches);
     BOOST_CHECK(added_an_entry);
+    BOOST_CHECK(added_an_unspendable_entry);
     BOOST_CHECK(removed_an_entry);
     BOOST_CHECK(updated_an_entry);
     BOOST_CHECK(found_an_entry);
     BOOST_CHECK(missed_an_entry);
+    BOOST_CHECK(synced_a_cache);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_sync_trim_test)
+{
+    // Sync() writes the modified entries and keeps all of them cached but
+    // unmodified; Trim() then evicts the ones used longest ago first.
+    CCoinsViewTest base;
+    CCoinsViewCacheTest cache(&base);
+    CScript script = CScript() << std::vector<unsigned char>(40, 1);
+    std::vector<COutPoint> outpoints;
+    for (unsigned int i = 0; i < 200; i++) {
+        outpoints.push_back(COutPoint(GetRandHash(), 0));
+        cache.AddCoin(outpoints.back(), Coin(CTxOut(i, script), 1, false, 1), false);
+    }
+    BOOST_CHECK(cache.GetCacheStats().nDirtyUsage > 0);
+    BOOST_CHECK(cache.Sync());
+    cache.SelfTest();
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 200U);
+    BOOST_CHECK_EQUAL(cache.GetCacheStats().nDirtyUsage, 0U);
+    BOOST_CHECK_EQUAL(cache.GetCacheStats().nLastSyncWritten, 200U);
+
+    // Everything is still answered from the cache, and is on disk too.
+    uint64_t nMisses = cache.GetCacheStats().nMisses;
+    for (unsigned int i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK(cache.HaveCoin(outpoints[i]));
+        BOOST_CHECK(base.GetCoin(outpoints[i], coin));
+        BOOST_CHECK_EQUAL(coin.out.nValue, (CAmount)i);
+    }
+    BOOST_CHECK_EQUAL(cache.GetCacheStats().nMisses, nMisses);
+
+    // Use the second half again in a later epoch, and modify one entry.
+    BOOST_CHECK(cache.Sync());
+    for (unsigned int i = 100; i < outpoints.size(); i++)
+        cache.AccessCoin(outpoints[i]);
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    cache.AddCoin(outpoints[0], Coin(CTxOut(1000, script), 1, false, 1), false);
+
+    // Trimming a quarter off drops just the (unmodified) entries from the first half.
+    BOOST_CHECK_EQUAL(cache.Trim(cache.DynamicMemoryUsage() * 3 / 4), 99U);
+    cache.SelfTest();
+    BOOST_CHECK(cache.IsCached(outpoints[0]));
+    for (unsigned int i = 1; i < outpoints.size(); i++)
+        BOOST_CHECK_EQUAL(cache.IsCached(outpoints[i]), i >= 100);
+
+    // Nothing left to evict.
+    BOOST_CHECK_EQUAL(cache.Trim(0), 100U);
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 1U);
+    BOOST_CHECK_EQUAL(cache.Trim(0), 0U);
+    BOOST_CHECK(cache.Sync());
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoints[0], coin));
+    BOOST_CHECK_EQUAL(coin.out.nValue, 1000);
 }
 
 // This test is similar to the previous test
@@ -220,7 +327,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 {
     bool spent_a_duplicate_coinbase = false;
     // A simple map to track what we expect the cache stack to represent.
-    std::map<uint256, CCoins> result;
+    std::map<COutPoint, Coin> result;
 
     // The cache stack.
     CCoinsViewTest base; // A CCoinsViewTest at the bottom.
@@ -273,8 +380,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
                 tx.vin[0].prevout.n = 0;
 
                 // Update the expected result of prevouthash to know these coins are spent
-                CCoins& oldcoins = result[prevouthash];
-                oldcoins.Clear();
+                result[tx.vin[0].prevout].Clear();
 
                 // It is of particular importance here that once we spend a coinbase tx hash
                 // it is no longer available to be duplicated (or spent again)
@@ -294,8 +400,7 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
             alltxids.insert(tx.GetHash());
 
             // Update the expected result to know about the new output coins
-            CCoins &coins = result[tx.GetHash()];
-            coins.FromTx(tx, height);
+            result[COutPoint(tx.GetHash(), 0)] = Coin(tx.vout[0], height, CTransaction(tx).IsCoinBase(), tx.nVersion);
 
             CValidationState dummy;
             UpdateCoins(tx, dummy, *(stack.back()), height);
@@ -303,13 +408,8 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
 
         // Once every 1000 iterations and at the end, verify the full cache.
         if (insecure_rand() % 1000 == 1 || i == NUM_SIMULATION_ITERATIONS - 1) {
-            for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
-                const CCoins* coins = stack.back()->AccessCoins(it->first);
-                if (coins) {
-                    BOOST_CHECK(*coins == it->second);
-                 } else {
-                    BOOST_CHECK(it->second.IsPruned());
-                 }
+            for (std::map<COutPoint, Coin>::iterator it = result.begin(); it != result.end(); it++) {
+                BOOST_CHECK(stack.back()->AccessCoin(it->first) == it->second);
             }
         }
 
@@ -347,4 +447,249 @@ BOOST_AUTO_TEST_CASE(updatecoins_simulation_test)
     BOOST_CHECK(spent_a_duplicate_coinbase);
 }
 
+BOOST_AUTO_TEST_CASE(coins_prefetch_test)
+{
+    // Prefetched coins must read the same as going to the backing view
+    // directly, whether a worker got to them, is busy with them, or not.
+    CCoinsViewTest base;
+    std::vector<COutPoint> outpoints;
+    {
+        CCoinsViewCacheTest stack(&base);
+        for (unsigned int i = 0; i < 2000; i++) {
+            outpoints.push_back(COutPoint(GetRandHash(), i % 5));
+            if (i % 3 == 0)
+                continue; // leave some of them missing
+            stack.AddCoin(outpoints.back(), Coin(CTxOut(i, CScript() << OP_TRUE), i, false, 1), false);
+        }
+        stack.SetBestBlock(GetRandHash());
+        stack.Flush();
+    }
+
+    CCoinsViewPrefetch prefetch(&base);
+    boost::thread_group threads;
+    for (int i = 0; i < 4; i++)
+        threads.create_thread(boost::bind(&CCoinsViewPrefetch::Thread, &prefetch));
+
+    for (int round = 0; round < 4; round++) {
+        prefetch.Prefetch(outpoints);
+        for (unsigned int i = 0; i < outpoints.size(); i++) {
+            Coin coin, expected;
+            bool fExpected = base.GetCoin(outpoints[i], expected);
+            BOOST_CHECK_EQUAL(prefetch.HaveCoin(outpoints[i]), fExpected);
+            BOOST_CHECK_EQUAL(prefetch.GetCoin(outpoints[i], coin), fExpected);
+            BOOST_CHECK(coin == expected);
+        }
+        // Half a batch left behind is dropped by the next one.
+        std::vector<COutPoint> vHalf(outpoints.begin(), outpoints.begin() + outpoints.size() / 2);
+        prefetch.Prefetch(vHalf);
+    }
+    prefetch.Clear();
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+BOOST_AUTO_TEST_CASE(coins_flusher_test)
+{
+    // Coins handed to the flusher must read the same while they are being
+    // written as afterwards, with or without a writer thread.
+    for (int nThreads = 0; nThreads <= 1; nThreads++) {
+        CCoinsViewTest base;
+        CCoinsViewFlusher flusher(&base);
+        boost::thread_group threads;
+        if (nThreads)
+            threads.create_thread(boost::bind(&CCoinsViewFlusher::Thread, &flusher));
+
+        CCoinsViewCacheTest cache(&flusher);
+        std::vector<COutPoint> outpoints;
+        for (int round = 0; round < 10; round++) {
+            for (unsigned int i = 0; i < 100; i++) {
+                outpoints.push_back(COutPoint(GetRandHash(), i % 3));
+                cache.AddCoin(outpoints.back(), Coin(CTxOut(outpoints.size(), CScript()), 1, false, 1), false);
+            }
+            // Spend one from the first round.
+            BOOST_CHECK(cache.SpendCoin(outpoints[round]));
+            uint256 hashBlock = GetRandHash();
+            cache.SetBestBlock(hashBlock);
+            BOOST_CHECK(cache.Sync());
+            BOOST_CHECK(cache.Trim(0) > 0);
+
+            BOOST_CHECK(flusher.GetBestBlock() == hashBlock);
+            for (unsigned int i = outpoints.size() - 100; i < outpoints.size(); i++) {
+                if (i == (unsigned int)round)
+                    continue;
+                Coin coin;
+                BOOST_CHECK(flusher.GetCoin(outpoints[i], coin));
+                BOOST_CHECK_EQUAL(coin.out.nValue, (CAmount)(i + 1));
+            }
+            Coin spent;
+            BOOST_CHECK(!flusher.GetCoin(outpoints[round], spent) || spent.IsSpent());
+            BOOST_CHECK(!flusher.HaveCoin(outpoints[round]));
+
+            BOOST_CHECK(flusher.Wait());
+            BOOST_CHECK(base.GetBestBlock() == hashBlock);
+            Coin coin;
+            BOOST_CHECK(base.GetCoin(outpoints.back(), coin));
+            BOOST_CHECK(!base.GetCoin(outpoints[round], coin) || coin.IsSpent());
+        }
+
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+namespace
+{
+class CCoinsViewFailingTest : public CCoinsViewTest
+{
+public:
+    bool BatchWrite(CCoinsMap& mapCoins, const uint256& hashBlock) { return false; }
+};
+}
+
+BOOST_AUTO_TEST_CASE(coins_flusher_failure_test)
+{
+    // After a failed write the database still has coins the caches above
+    // already saw spent; those must not come back through the flusher.
+    CCoinsViewFailingTest base;
+    COutPoint outpoint(GetRandHash(), 0);
+    {
+        CCoinsMap mapCoins;
+        CCoinsCacheEntry& entry = mapCoins[outpoint];
+        entry.coin = Coin(CTxOut(1, CScript()), 1, false, 1);
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        BOOST_CHECK(base.CCoinsViewTest::BatchWrite(mapCoins, uint256()));
+    }
+
+    CCoinsViewFlusher flusher(&base);
+    CCoinsViewCacheTest cache(&flusher);
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    uint256 hashBlock = GetRandHash();
+    cache.SetBestBlock(hashBlock);
+    BOOST_CHECK(!cache.Sync());
+    BOOST_CHECK(!flusher.Wait());
+
+    Coin coin;
+    BOOST_CHECK(base.GetCoin(outpoint, coin) && !coin.IsSpent());
+    BOOST_CHECK(!flusher.GetCoin(outpoint, coin));
+    BOOST_CHECK(!flusher.HaveCoin(outpoint));
+    BOOST_CHECK(flusher.GetBestBlock() == hashBlock);
+
+    // Nothing more is accepted.
+    CCoinsMap mapCoins;
+    BOOST_CHECK(!flusher.BatchWrite(mapCoins, GetRandHash()));
+}
+
+BOOST_FIXTURE_TEST_CASE(coins_db_test, TestingSetup)
+{
+    // Outputs must read back from the database as written, however many of
+    // their transaction's other outputs got spent (or came back) in between,
+    // and after upgrading from records per transaction. Some transactions
+    // have enough outputs for the indices' VARINTs to stop sorting in order.
+    CCoinsViewDBTest db;
+    std::map<uint256, CCoins> created;
+    std::map<uint256, CCoins> result;
+    for (int round = 0; round < 20; round++) {
+        CCoinsViewCache cache(&db);
+        for (int i = 0; i < 20; i++) {
+            uint256 txid = GetRandHash();
+            CCoins& coins = created[txid];
+            coins.nVersion = 1 + insecure_rand() % 2;
+            coins.nHeight = insecure_rand() % 1000;
+            coins.fCoinBase = insecure_rand() % 2;
+            coins.vout.resize(round < 2 && i == 0 ? 16600 : 1 + insecure_rand() % 200);
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                coins.vout[n].nValue = insecure_rand();
+                coins.vout[n].scriptPubKey = CScript() << OP_TRUE << n;
+            }
+            result[txid] = coins;
+            if (round % 2) {
+                for (unsigned int n = 0; n < coins.vout.size(); n++)
+                    cache.AddCoin(COutPoint(txid, n), Coin(coins.vout[n], coins.nHeight, coins.fCoinBase, coins.nVersion), false);
+            } else {
+                db.WriteOldFormat(txid, coins);
+            }
+        }
+        BOOST_CHECK(db.Upgrade());
+        for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+            BOOST_CHECK(!db.HaveOldFormat(it->first));
+            const CCoins& coins = created[it->first];
+            switch (insecure_rand() % 8) {
+            case 0:
+                // Spend all of them.
+                for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                    BOOST_CHECK_EQUAL(cache.SpendCoin(COutPoint(it->first, n)), it->second.IsAvailable(n));
+                    it->second.Spend(n);
+                }
+                break;
+            case 1:
+                // Bring back some spent ones, the way undoing a block does.
+                for (int i = 0; i < 5; i++) {
+                    unsigned int n = insecure_rand() % coins.vout.size();
+                    if (it->second.IsAvailable(n))
+                        continue;
+                    cache.AddCoin(COutPoint(it->first, n), Coin(coins.vout[n], coins.nHeight, coins.fCoinBase, coins.nVersion), true);
+                    if (it->second.vout.size() <= n)
+                        it->second.vout.resize(n + 1);
+                    it->second.vout[n] = coins.vout[n];
+                }
+                break;
+            case 2:
+            case 3:
+                // Spend some.
+                for (int i = 0; i < 5; i++) {
+                    unsigned int n = insecure_rand() % coins.vout.size();
+                    const Coin& coin = cache.AccessCoin(COutPoint(it->first, n));
+                    BOOST_CHECK_EQUAL(coin.IsSpent(), !it->second.IsAvailable(n));
+                    if (!coin.IsSpent())
+                        BOOST_CHECK(coin == Coin(coins.vout[n], coins.nHeight, coins.fCoinBase, coins.nVersion));
+                    BOOST_CHECK_EQUAL(cache.SpendCoin(COutPoint(it->first, n)), it->second.IsAvailable(n));
+                    it->second.Spend(n);
+                }
+                break;
+            }
+        }
+        cache.SetBestBlock(chainActive.Tip()->GetBlockHash());
+        BOOST_CHECK(cache.Flush());
+
+        size_t nTransactions = 0;
+        size_t nOutputs = 0;
+        CAmount nTotalAmount = 0;
+        for (std::map<uint256, CCoins>::iterator it = result.begin(); it != result.end(); it++) {
+            const CCoins& coins = created[it->first];
+            for (unsigned int n = 0; n < coins.vout.size(); n++) {
+                COutPoint outpoint(it->first, n);
+                Coin coin;
+                if (!it->second.IsAvailable(n)) {
+                    BOOST_CHECK(!db.HaveCoin(outpoint));
+                    BOOST_CHECK(!db.GetCoin(outpoint, coin));
+                    continue;
+                }
+                BOOST_CHECK(db.HaveCoin(outpoint));
+                BOOST_CHECK(db.GetCoin(outpoint, coin));
+                BOOST_CHECK(coin == Coin(coins.vout[n], coins.nHeight, coins.fCoinBase, coins.nVersion));
+                nOutputs++;
+                nTotalAmount += coin.out.nValue;
+            }
+            if (!it->second.IsPruned())
+                nTransactions++;
+        }
+
+        // The running totals match the database's contents, and what a
+        // scan of it gives.
+        CCoinsStats stats;
+        BOOST_CHECK(db.GetStats(stats));
+        BOOST_CHECK_EQUAL(stats.nTransactions, nTransactions);
+        BOOST_CHECK_EQUAL(stats.nTransactionOutputs, nOutputs);
+        BOOST_CHECK_EQUAL(stats.nTotalAmount, nTotalAmount);
+        BOOST_CHECK(stats.hashBlock == chainActive.Tip()->GetBlockHash());
+        CCoinsStats statsScan;
+        BOOST_CHECK(db.RecomputeTotals());
+        BOOST_CHECK(db.GetStats(statsScan));
+        BOOST_CHECK_EQUAL(statsScan.nTransactions, stats.nTransactions);
+        BOOST_CHECK_EQUAL(statsScan.nSerializedSize, stats.nSerializedSize);
+        BOOST_CHECK(statsScan.hashSerialized == stats.hashSerialized);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
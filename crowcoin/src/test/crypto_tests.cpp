@@ -2,13 +2,17 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "crypto/common.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "crypto/muhash.h"
+#include "hash.h"
 #include "random.h"
+#include "streams.h"
 #include "utilstrencodings.h"
 #include "test/test_crowcoin.h"
 
@@ -248,4 +252,138 @@ BOOST_AUTO_TEST_CASE(hmac_sha512_testvectors) {
                    "b6022cac3c4982b10d5eeb55c3e4de15134676fb6de0446065c97440fa8c6a58");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = insecure_rand();
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+        // Hashing in place must give the same result.
+        SHA256D64(in, in, i);
+        BOOST_CHECK(memcmp(out1, in, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d80scan)
+{
+    unsigned char header[80];
+    for (int i = 0; i < 80; ++i) {
+        header[i] = insecure_rand();
+    }
+    // Compare against hashing every nonce separately, in chunks of varying size, and across the wraparound.
+    uint32_t nNonce = 0xffff0000 + insecure_rand() % 0x1000;
+    for (uint32_t nDone = 0; nDone < 0x20000; ) {
+        uint32_t nFirst = nNonce;
+        uint32_t nCount = 1 + insecure_rand() % 0x1000;
+        bool fFound = SHA256D80Scan(header, nNonce, nCount);
+        BOOST_CHECK(fFound || nNonce == nFirst + nCount - 1);
+        for (uint32_t n = nFirst; n != nNonce + 1; ++n) {
+            unsigned char hash[32];
+            WriteLE32(header + 76, n);
+            CHash256().Write(header, 80).Finalize(hash);
+            BOOST_CHECK_EQUAL(hash[30] == 0 && hash[31] == 0, fFound && n == nNonce);
+        }
+        nDone += nNonce - nFirst + 1;
+        ++nNonce;
+    }
+}
+
+static Num3072 RandomNum3072()
+{
+    unsigned char buf[Num3072::BYTE_SIZE];
+    for (size_t i = 0; i < sizeof(buf); ++i) {
+        buf[i] = insecure_rand();
+    }
+    return Num3072(buf);
+}
+
+BOOST_AUTO_TEST_CASE(num3072)
+{
+    // -1 squared is 1, which takes every carry in the reduction.
+    unsigned char buf[Num3072::BYTE_SIZE];
+    memset(buf, 0xff, sizeof(buf));
+    buf[0] = 0x9a;
+    buf[1] = 0x28;
+    buf[2] = 0xef;
+    Num3072 minusone(buf);
+    Num3072 x(minusone);
+    x.Multiply(minusone);
+    BOOST_CHECK(x == Num3072());
+
+    // 2^3072 - 1 is reduced to 1103716 on input.
+    memset(buf, 0xff, sizeof(buf));
+    Num3072 y(buf);
+    memset(buf, 0, sizeof(buf));
+    buf[0] = 0x64;
+    buf[1] = 0xd7;
+    buf[2] = 0x10;
+    BOOST_CHECK(y == Num3072(buf));
+
+    for (int i = 0; i < 10; ++i) {
+        Num3072 a = RandomNum3072(), b = RandomNum3072();
+        Num3072 c(a);
+        c.Multiply(b);
+        Num3072 d(b);
+        d.Multiply(a);
+        BOOST_CHECK(c == d);
+        c.Divide(b);
+        BOOST_CHECK(c == a);
+        unsigned char out[Num3072::BYTE_SIZE];
+        a.ToBytes(out);
+        BOOST_CHECK(Num3072(out) == a);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(muhash3072)
+{
+    const unsigned char elements[4][3] = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {0, 1, 2}};
+    unsigned char hashEmpty[32], hash1[32], hash2[32];
+    MuHash3072().Finalize(hashEmpty);
+
+    // The order of insertion does not matter, and removing undoes inserting.
+    MuHash3072 a, b;
+    a.Insert(elements[0], 3).Insert(elements[1], 3).Insert(elements[2], 3);
+    b.Insert(elements[2], 3).Insert(elements[0], 3).Insert(elements[1], 3);
+    a.Finalize(hash1);
+    b.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, 32) == 0);
+    BOOST_CHECK(memcmp(hash1, hashEmpty, 32) != 0);
+
+    b.Remove(elements[1], 3).Insert(elements[3], 3);
+    b.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, 32) != 0);
+    b.Remove(elements[3], 3).Insert(elements[1], 3);
+    b.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, 32) == 0);
+
+    MuHash3072 c;
+    c.Remove(elements[0], 3).Insert(elements[0], 3);
+    c.Finalize(hash2);
+    BOOST_CHECK(memcmp(hashEmpty, hash2, 32) == 0);
+
+    // Sets combine, and survive serialization.
+    MuHash3072 d, e;
+    d.Insert(elements[0], 3).Insert(elements[1], 3);
+    e.Insert(elements[2], 3);
+    d *= e;
+    CDataStream ss(SER_DISK, 0);
+    ss << d;
+    BOOST_CHECK_EQUAL(ss.size(), 2 * Num3072::BYTE_SIZE);
+    MuHash3072 f;
+    ss >> f;
+    f.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, 32) == 0);
+    f /= e;
+    f.Insert(elements[2], 3);
+    f.Finalize(hash2);
+    BOOST_CHECK(memcmp(hash1, hash2, 32) == 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
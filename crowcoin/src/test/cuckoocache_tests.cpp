@@ -0,0 +1,132 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "uint256.h"
+
+#include "test/test_crowcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** Test Suite for CuckooCache
+ *
+ *  1) All tests should have a deterministic result (using insecure rand
+ *  with deterministic seeds)
+ *  2) Some test methods are templated to allow for easier testing
+ *  against new versions / comparing
+ *  3) Results should be treated as a regression test, i.e., did the behavior
+ *  change significantly from what was expected. This can be OK, depending on
+ *  the nature of the change, but requires updating the tests to reflect the new
+ *  expected behavior. For example improving the hit rate may cause some tests
+ *  using BOOST_CHECK_CLOSE to fail.
+ *
+ */
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+typedef CuckooCache::cache<uint256, SignatureCacheHasher> SigCache;
+
+static void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Insert n random entries into a cache of the given size, then return the
+ * fraction of them that can still be found.
+ */
+template <typename Cache>
+double test_cache(size_t megabytes, double load)
+{
+    seed_insecure_rand(true);
+    std::vector<uint256> hashes;
+    Cache set;
+    size_t bytes = megabytes * (1 << 20);
+    set.setup_bytes(bytes);
+    uint32_t n_insert = static_cast<uint32_t>(load * (bytes / sizeof(uint256)));
+    hashes.resize(n_insert);
+    for (uint32_t i = 0; i < n_insert; ++i)
+        insecure_GetRandHash(hashes[i]);
+    for (uint32_t i = 0; i < n_insert; ++i)
+        set.insert(hashes[i]);
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < n_insert; ++i)
+        if (set.contains(hashes[i], false))
+            ++count;
+    return double(count) / double(n_insert);
+}
+
+/** Check that a freshly set-up cache never reports anything, and that inserted
+ * entries are found.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_empty_and_insert)
+{
+    seed_insecure_rand(true);
+    SigCache cc;
+    cc.setup_bytes(1 << 20);
+    uint256 v;
+    for (int x = 0; x < 100000; ++x) {
+        insecure_GetRandHash(v);
+        BOOST_CHECK(!cc.contains(v, false));
+    }
+    for (int x = 0; x < 1000; ++x) {
+        insecure_GetRandHash(v);
+        cc.insert(v);
+        BOOST_CHECK(cc.contains(v, false));
+    }
+}
+
+/** At up to 90% load nearly everything inserted must still be present, and an
+ * overfilled cache keeps a sensible fraction of its entries.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate_ok)
+{
+    const size_t megabytes = 4;
+    BOOST_CHECK(test_cache<SigCache>(megabytes, 0.90) > 0.99);
+    BOOST_CHECK(test_cache<SigCache>(megabytes, 2.0) > 0.40);
+}
+
+/** Entries looked up with erase set are overwritten first once the cache is
+ * full, and the ones that were kept survive.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_erase_ok)
+{
+    seed_insecure_rand(true);
+    const size_t megabytes = 4;
+    const size_t bytes = megabytes * (1 << 20);
+    SigCache set;
+    uint32_t n_insert = static_cast<uint32_t>(0.45 * (bytes / sizeof(uint256)));
+    std::vector<uint256> hashes(2 * n_insert);
+    for (uint32_t i = 0; i < 2 * n_insert; ++i)
+        insecure_GetRandHash(hashes[i]);
+    set.setup_bytes(bytes);
+
+    // Insert the first half, then erase half of those.
+    for (uint32_t i = 0; i < n_insert; ++i)
+        set.insert(hashes[i]);
+    for (uint32_t i = 0; i < n_insert / 2; ++i)
+        BOOST_CHECK(set.contains(hashes[i], true));
+
+    // Fill the cache up again; the erased entries make room.
+    for (uint32_t i = n_insert; i < 2 * n_insert; ++i)
+        set.insert(hashes[i]);
+
+    uint32_t count_erased = 0, count_kept = 0, count_new = 0;
+    for (uint32_t i = 0; i < n_insert / 2; ++i)
+        count_erased += set.contains(hashes[i], false);
+    for (uint32_t i = n_insert / 2; i < n_insert; ++i)
+        count_kept += set.contains(hashes[i], false);
+    for (uint32_t i = n_insert; i < 2 * n_insert; ++i)
+        count_new += set.contains(hashes[i], false);
+
+    BOOST_CHECK(count_kept > 0.98 * (n_insert - n_insert / 2));
+    BOOST_CHECK(count_new > 0.98 * n_insert);
+    BOOST_CHECK(count_erased < count_kept);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,11 +2,14 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockimport.h"
 #include "chainparams.h"
 #include "main.h"
+#include "txdb.h"
 
 #include "test/test_crowcoin.h"
 
+#include <boost/filesystem.hpp>
 #include <boost/signals2/signal.hpp>
 #include <boost/test/unit_test.hpp>
 
@@ -72,4 +75,263 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_FIXTURE_TEST_CASE(txoutset_snapshot_test, TestChain100Setup)
+{
+    boost::filesystem::path path = pathTemp / "utxo.dat";
+    CTxOutSetSnapshot snapshot;
+    BOOST_CHECK(DumpTxOutSet(path, snapshot));
+    BOOST_CHECK(snapshot.hashBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(snapshot.nHeight, 100);
+    BOOST_CHECK(boost::filesystem::exists(path));
+    BOOST_CHECK(!boost::filesystem::exists(path.string() + ".incomplete"));
+
+    CCoinsStats stats;
+    BOOST_CHECK(pcoinsTip->GetStats(stats));
+    BOOST_CHECK_EQUAL(snapshot.nTransactions, stats.nTransactions);
+    BOOST_CHECK_EQUAL(snapshot.nTransactionOutputs, stats.nTransactionOutputs);
+
+    // Dumping the same state again gives the same file
+    CTxOutSetSnapshot snapshot2;
+    BOOST_CHECK(DumpTxOutSet(pathTemp / "utxo2.dat", snapshot2));
+    BOOST_CHECK(snapshot2.hashChecksum == snapshot.hashChecksum);
+
+    // A chain past the genesis block is left alone
+    BOOST_CHECK(LoadTxOutSet(Params(), path));
+    BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+
+    // A fresh chainstate loaded from the snapshot has the same UTXO set
+    {
+        LOCK(cs_main);
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        delete pcoinsdbview;
+        delete pblocktree;
+        pblocktree = new CBlockTreeDB(1 << 20, true);
+        pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        BOOST_CHECK(InitBlockIndex(Params()));
+        BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+    }
+    fPruneMode = true;
+    BOOST_CHECK(LoadTxOutSet(Params(), path));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == snapshot.hashBlock);
+    BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+    BOOST_CHECK(pcoinsdbview->GetBestBlock() == snapshot.hashBlock);
+    bool fLoading;
+    BOOST_CHECK(pcoinsdbview->ReadLoadingTxOutSet(fLoading));
+    BOOST_CHECK(!fLoading);
+
+    CCoinsStats statsLoaded;
+    BOOST_CHECK(pcoinsTip->GetStats(statsLoaded));
+    BOOST_CHECK(statsLoaded.hashBlock == stats.hashBlock);
+    BOOST_CHECK_EQUAL(statsLoaded.nTransactions, stats.nTransactions);
+    BOOST_CHECK_EQUAL(statsLoaded.nTransactionOutputs, stats.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(statsLoaded.nSerializedSize, stats.nSerializedSize);
+    BOOST_CHECK_EQUAL(statsLoaded.nTotalAmount, stats.nTotalAmount);
+    BOOST_CHECK(statsLoaded.hashSerialized == stats.hashSerialized);
+    fPruneMode = false;
+    fHavePruned = false;
+}
+
+BOOST_FIXTURE_TEST_CASE(read_block_from_disk_test, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    for (int nMaxFiles = 0; nMaxFiles < 2; nMaxFiles++) {
+        blockFileMapper.SetMaxFiles(nMaxFiles);
+        CBlockIndex* pindex = chainActive[50];
+        CBlock block;
+        BOOST_CHECK(ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()));
+        BOOST_CHECK(block.GetHash() == pindex->GetBlockHash());
+
+        // The raw bytes are the block's serialization
+        CBlockFileView view;
+        BOOST_CHECK(ReadRawBlockFromDisk(view, pindex, chainparams.MessageStart()));
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << block;
+        BOOST_CHECK_EQUAL(view.size(), ss.size());
+        BOOST_CHECK(std::equal(view.begin(), view.end(), ss.begin()));
+
+        // Blocks written after the file was mapped can be read too
+        CBlock blockTip;
+        BOOST_CHECK(ReadBlockFromDisk(blockTip, chainActive.Tip(), chainparams.GetConsensus()));
+
+        // Wrong message start, wrong block, or no block at all
+        CMessageHeader::MessageStartChars messageStart;
+        memcpy(messageStart, chainparams.MessageStart(), sizeof(messageStart));
+        messageStart[0] ^= 1;
+        BOOST_CHECK(!ReadRawBlockFromDisk(view, pindex->GetBlockPos(), messageStart));
+        BOOST_CHECK(!ReadRawBlockFromDisk(view, CDiskBlockPos(pindex->GetBlockPos().nFile, pindex->GetBlockPos().nPos + 1), chainparams.MessageStart()));
+        BOOST_CHECK(!ReadRawBlockFromDisk(view, CDiskBlockPos(pindex->GetBlockPos().nFile + 1, 8), chainparams.MessageStart()));
+    }
+    blockFileMapper.SetMaxFiles(DEFAULT_MAPPED_BLOCK_FILES);
+}
+
+static std::string GetSendQueue(const CNode& node)
+{
+    std::string str;
+    BOOST_FOREACH(const CSendBuffer& buffer, node.vSendMsg)
+        str.append(buffer.begin(), buffer.size());
+    return str;
+}
+
+BOOST_FIXTURE_TEST_CASE(raw_block_message_test, TestChain100Setup)
+{
+    // Sending a block from its bytes on disk gives the same message as
+    // serializing it
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, chainActive.Tip(), Params().GetConsensus()));
+    CBlockFileView view;
+    BOOST_CHECK(ReadRawBlockFromDisk(view, chainActive.Tip(), Params().MessageStart()));
+
+    CAddress addr(CService("127.0.0.1", 9999));
+    CNode nodeSerialized(INVALID_SOCKET, addr, "", true);
+    CNode nodeRaw(INVALID_SOCKET, addr, "", true);
+    nodeSerialized.PushMessage(NetMsgType::BLOCK, block);
+    nodeRaw.PushRawMessage(NetMsgType::BLOCK, view);
+    BOOST_CHECK_EQUAL(nodeRaw.vSendMsg.size(), 2U);
+    BOOST_CHECK_EQUAL(nodeRaw.nSendSize, nodeSerialized.nSendSize);
+    BOOST_CHECK(GetSendQueue(nodeRaw) == GetSendQueue(nodeSerialized));
+}
+
+BOOST_FIXTURE_TEST_CASE(block_import_pipeline_test, TestChain100Setup)
+{
+    // Write the chain to a file, out of order and with some garbage between
+    // the blocks
+    boost::filesystem::path path = pathTemp / "import.dat";
+    std::vector<CBlockIndex*> vIndex;
+    {
+        CAutoFile file(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        // Even heights first, then odd ones backwards
+        for (int i = 0; i <= chainActive.Height(); i++) {
+            int nHalf = chainActive.Height() / 2 + 1;
+            CBlockIndex* pindex = chainActive[i < nHalf ? 2 * i : 2 * (chainActive.Height() - i) + 1];
+            CBlock block;
+            BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+            file << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(block, SER_DISK, CLIENT_VERSION) << block;
+            file << (unsigned char)Params().MessageStart()[0] << i;
+            vIndex.push_back(pindex);
+        }
+    }
+
+    // The blocks come out in file order, whatever thread checked them
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        CBlockImportPipeline pipeline(Params(), fopen(path.string().c_str(), "rb"), -1, nThreads);
+        CImportedBlock imported;
+        size_t n = 0;
+        while (pipeline.Next(imported)) {
+            BOOST_CHECK(imported.pos.IsNull());
+            BOOST_CHECK(imported.pblock);
+            if (n < vIndex.size() && imported.pblock)
+                BOOST_CHECK(imported.pblock->GetHash() == vIndex[n]->GetBlockHash());
+            n++;
+        }
+        BOOST_CHECK_EQUAL(n, vIndex.size());
+        BOOST_CHECK(pipeline.GetError().empty());
+    }
+
+    // Blocks in a block file get their position there
+    CDiskBlockPos pos(chainActive[0]->GetBlockPos().nFile, 0);
+    CBlockImportPipeline pipeline(Params(), OpenBlockFile(pos, true), pos.nFile, 2);
+    CImportedBlock imported;
+    for (int i = 0; i <= chainActive.Height(); i++) {
+        BOOST_CHECK(pipeline.Next(imported));
+        BOOST_CHECK(imported.pos == chainActive[i]->GetBlockPos());
+    }
+
+    // Importing blocks we already have loads nothing
+    BOOST_CHECK(!LoadExternalBlockFile(Params(), fopen(path.string().c_str(), "rb")));
+    BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+}
+
+BOOST_FIXTURE_TEST_CASE(block_index_snapshot_test, TestChain100Setup)
+{
+    FlushStateToDisk();
+    BOOST_CHECK(WriteBlockIndexSnapshot());
+
+    std::map<uint256, std::pair<uint256, arith_uint256> > mapExpected;
+    BOOST_FOREACH(const BlockMap::value_type& item, mapBlockIndex)
+        mapExpected[item.first] = std::make_pair(item.second->pprev ? item.second->pprev->GetBlockHash() : uint256(), item.second->nChainWork);
+    const uint256 hashTip = chainActive.Tip()->GetBlockHash();
+
+    // The snapshot comes back sorted by height, and the block index built
+    // from it is the one we had
+    UnloadBlockIndex();
+    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+    BOOST_CHECK(pblocktree->LoadBlockIndexSnapshot(vSortedByHeight));
+    BOOST_CHECK_EQUAL(vSortedByHeight.size(), mapExpected.size());
+    for (size_t i = 1; i < vSortedByHeight.size(); i++)
+        BOOST_CHECK(vSortedByHeight[i - 1].first <= vSortedByHeight[i].first);
+
+    // Loading it uses it up, so a clean shutdown has to write a new one
+    UnloadBlockIndex();
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(vSortedByHeight));
+    BOOST_CHECK(mapBlockIndex.empty());
+    BOOST_CHECK(LoadBlockIndex());
+    BOOST_CHECK(WriteBlockIndexSnapshot());
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex());
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == hashTip);
+    BOOST_CHECK_EQUAL(mapBlockIndex.size(), mapExpected.size());
+    BOOST_FOREACH(const BlockMap::value_type& item, mapBlockIndex) {
+        BOOST_CHECK(*item.second->phashBlock == item.first);
+        BOOST_CHECK(mapExpected[item.first].first == (item.second->pprev ? item.second->pprev->GetBlockHash() : uint256()));
+        BOOST_CHECK(mapExpected[item.first].second == item.second->nChainWork);
+    }
+
+    // Writing to the block index database makes the snapshot stale
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    FlushStateToDisk();
+    UnloadBlockIndex();
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(vSortedByHeight));
+    BOOST_CHECK(mapBlockIndex.empty());
+    BOOST_CHECK(LoadBlockIndex());
+    BOOST_CHECK_EQUAL(chainActive.Height(), 101);
+
+    // So does damage to the file
+    BOOST_CHECK(WriteBlockIndexSnapshot());
+    boost::filesystem::path path = GetDataDir() / "blocks" / "index.snapshot";
+    FILE* file = fopen(path.string().c_str(), "r+b");
+    BOOST_REQUIRE(file);
+    fseek(file, 100, SEEK_SET);
+    int c = fgetc(file);
+    fseek(file, 100, SEEK_SET);
+    fputc(c ^ 0x55, file);
+    fclose(file);
+    UnloadBlockIndex();
+    BOOST_CHECK(!pblocktree->LoadBlockIndexSnapshot(vSortedByHeight));
+    BOOST_CHECK(LoadBlockIndex());
+    BOOST_CHECK_EQUAL(chainActive.Height(), 101);
+}
+
+BOOST_FIXTURE_TEST_CASE(verify_db_test, TestChain100Setup)
+{
+    FlushStateToDisk();
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 4, 0, nThreads));
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 2, 10, nThreads));
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 100);
+
+    // Damage the header of block 50; only checks that reach it fail
+    CDiskBlockPos pos = chainActive[50]->GetBlockPos();
+    pos.nPos += 76;
+    FILE* file = OpenBlockFile(pos);
+    BOOST_REQUIRE(file);
+    int c = fgetc(file);
+    fseek(file, pos.nPos, SEEK_SET);
+    fputc(c ^ 0x55, file);
+    fflush(file);
+    for (int nThreads = 1; nThreads <= 4; nThreads += 3) {
+        BOOST_CHECK(!CVerifyDB().VerifyDB(Params(), pcoinsTip, 0, 0, nThreads));
+        BOOST_CHECK(!CVerifyDB().VerifyDB(Params(), pcoinsTip, 3, 60, nThreads));
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 3, 40, nThreads));
+    }
+    fseek(file, pos.nPos, SEEK_SET);
+    fputc(c, file);
+    fclose(file);
+    BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip, 4, 0, 4));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -54,7 +54,7 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
 
 
     CTxMemPool testPool(CFeeRate(0));
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
 
     // Nothing in pool, remove should do nothing:
     testPool.remove(txParent, removed, true);
@@ -280,7 +280,7 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     BOOST_CHECK_EQUAL(pool.size(), 10);
 
     // Now try removing tx10 and verify the sort order returns to normal
-    std::list<CTransaction> removed;
+    std::list<CTransactionRef> removed;
     pool.remove(pool.mapTx.find(tx10.GetHash())->GetTx(), removed, true);
     CheckSort<1>(pool, snapshotOrder);
 
@@ -317,6 +317,147 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
     CheckSort<3>(pool, sortedOrder);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // Transactions of the same size: tx4 spends tx3
+    CMutableTransaction tx[5];
+    for (int i = 1; i <= 4; i++) {
+        tx[i].vin.resize(1);
+        tx[i].vin[0].scriptSig = CScript() << OP_11;
+        tx[i].vin[0].prevout.n = i;
+        tx[i].vout.resize(1);
+        tx[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx[i].vout[0].nValue = i * COIN;
+    }
+    tx[4].vin[0].prevout = COutPoint(tx[3].GetHash(), 0);
+
+    pool.addUnchecked(tx[1].GetHash(), entry.Fee(10000LL).FromTx(tx[1]));
+    pool.addUnchecked(tx[2].GetHash(), entry.Fee(20000LL).FromTx(tx[2]));
+    pool.addUnchecked(tx[3].GetHash(), entry.Fee(0LL).FromTx(tx[3]));
+    pool.addUnchecked(tx[4].GetHash(), entry.Fee(30000LL).FromTx(tx[4]));
+
+    CTxMemPool::txiter it4 = pool.mapTx.find(tx[4].GetHash());
+    const uint64_t nSize = it4->GetTxSize();
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 2U);
+    BOOST_CHECK_EQUAL(it4->GetSizeWithAncestors(), 2 * nSize);
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 30000);
+    BOOST_CHECK_EQUAL(it4->GetSigOpCountWithAncestors(), 2U);
+
+    // tx4 pays 15000 per tx size with its parent
+    std::vector<std::string> sortedOrder;
+    sortedOrder.push_back(tx[2].GetHash().ToString()); // 20000
+    sortedOrder.push_back(tx[4].GetHash().ToString()); // 15000
+    sortedOrder.push_back(tx[1].GetHash().ToString()); // 10000
+    sortedOrder.push_back(tx[3].GetHash().ToString()); // 0
+    CheckSort<4>(pool, sortedOrder);
+
+    // Prioritising the parent raises the child too
+    pool.PrioritiseTransaction(tx[3].GetHash(), tx[3].GetHash().ToString(), 0.0, 40000LL);
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 70000);
+    sortedOrder.clear();
+    sortedOrder.push_back(tx[3].GetHash().ToString()); // 40000
+    sortedOrder.push_back(tx[4].GetHash().ToString()); // 35000
+    sortedOrder.push_back(tx[2].GetHash().ToString()); // 20000
+    sortedOrder.push_back(tx[1].GetHash().ToString()); // 10000
+    CheckSort<4>(pool, sortedOrder);
+
+    // Once the parent is mined, the child's package is just itself
+    std::list<CTransactionRef> removed;
+    pool.remove(tx[3], removed, false);
+    BOOST_CHECK_EQUAL(removed.size(), 1U);
+    BOOST_CHECK_EQUAL(it4->GetCountWithAncestors(), 1U);
+    BOOST_CHECK_EQUAL(it4->GetSizeWithAncestors(), nSize);
+    BOOST_CHECK_EQUAL(it4->GetModFeesWithAncestors(), 30000);
+    BOOST_CHECK_EQUAL(it4->GetSigOpCountWithAncestors(), 1U);
+    sortedOrder.erase(sortedOrder.begin());
+    sortedOrder.erase(sortedOrder.begin());
+    sortedOrder.insert(sortedOrder.begin(), tx[4].GetHash().ToString()); // 30000
+    CheckSort<4>(pool, sortedOrder);
+}
+
+
+BOOST_AUTO_TEST_CASE(MempoolAncestorLimitsTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    std::string errString;
+    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+
+    // A chain of 30 transactions
+    std::vector<CMutableTransaction> vChain(30);
+    for (unsigned int i = 0; i < vChain.size(); i++) {
+        vChain[i].vin.resize(1);
+        vChain[i].vin[0].scriptSig = CScript() << OP_11;
+        if (i > 0)
+            vChain[i].vin[0].prevout = COutPoint(vChain[i - 1].GetHash(), 0);
+        vChain[i].vout.resize(1);
+        vChain[i].vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        vChain[i].vout[0].nValue = COIN;
+        pool.addUnchecked(vChain[i].GetHash(), entry.Fee(1000LL).FromTx(vChain[i]));
+    }
+    CTxMemPool::txiter itTip = pool.mapTx.find(vChain.back().GetHash());
+    BOOST_CHECK_EQUAL(itTip->GetCountWithAncestors(), 30U);
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout = COutPoint(vChain.back().GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = COIN;
+    CTxMemPoolEntry entryChild = entry.FromTx(txChild);
+
+    CTxMemPool::setEntries setAncestors;
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryChild, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 30U);
+
+    // Turned away on the parent's ancestor state
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryChild, setAncestors, 25, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(errString, "too many unconfirmed ancestors [limit: 25]");
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryChild, setAncestors, nNoLimit, itTip->GetSizeWithAncestors(), nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(errString, "exceeds ancestor size limit [limit: " + i64tostr(itTip->GetSizeWithAncestors()) + "]");
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryChild, setAncestors, 31, itTip->GetSizeWithAncestors() + entryChild.GetTxSize(), nNoLimit, nNoLimit, errString));
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryChild, setAncestors, nNoLimit, nNoLimit, 29, nNoLimit, errString));
+
+    // Ancestors reached along several paths count once
+    CMutableTransaction txBranch;
+    txBranch.vin.resize(1);
+    txBranch.vin[0].scriptSig = CScript() << OP_11;
+    txBranch.vin[0].prevout = COutPoint(vChain[9].GetHash(), 1);
+    txBranch.vout.resize(1);
+    txBranch.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txBranch.vout[0].nValue = COIN;
+    pool.addUnchecked(txBranch.GetHash(), entry.FromTx(txBranch));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(txBranch.GetHash())->GetCountWithAncestors(), 11U);
+    txChild.vin.resize(2);
+    txChild.vin[1].scriptSig = CScript() << OP_11;
+    txChild.vin[1].prevout = COutPoint(txBranch.GetHash(), 0);
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entry.FromTx(txChild), setAncestors, 32, nNoLimit, nNoLimit, nNoLimit, errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 31U);
+    pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild), setAncestors);
+    CTxMemPool::txiter itChild = pool.mapTx.find(txChild.GetHash());
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 32U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(vChain[0].GetHash())->GetCountWithDescendants(), 32U);
+
+    // Mining the start of the chain takes it out of the ancestors of the rest
+    std::list<CTransactionRef> removed;
+    pool.remove(vChain[0], removed, false);
+    BOOST_CHECK_EQUAL(itTip->GetCountWithAncestors(), 29U);
+    BOOST_CHECK_EQUAL(itChild->GetCountWithAncestors(), 31U);
+
+    // Removing a transaction in the middle takes its descendants along
+    removed.clear();
+    pool.remove(vChain[10], removed, true);
+    BOOST_CHECK_EQUAL(removed.size(), 21U);
+    BOOST_CHECK_EQUAL(pool.size(), 10U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(vChain[1].GetHash())->GetCountWithDescendants(), 10U);
+}
+
 
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
@@ -444,7 +585,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7, &pool));
 
     std::vector<CTransaction> vtx;
-    std::list<CTransaction> conflicts;
+    std::list<CTransactionRef> conflicts;
     SetMockTime(42);
     SetMockTime(42 + CTxMemPool::ROLLING_FEE_HALFLIFE);
     BOOST_CHECK_EQUAL(pool.GetMinFee(1).GetFeePerK(), maxFeeRateRemoved.GetFeePerK() + 1000);
@@ -0,0 +1,103 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "consensus/validation.h"
+#include "key.h"
+#include "main.h"
+#include "script/sign.h"
+#include "txmempool.h"
+#include "utiltime.h"
+
+#include "test/test_crowcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mempoolpersist_tests, TestChain100Setup)
+
+/** Spend output 0 of txFrom, which pays to scriptPubKey, back to it. */
+static CMutableTransaction Spend(const CKey& key, const CScript& scriptPubKey, const CTransaction& txFrom, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_AUTO_TEST_CASE(mempool_dump_load)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    // Let the first coinbase mature
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    CTransaction txParent = Spend(coinbaseKey, scriptPubKey, coinbaseTxns[0], 100000);
+    CTransaction txChild = Spend(coinbaseKey, scriptPubKey, txParent, 100000);
+    const uint256 hashOther = uint256S("0123");
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, MakeTransactionRef(txParent), false, NULL));
+        BOOST_REQUIRE(AcceptToMemoryPool(mempool, state, MakeTransactionRef(txChild), false, NULL));
+    }
+    mempool.PrioritiseTransaction(txChild.GetHash(), txChild.GetHash().ToString(), 1.5, 20000);
+    mempool.PrioritiseTransaction(hashOther, hashOther.ToString(), 0.0, 30000);
+    int64_t nParentTime, nChildTime;
+    {
+        LOCK(mempool.cs);
+        nParentTime = mempool.mapTx.find(txParent.GetHash())->GetTime();
+        nChildTime = mempool.mapTx.find(txChild.GetHash())->GetTime();
+    }
+    BOOST_REQUIRE(DumpMempool());
+
+    // Comes back with the entry times and the deltas, also of transactions
+    // that aren't in the mempool
+    mempool.clear();
+    mempool.mapDeltas.clear();
+    BOOST_REQUIRE(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 2);
+    {
+        LOCK(mempool.cs);
+        CTxMemPool::txiter it = mempool.mapTx.find(txParent.GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetTime(), nParentTime);
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), 100000);
+        it = mempool.mapTx.find(txChild.GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetTime(), nChildTime);
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), 120000);
+    }
+    double dPriorityDelta = 0;
+    CAmount nFeeDelta = 0;
+    mempool.ApplyDeltas(txChild.GetHash(), dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(dPriorityDelta, 1.5);
+    BOOST_CHECK_EQUAL(nFeeDelta, 20000);
+    dPriorityDelta = 0;
+    nFeeDelta = 0;
+    mempool.ApplyDeltas(hashOther, dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(nFeeDelta, 30000);
+
+    // Expired transactions are left out, but keep their deltas
+    BOOST_REQUIRE(DumpMempool());
+    mempool.clear();
+    mempool.mapDeltas.clear();
+    SetMockTime(nChildTime + DEFAULT_MEMPOOL_EXPIRY * 60 * 60);
+    BOOST_REQUIRE(LoadMempool());
+    SetMockTime(0);
+    BOOST_CHECK_EQUAL(mempool.size(), 0);
+    nFeeDelta = 0;
+    mempool.ApplyDeltas(txChild.GetHash(), dPriorityDelta, nFeeDelta);
+    BOOST_CHECK_EQUAL(nFeeDelta, 20000);
+
+    mempool.clear();
+    mempool.mapDeltas.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
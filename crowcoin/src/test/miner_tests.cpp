@@ -4,12 +4,14 @@
 
 #include "chainparams.h"
 #include "coins.h"
+#include "key.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "main.h"
 #include "miner.h"
 #include "pubkey.h"
+#include "script/sign.h"
 #include "script/standard.h"
 #include "txmempool.h"
 #include "uint256.h"
@@ -386,4 +388,63 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+// Spend output 0 of txPrev, paying to the same key, less nFee
+static CMutableTransaction SpendWithFee(const CTransaction& txPrev, const CKey& key, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = txPrev.vout[0].scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txPrev.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(CreateNewBlock_packages, TestChain100Setup)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    TestMemPoolEntryHelper entry;
+
+    // Let the second coinbase mature
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+
+    // A parent paying little, with a child paying a lot for both, and a
+    // transaction paying in between the child and the two together
+    CMutableTransaction txParent = SpendWithFee(coinbaseTxns[0], coinbaseKey, 1000);
+    CMutableTransaction txChild = SpendWithFee(txParent, coinbaseKey, 100000);
+    CMutableTransaction txOther = SpendWithFee(coinbaseTxns[1], coinbaseKey, 30000);
+    {
+        LOCK(mempool.cs);
+        mempool.addUnchecked(txParent.GetHash(), entry.Fee(1000).FromTx(txParent));
+        mempool.addUnchecked(txChild.GetHash(), entry.Fee(100000).FromTx(txChild));
+        mempool.addUnchecked(txOther.GetHash(), entry.Fee(30000).FromTx(txOther));
+    }
+
+    // The child gets its parent in ahead of the other transaction
+    CBlockTemplate* pblocktemplate;
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(chainparams, scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1].GetHash() == txParent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txChild.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3].GetHash() == txOther.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -131000);
+    delete pblocktemplate;
+
+    // With room for only one of the two, the package wins
+    mapArgs["-blockmaxsize"] = "1500";
+    BOOST_CHECK(pblocktemplate = CreateNewBlock(chainparams, scriptPubKey));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[2].GetHash() == txChild.GetHash());
+    delete pblocktemplate;
+    mapArgs.erase("-blockmaxsize");
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -19,9 +19,11 @@ template<unsigned int N, typename T>
 class prevector_tester {
     typedef std::vector<T> realtype;
     realtype real_vector;
+    realtype real_vector_alt;
 
     typedef prevector<N, T> pretype;
     pretype pre_vector;
+    pretype pre_vector_alt;
 
     typedef typename pretype::size_type Size;
 
@@ -149,6 +151,12 @@ public:
         pre_vector.shrink_to_fit();
         test();
     }
+
+    void swap() {
+        real_vector.swap(real_vector_alt);
+        pre_vector.swap(pre_vector_alt);
+        test();
+    }
 };
 
 BOOST_AUTO_TEST_CASE(PrevectorTestInt)
@@ -210,6 +218,9 @@ BOOST_AUTO_TEST_CASE(PrevectorTestInt)
             if (((r >> 21) & 512) == 12) {
                 test.assign(insecure_rand() % 32, insecure_rand());
             }
+            if (((r >> 15) % 8) == 3) {
+                test.swap();
+            }
         }
     }
 }
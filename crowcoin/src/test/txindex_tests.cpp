@@ -0,0 +1,75 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "main.h"
+#include "txdb.h"
+#include "txindex.h"
+
+#include "test/test_crowcoin.h"
+
+#include <boost/foreach.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(txindex_initial_sync)
+{
+    CTxIndexer indexer(Params());
+    CDiskTxPos pos;
+    BOOST_CHECK(!pblocktree->ReadTxIndex(coinbaseTxns[0].GetHash(), pos));
+    CBlockLocator locator;
+    BOOST_CHECK(!pblocktree->ReadTxIndexBest(locator));
+
+    // Catches up with the existing chain
+    indexer.Start();
+    BOOST_CHECK(indexer.WaitForSync(10000));
+    BOOST_CHECK(indexer.GetBestBlock() == chainActive.Tip());
+    BOOST_FOREACH(const CTransaction& tx, coinbaseTxns) {
+        BOOST_CHECK(pblocktree->ReadTxIndex(tx.GetHash(), pos));
+    }
+    BOOST_CHECK(pblocktree->ReadTxIndexBest(locator));
+    BOOST_CHECK(FindForkInGlobalIndex(chainActive, locator) == chainActive.Tip());
+
+    // Follows new blocks
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    BOOST_CHECK(indexer.WaitForSync(10000));
+    BOOST_CHECK(pblocktree->ReadTxIndex(block.vtx[0].GetHash(), pos));
+
+    // The positions are those of the transactions on disk
+    fTxIndex = true;
+    CTransaction tx;
+    uint256 hashBlock;
+    BOOST_CHECK(GetTransaction(coinbaseTxns[42].GetHash(), tx, Params().GetConsensus(), hashBlock));
+    BOOST_CHECK(tx.GetHash() == coinbaseTxns[42].GetHash());
+    BOOST_CHECK(hashBlock == chainActive[43]->GetBlockHash());
+    fTxIndex = false;
+
+    indexer.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(txindex_resume)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    {
+        CTxIndexer indexer(Params());
+        indexer.Start();
+        BOOST_CHECK(indexer.WaitForSync(10000));
+    }
+
+    // Blocks connected while no indexer runs are picked up from the locator
+    CBlock block = CreateAndProcessBlock(std::vector<CMutableTransaction>(), scriptPubKey);
+    CDiskTxPos pos;
+    BOOST_CHECK(!pblocktree->ReadTxIndex(block.vtx[0].GetHash(), pos));
+
+    CTxIndexer indexer(Params());
+    indexer.Start();
+    BOOST_CHECK(indexer.GetBestBlock() == chainActive.Tip()->pprev);
+    BOOST_CHECK(indexer.WaitForSync(10000));
+    BOOST_CHECK(pblocktree->ReadTxIndex(block.vtx[0].GetHash(), pos));
+    indexer.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
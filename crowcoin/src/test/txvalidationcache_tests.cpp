@@ -23,7 +23,7 @@ ToMemPool(CMutableTransaction& tx)
     LOCK(cs_main);
 
     CValidationState state;
-    return AcceptToMemoryPool(mempool, state, tx, false, NULL, true, false);
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, NULL, true, false);
 }
 
 BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
@@ -83,4 +83,49 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_script_execution_cache, TestChain100Setup)
+{
+    // Once a transaction's scripts have been executed with a given set of
+    // flags, checking it again with those flags must not queue any script
+    // checks, while any other set of flags must still run them.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+
+    LOCK(cs_main);
+    CTransaction tx(spend);
+    CCoinsViewCache view(pcoinsTip);
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+
+    // Not cached yet: the input's script check is handed back.
+    std::vector<CScriptCheck> vChecks;
+    CValidationState state;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, true, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Executing the scripts inline stores the result.
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, true, NULL));
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 0U);
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags | SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
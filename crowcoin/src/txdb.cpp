@@ -7,38 +7,181 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "clientversion.h"
 #include "hash.h"
 #include "main.h"
+#include "compressor.h"
+#include "init.h"
 #include "pow.h"
+#include "random.h"
+#include "streams.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
+#include <algorithm>
+#include <stdexcept>
 #include <stdint.h>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 
 using namespace std;
 
 static const char DB_COINS = 'c';
+static const char DB_COIN = 'C';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_COIN_TOTALS = 'T';
+static const char DB_TXOUTSET_LOADING = 'L';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_SNAPSHOT = 's';
+static const char DB_TXINDEX_BEST = 'I';
 
+//! Number of outputs written per batch when upgrading the chainstate to DB_COIN records
+static const size_t COIN_UPGRADE_BATCH_SIZE = 100000;
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+//! Format version of the block index snapshot file
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
+
+namespace {
+
+/** Key of the DB_COIN record for one unspent output */
+struct CoinKey
+{
+    char key;
+    uint256 hash;
+    uint32_t n;
+
+    CoinKey() : key(DB_COIN), n(0) {}
+    CoinKey(const uint256& hashIn, uint32_t nIn) : key(DB_COIN), hash(hashIn), n(nIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(key);
+        READWRITE(hash);
+        READWRITE(VARINT(n));
+    }
+};
+
+/**
+ * Read the records of transaction txid, starting at the cursor's position,
+ * into coins. Leaves the cursor at the first record of another transaction
+ * and returns whether any record was found; pnSize, if given, receives the
+ * size of the records on disk.
+ */
+bool ReadCoinRecords(CDBIterator* pcursor, const uint256& txid, CCoins& coins, size_t* pnSize = NULL)
+{
+    coins.Clear();
+    bool fFound = false;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        CoinKey key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || key.key != DB_COIN || key.hash != txid)
+            break;
+        if (!pcursor->GetValue(coin))
+            throw std::runtime_error("ReadCoinRecords(): unable to read value");
+        coins.nVersion = coin.nVersion;
+        coins.nHeight = coin.nHeight;
+        coins.fCoinBase = coin.fCoinBase;
+        if (coins.vout.size() <= key.n)
+            coins.vout.resize(key.n + 1);
+        coins.vout[key.n] = coin.out;
+        if (pnSize)
+            *pnSize += pcursor->GetKeySize() + pcursor->GetValueSize();
+        fFound = true;
+    }
+    return fFound;
+}
+
+/** Add one coin database record to totals, or with fAdd false, remove it. */
+void UpdateTotals(CCoinsTotals& totals, const CoinKey& key, const Coin& coin, bool fAdd)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << key << coin;
+    if (fAdd) {
+        totals.nTransactionOutputs++;
+        totals.nSerializedSize += ss.size();
+        totals.nTotalAmount += coin.out.nValue;
+        totals.muhash.Insert((const unsigned char*)&ss[0], ss.size());
+    } else {
+        totals.nTransactionOutputs--;
+        totals.nSerializedSize -= ss.size();
+        totals.nTotalAmount -= coin.out.nValue;
+        totals.muhash.Remove((const unsigned char*)&ss[0], ss.size());
+    }
+}
+
+/** Order coin cache entries by outpoint, which groups them by transaction */
+struct CompareCoinsMapIterByOutPoint
+{
+    bool operator()(const CCoinsMap::const_iterator& a, const CCoinsMap::const_iterator& b) const {
+        return a->first < b->first;
+    }
+};
+
+/**
+ * A block index entry in the block index snapshot. It has the fields of
+ * CDiskBlockIndex, but stores the block's own hash, so that it need not be
+ * recomputed, and the position of its parent in the snapshot instead of
+ * the parent's hash.
+ */
+struct SnapshotBlockIndex
+{
+    CBlockIndex* pindex;
+    uint256 hash;
+    //! One more than the position of the parent in the snapshot; 0 if none
+    uint32_t nParentPos;
+
+    explicit SnapshotBlockIndex(CBlockIndex* pindexIn) : pindex(pindexIn), nParentPos(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(hash);
+        READWRITE(VARINT(nParentPos));
+        READWRITE(VARINT(pindex->nHeight));
+        READWRITE(VARINT(pindex->nStatus));
+        READWRITE(VARINT(pindex->nTx));
+        READWRITE(VARINT(pindex->nFile));
+        READWRITE(VARINT(pindex->nDataPos));
+        READWRITE(VARINT(pindex->nUndoPos));
+        READWRITE(pindex->nVersion);
+        READWRITE(pindex->hashMerkleRoot);
+        READWRITE(pindex->nTime);
+        READWRITE(pindex->nBits);
+        READWRITE(pindex->nNonce);
+    }
+};
+
+boost::filesystem::path GetBlockIndexSnapshotPath()
 {
+    return GetDataDir() / "blocks" / "index.snapshot";
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(make_pair(DB_COINS, txid), coins);
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(make_pair(DB_COINS, txid));
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), fHaveTotals(false)
+{
+    // A database without a best block has no coins yet either.
+    fHaveTotals = db.Read(DB_COIN_TOTALS, totals) || !db.Exists(DB_BEST_BLOCK);
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    return db.Read(CoinKey(outpoint.hash, outpoint.n), coin);
+}
+
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    return db.Exists(CoinKey(outpoint.hash, outpoint.n));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -48,27 +191,215 @@ uint256 CCoinsViewDB::GetBestBlock() const {
     return hashBestChain;
 }
 
+bool CCoinsViewDB::WriteLoadingTxOutSet(bool fLoading) {
+    if (fLoading)
+        return db.Write(DB_TXOUTSET_LOADING, '1', true);
+    else
+        return db.Erase(DB_TXOUTSET_LOADING, true);
+}
+
+bool CCoinsViewDB::ReadLoadingTxOutSet(bool &fLoading) const {
+    fLoading = db.Exists(DB_TXOUTSET_LOADING);
+    return true;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(&db.GetObfuscateKey());
+    bool fOk = BatchWriteConst(mapCoins, hashBlock);
+    mapCoins.clear();
+    return fOk;
+}
+
+bool CCoinsViewDB::BatchWriteConst(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    // Go through the modified outputs by transaction.
+    std::vector<CCoinsMap::const_iterator> vDirty;
     size_t count = 0;
-    size_t changed = 0;
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
-        if (it->second.flags & CCoinsCacheEntry::DIRTY) {
-            if (it->second.coins.IsPruned())
-                batch.Erase(make_pair(DB_COINS, it->first));
-            else
-                batch.Write(make_pair(DB_COINS, it->first), it->second.coins);
-            changed++;
-        }
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
+        if (it->second.flags & CCoinsCacheEntry::DIRTY)
+            vDirty.push_back(it);
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
+    }
+    std::sort(vDirty.begin(), vDirty.end(), CompareCoinsMapIterByOutPoint());
+
+    CDBBatch batch(&db.GetObfuscateKey());
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewLookupIterator());
+    size_t written = 0;
+    size_t erased = 0;
+    size_t seeks = 0;
+    CCoinsTotals totalsNew;
+    {
+        LOCK(cs_totals);
+        totalsNew = totals;
+    }
+    std::vector<bool> vOnDisk;
+    std::vector<uint32_t> vN;
+    for (size_t nBegin = 0, nEnd = 0; nBegin < vDirty.size(); nBegin = nEnd) {
+        const uint256& txid = vDirty[nBegin]->first.hash;
+        bool fFresh = true;
+        bool fHasCoins = false;
+        vN.clear();
+        for (nEnd = nBegin; nEnd < vDirty.size() && vDirty[nEnd]->first.hash == txid; nEnd++) {
+            fFresh &= (vDirty[nEnd]->second.flags & CCoinsCacheEntry::FRESH) != 0;
+            fHasCoins |= !vDirty[nEnd]->second.coin.IsSpent();
+            vN.push_back(vDirty[nEnd]->first.n);
+        }
+        vOnDisk.assign(nEnd - nBegin, false);
+
+        // FRESH outputs are not on disk, and as the outputs of a transaction
+        // only come back non-FRESH (from block undo data, or a coinbase that
+        // may be a duplicate), neither is the rest of the transaction. For
+        // the others, read the old records of just the outputs this batch
+        // touches, to take them out of the totals.
+        bool fHadCoins = false;
+        if (!fFresh) {
+            for (size_t i = nBegin; i < nEnd; i++) {
+                if (vDirty[i]->second.flags & CCoinsCacheEntry::FRESH)
+                    continue;
+                CoinKey key(txid, vDirty[i]->first.n);
+                Coin coinOld;
+                if (!db.Read(key, coinOld))
+                    continue;
+                fHadCoins = true;
+                const Coin& coin = vDirty[i]->second.coin;
+                if (!coin.IsSpent() && coin == coinOld) {
+                    vOnDisk[i - nBegin] = true;
+                    continue;
+                }
+                UpdateTotals(totalsNew, key, coinOld, false);
+                if (coin.IsSpent()) {
+                    batch.Erase(key);
+                    erased++;
+                }
+            }
+            // Whether the transaction stays in (or was already in) the count
+            // then depends on the outputs the batch leaves alone. The first
+            // record that is not one of the touched outputs decides; touched
+            // ones can only come before it when they are all being spent.
+            if (!fHasCoins || !fHadCoins) {
+                pcursor->Seek(CoinKey(txid, 0));
+                seeks++;
+                for (; pcursor->Valid(); pcursor->Next()) {
+                    CoinKey key;
+                    if (!pcursor->GetKey(key) || key.key != DB_COIN || key.hash != txid)
+                        break;
+                    if (!std::binary_search(vN.begin(), vN.end(), key.n)) {
+                        fHadCoins = fHasCoins = true;
+                        break;
+                    }
+                }
+            }
+        }
+        for (size_t i = nBegin; i < nEnd; i++) {
+            const Coin& coin = vDirty[i]->second.coin;
+            if (coin.IsSpent() || vOnDisk[i - nBegin])
+                continue;
+            CoinKey key(txid, vDirty[i]->first.n);
+            batch.Write(key, coin);
+            UpdateTotals(totalsNew, key, coin, true);
+            written++;
+        }
+        if (fHasCoins && !fHadCoins)
+            totalsNew.nTransactions++;
+        else if (fHadCoins && !fHasCoins)
+            totalsNew.nTransactions--;
     }
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LOCK(cs_totals);
+    if (fHaveTotals)
+        batch.Write(DB_COIN_TOTALS, totalsNew);
+    LogPrint("coindb", "Committing %u changed outputs (out of %u) to coin database, %u written, %u erased, %u seeks...\n", (unsigned int)vDirty.size(), (unsigned int)count, (unsigned int)written, (unsigned int)erased, (unsigned int)seeks);
+    if (!db.WriteBatch(batch))
+        return false;
+    totals = totalsNew;
+    return true;
+}
+
+CDBIterator* CCoinsViewDB::NewCoinsCursor() const {
+    CDBIterator* pcursor = const_cast<CDBWrapper*>(&db)->NewIterator();
+    pcursor->Seek(DB_COIN);
+    return pcursor;
+}
+
+bool CCoinsViewDB::ReadCoins(CDBIterator* pcursor, uint256& txid, CCoins& coins) {
+    CoinKey key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.key != DB_COIN)
+        return false;
+    txid = key.hash;
+    return ReadCoinRecords(pcursor, txid, coins);
+}
+
+bool CCoinsViewDB::Upgrade() {
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_COINS);
+    std::pair<char, uint256> key;
+    if (!pcursor->Valid() || !pcursor->GetKey(key) || key.first != DB_COINS)
+        return fHaveTotals || ComputeTotals();
+
+    LogPrintf("Upgrading chainstate database to one record per output...\n");
+    uiInterface.InitMessage(_("Upgrading chainstate database..."));
+    CDBBatch batch(&db.GetObfuscateKey());
+    size_t nTransactions = 0;
+    size_t nBatch = 0;
+    for (; pcursor->Valid(); pcursor->Next()) {
+        if (ShutdownRequested())
+            return false;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        CCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("%s: unable to read value", __func__);
+        // Each transaction moves in a single batch, so an interrupted upgrade
+        // can simply be picked up again at the next start.
+        for (unsigned int i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull()) {
+                batch.Write(CoinKey(key.second, i), Coin(coins.vout[i], coins.nHeight, coins.fCoinBase, coins.nVersion));
+                nBatch++;
+            }
+        }
+        batch.Erase(key);
+        nTransactions++;
+        if (nBatch >= COIN_UPGRADE_BATCH_SIZE) {
+            if (!db.WriteBatch(batch))
+                return false;
+            batch = CDBBatch(&db.GetObfuscateKey());
+            nBatch = 0;
+            LogPrintf("%u transactions upgraded...\n", (unsigned int)nTransactions);
+        }
+    }
+    if (!db.WriteBatch(batch))
+        return false;
+    LogPrintf("Upgraded %u transactions in the chainstate database\n", (unsigned int)nTransactions);
+    return ComputeTotals();
+}
+
+bool CCoinsViewDB::ComputeTotals() {
+    LogPrintf("Computing UTXO set statistics...\n");
+    uiInterface.InitMessage(_("Computing UTXO set statistics..."));
+    CCoinsTotals totalsNew;
+    boost::scoped_ptr<CDBIterator> pcursor(db.NewIterator());
+    uint256 hashLast;
+    for (pcursor->Seek(DB_COIN); pcursor->Valid(); pcursor->Next()) {
+        if (ShutdownRequested())
+            return false;
+        CoinKey key;
+        Coin coin;
+        if (!pcursor->GetKey(key) || key.key != DB_COIN)
+            break;
+        if (!pcursor->GetValue(coin))
+            return error("%s: unable to read value", __func__);
+        if (totalsNew.nTransactionOutputs == 0 || key.hash != hashLast)
+            totalsNew.nTransactions++;
+        hashLast = key.hash;
+        UpdateTotals(totalsNew, key, coin, true);
+    }
+    LOCK(cs_totals);
+    if (!db.Write(DB_COIN_TOTALS, totalsNew))
+        return false;
+    totals = totalsNew;
+    fHaveTotals = true;
+    LogPrintf("UTXO set statistics: %u transactions, %u outputs\n", (unsigned int)totals.nTransactions, (unsigned int)totals.nTransactionOutputs);
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -95,48 +426,27 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 }
 
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) const {
-    /* It seems that there are no "const iterators" for LevelDB.  Since we
-       only need read operations on it, use a const-cast to get around
-       that restriction.  */
-    boost::scoped_ptr<CDBIterator> pcursor(const_cast<CDBWrapper*>(&db)->NewIterator());
-    pcursor->Seek(DB_COINS);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock();
-    ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && key.first == DB_COINS) {
-            if (pcursor->GetValue(coins)) {
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
-                }
-                stats.nSerializedSize += 32 + pcursor->GetValueSize();
-                ss << VARINT(0);
-            } else {
-                return error("CCoinsViewDB::GetStats() : unable to read value");
-            }
-        } else {
-            break;
-        }
-        pcursor->Next();
+    CCoinsTotals totalsCopy;
+    {
+        LOCK(cs_totals);
+        if (!fHaveTotals)
+            return error("CCoinsViewDB::GetStats() : no UTXO set statistics");
+        stats.hashBlock = GetBestBlock();
+        totalsCopy = totals;
     }
+    stats.nTransactions = totalsCopy.nTransactions;
+    stats.nTransactionOutputs = totalsCopy.nTransactionOutputs;
+    stats.nSerializedSize = totalsCopy.nSerializedSize;
+    stats.nTotalAmount = totalsCopy.nTotalAmount;
+    unsigned char hash[MuHash3072::OUTPUT_SIZE];
+    totalsCopy.muhash.Finalize(hash);
+    stats.hashSerialized = uint256(std::vector<unsigned char>(hash, hash + sizeof(hash)));
     {
         LOCK(cs_main);
-        stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
+        BlockMap::const_iterator it = mapBlockIndex.find(stats.hashBlock);
+        if (it != mapBlockIndex.end())
+            stats.nHeight = it->second->nHeight;
     }
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -149,6 +459,8 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
         batch.Write(make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    // Any block index snapshot no longer matches the database
+    batch.Erase(DB_INDEX_SNAPSHOT);
     return WriteBatch(batch, true);
 }
 
@@ -156,13 +468,18 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect, const CBlockLocator& locator) {
     CDBBatch batch(&GetObfuscateKey());
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(DB_TXINDEX_BEST, locator);
     return WriteBatch(batch);
 }
 
+bool CBlockTreeDB::ReadTxIndexBest(CBlockLocator& locator) {
+    return Read(DB_TXINDEX_BEST, locator);
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -217,3 +534,138 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
 
     return true;
 }
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const std::vector<const CBlockIndex*>& vSortedByHeight)
+{
+    // Invalidate the current snapshot before replacing its file
+    if (!Erase(DB_INDEX_SNAPSHOT, true))
+        return error("%s: failed to invalidate the previous snapshot", __func__);
+
+    const uint256 id = GetRandHash();
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss.reserve(64 + vSortedByHeight.size() * 120);
+    ss << BLOCK_INDEX_SNAPSHOT_VERSION << id << (uint64_t)vSortedByHeight.size();
+
+    boost::unordered_map<const CBlockIndex*, uint32_t> mapPos;
+    mapPos.reserve(vSortedByHeight.size());
+    for (size_t i = 0; i < vSortedByHeight.size(); i++) {
+        const CBlockIndex* pindex = vSortedByHeight[i];
+        SnapshotBlockIndex entry(const_cast<CBlockIndex*>(pindex));
+        entry.hash = pindex->GetBlockHash();
+        if (pindex->pprev) {
+            boost::unordered_map<const CBlockIndex*, uint32_t>::const_iterator it = mapPos.find(pindex->pprev);
+            if (it == mapPos.end())
+                return error("%s: block %s comes before its parent", __func__, entry.hash.ToString());
+            entry.nParentPos = it->second + 1;
+        }
+        ss << entry;
+        mapPos[pindex] = i;
+    }
+    ss << Hash(ss.begin(), ss.end());
+
+    boost::filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    boost::filesystem::path pathTmp = pathSnapshot.string() + ".new";
+    FILE* file = fopen(pathTmp.string().c_str(), "wb");
+    if (!file)
+        return error("%s: failed to open %s", __func__, pathTmp.string());
+    bool fWritten = fwrite(&ss[0], 1, ss.size(), file) == ss.size();
+    if (fWritten)
+        FileCommit(file);
+    fclose(file);
+    if (!fWritten || !RenameOver(pathTmp, pathSnapshot))
+        return error("%s: failed to write %s", __func__, pathSnapshot.string());
+
+    if (!Write(DB_INDEX_SNAPSHOT, id, true))
+        return error("%s: failed to record the snapshot", __func__);
+    LogPrintf("%s: wrote %u block index entries (%u kB)\n", __func__, vSortedByHeight.size(), ss.size() / 1000);
+    return true;
+}
+
+bool CBlockTreeDB::LoadBlockIndexSnapshot(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight)
+{
+    uint256 id;
+    if (!mapBlockIndex.empty() || !Read(DB_INDEX_SNAPSHOT, id))
+        return false;
+
+    // Read the whole file at once
+    boost::filesystem::path pathSnapshot = GetBlockIndexSnapshotPath();
+    FILE* file = fopen(pathSnapshot.string().c_str(), "rb");
+    if (!file) {
+        LogPrintf("%s: cannot open %s\n", __func__, pathSnapshot.string());
+        return false;
+    }
+    std::vector<char> vData;
+    try {
+        vData.resize(boost::filesystem::file_size(pathSnapshot));
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    bool fRead = vData.size() > sizeof(uint256) && fread(&vData[0], 1, vData.size(), file) == vData.size();
+    fclose(file);
+    if (!fRead) {
+        LogPrintf("%s: cannot read %s\n", __func__, pathSnapshot.string());
+        return false;
+    }
+    const char* pbegin = &vData[0];
+    const char* pend = pbegin + vData.size() - sizeof(uint256);
+    if (memcmp(Hash(pbegin, pend).begin(), pend, sizeof(uint256))) {
+        LogPrintf("%s: checksum mismatch in %s\n", __func__, pathSnapshot.string());
+        return false;
+    }
+
+    // Entries go straight into mapBlockIndex, which is emptied again if
+    // anything is wrong with them
+    try {
+        CMemoryReader reader(pbegin, pend, SER_DISK, CLIENT_VERSION);
+        uint32_t nVersion;
+        uint256 idFile;
+        uint64_t nCount;
+        reader >> nVersion >> idFile >> nCount;
+        if (nVersion != BLOCK_INDEX_SNAPSHOT_VERSION || idFile != id)
+            throw std::runtime_error("snapshot does not match the block index");
+        // Every entry takes at least 80 bytes
+        if (nCount > reader.size() / 80)
+            throw std::runtime_error("bad entry count");
+
+        mapBlockIndex.reserve(nCount);
+        vSortedByHeight.reserve(nCount);
+        CBlockIndex index;
+        for (uint64_t i = 0; i < nCount; i++) {
+            SnapshotBlockIndex entry(&index);
+            reader >> entry;
+            if (entry.nParentPos > i)
+                throw std::runtime_error("entry before its parent");
+            std::pair<BlockMap::iterator, bool> ret = mapBlockIndex.emplace(entry.hash, index);
+            if (!ret.second)
+                throw std::runtime_error("duplicate block " + entry.hash.ToString());
+            CBlockIndex* pindex = ret.first->second;
+            if (entry.nParentPos) {
+                pindex->pprev = vSortedByHeight[entry.nParentPos - 1].second;
+                if (pindex->nHeight != pindex->pprev->nHeight + 1)
+                    throw std::runtime_error("bad height");
+            }
+            if (i > 0 && pindex->nHeight < vSortedByHeight.back().first)
+                throw std::runtime_error("entries not sorted by height");
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        if (!reader.empty())
+            throw std::runtime_error("trailing data");
+    } catch (const std::exception& e) {
+        LogPrintf("%s: ignoring %s: %s\n", __func__, pathSnapshot.string(), e.what());
+        mapBlockIndex.clear();
+        vSortedByHeight.clear();
+        return false;
+    }
+
+    // The snapshot is only good for one start: a version that does not know
+    // about it could change the block index before the next one
+    if (!Erase(DB_INDEX_SNAPSHOT, true)) {
+        LogPrintf("%s: failed to invalidate %s\n", __func__, pathSnapshot.string());
+        mapBlockIndex.clear();
+        vSortedByHeight.clear();
+        return false;
+    }
+
+    LogPrintf("%s: loaded %u block index entries from %s\n", __func__, vSortedByHeight.size(), pathSnapshot.string());
+    return true;
+}
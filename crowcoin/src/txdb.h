@@ -6,8 +6,11 @@
 #ifndef CROWCOIN_TXDB_H
 #define CROWCOIN_TXDB_H
 
+#include "amount.h"
 #include "coins.h"
+#include "crypto/muhash.h"
 #include "dbwrapper.h"
+#include "sync.h"
 
 #include <map>
 #include <string>
@@ -16,6 +19,7 @@
 
 class CBlockFileInfo;
 class CBlockIndex;
+struct CBlockLocator;
 struct CDiskTxPos;
 class uint256;
 
@@ -26,19 +30,88 @@ static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache in (MiB)
 static const int64_t nMinDbCache = 4;
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/** Running totals over the unspent outputs in the coin database */
+struct CCoinsTotals
+{
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nSerializedSize;
+    CAmount nTotalAmount;
+    //! Hash of the set of coin database records
+    MuHash3072 muhash;
+
+    CCoinsTotals() : nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(VARINT(nTransactions));
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nSerializedSize));
+        READWRITE(nTotalAmount);
+        READWRITE(muhash);
+    }
+};
+
+/**
+ * CCoinsView backed by the coin database (chainstate/).
+ *
+ * Every unspent output is stored in a record of its own, keyed by txid and
+ * output index, so spending an output only deletes that one record instead
+ * of rewriting all remaining outputs of its transaction, and reading one is a
+ * single lookup.
+ *
+ * The statistics GetStats() reports are kept up to date by BatchWrite() and
+ * stored in the same database batch as the best block, so they never need a
+ * scan of the whole set.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    //! Protects totals, and keeps them in step with the best block on disk.
+    mutable CCriticalSection cs_totals;
+    CCoinsTotals totals;
+    //! False for a database from before totals were kept, until Upgrade() computed them.
+    bool fHaveTotals;
+
+    bool ComputeTotals();
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
+    bool BatchWriteConst(const CCoinsMap &mapCoins, const uint256 &hashBlock);
     bool GetStats(CCoinsStats &stats) const;
+
+    /**
+     * Mark the database as being filled from a UTXO set snapshot, before its
+     * first batch is written, until the chain it leads to is on disk too.
+     * A database still marked at startup has only part of the snapshot.
+     */
+    bool WriteLoadingTxOutSet(bool fLoading);
+    bool ReadLoadingTxOutSet(bool &fLoading) const;
+
+    /**
+     * Convert a chainstate from the old format, with one record per
+     * transaction, to one record per unspent output, and compute the
+     * running totals if the database has none yet. Returns false if that
+     * failed or was interrupted by a shutdown request.
+     */
+    bool Upgrade();
+
+    /**
+     * Return a cursor at the first transaction with unspent outputs, for
+     * ReadCoins(). It keeps seeing the database as it is at this point.
+     */
+    CDBIterator* NewCoinsCursor() const;
+
+    /** Read the next transaction's unspent outputs from pcursor; returns false after the last one. */
+    static bool ReadCoins(CDBIterator* pcursor, uint256& txid, CCoins& coins);
 };
 
 /** Access to the block database (blocks/index/) */
@@ -56,10 +129,27 @@ public:
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    /** Write transaction index entries, and the locator of the last block they cover, in one batch. */
+    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list, const CBlockLocator &locator);
+    bool ReadTxIndexBest(CBlockLocator &locator);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
+
+    /**
+     * Write the whole block index, sorted by height, to a flat snapshot file
+     * that the next LoadBlockIndexSnapshot() can load in one go. It stays
+     * valid until the next WriteBatchSync() or until it has been loaded.
+     */
+    bool WriteBlockIndexSnapshot(const std::vector<const CBlockIndex*>& vSortedByHeight);
+
+    /**
+     * Load the block index from the snapshot file instead of from the
+     * database, returning its entries sorted by height, and invalidate the
+     * snapshot. Returns false, leaving mapBlockIndex empty, if there is no
+     * valid snapshot.
+     */
+    bool LoadBlockIndexSnapshot(std::vector<std::pair<int, CBlockIndex*> >& vSortedByHeight);
 };
 
 #endif // CROWCOIN_TXDB_H
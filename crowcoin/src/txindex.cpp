@@ -0,0 +1,35 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txindex.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "main.h"
+#include "txdb.h"
+
+#include <boost/foreach.hpp>
+
+bool CTxIndexer::ReadBestBlock(CBlockLocator& locator)
+{
+    return pblocktree->ReadTxIndexBest(locator);
+}
+
+bool CTxIndexer::AddBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    BOOST_FOREACH(const CTransaction& tx, block.vtx) {
+        vPos.push_back(std::make_pair(tx.GetHash(), pos));
+        pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+    }
+    return true;
+}
+
+bool CTxIndexer::WriteBatch(const CBlockLocator& locator)
+{
+    if (!pblocktree->WriteTxIndex(vPos, locator))
+        return false;
+    vPos.clear();
+    return true;
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2016 The Crowcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef CROWCOIN_TXINDEX_H
+#define CROWCOIN_TXINDEX_H
+
+#include "chainindexer.h"
+
+#include <utility>
+#include <vector>
+
+struct CDiskTxPos;
+class uint256;
+
+/** Number of transactions the transaction indexer collects before writing them out */
+static const unsigned int TXINDEX_BATCH_SIZE = 20000;
+
+/**
+ * Builds the transaction index (-txindex) in the background, in the block
+ * tree database. As that is enough to switch -txindex on for an existing
+ * node, it doesn't take -reindex. Entries for transactions in disconnected
+ * blocks are kept until the transactions are indexed again, as lookups
+ * check the block they point to anyway.
+ */
+class CTxIndexer : public CChainIndexer
+{
+private:
+    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
+
+protected:
+    const char* GetName() const { return "txindex"; }
+    bool ReadBestBlock(CBlockLocator& locator);
+    bool AddBlock(const CBlock& block, const CBlockIndex* pindex);
+    size_t GetBatchSize() const { return vPos.size(); }
+    size_t GetMaxBatchSize() const { return TXINDEX_BATCH_SIZE; }
+    bool WriteBatch(const CBlockLocator& locator);
+
+public:
+    CTxIndexer(const CChainParams& chainparamsIn) : CChainIndexer(chainparamsIn) {}
+    ~CTxIndexer() { Stop(); }
+};
+
+#endif // CROWCOIN_TXINDEX_H
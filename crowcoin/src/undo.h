@@ -12,17 +12,20 @@
 
 /** Undo information for a CTxIn
  *
- *  Contains the prevout's CTxOut being spent, and if this was the
- *  last output of the affected transaction, its metadata as well
- *  (coinbase or not, height, transaction version)
+ *  Contains the prevout's CTxOut being spent, and its metadata as well
+ *  (coinbase or not, height, transaction version), which is always
+ *  written. Undo data from older versions only has the metadata for the
+ *  last output of the affected transaction, and nHeight == 0 for the
+ *  others; ApplyTxInUndo fills it in from another output of the same
+ *  transaction.
  */
 class CTxInUndo
 {
 public:
     CTxOut txout;         // the txout data before being spent
-    bool fCoinBase;       // if the outpoint was the last unspent: whether it belonged to a coinbase
-    unsigned int nHeight; // if the outpoint was the last unspent: its height
-    int nVersion;         // if the outpoint was the last unspent: its version
+    bool fCoinBase;       // whether the outpoint belonged to a coinbase
+    unsigned int nHeight; // its height, or 0 in older undo data if it was not the last unspent
+    int nVersion;         // its transaction's version
 
     CTxInUndo() : txout(), fCoinBase(false), nHeight(0), nVersion(0) {}
     CTxInUndo(const CTxOut &txoutIn, bool fCoinBaseIn = false, unsigned int nHeightIn = 0, int nVersionIn = 0) : txout(txoutIn), fCoinBase(fCoinBaseIn), nHeight(nHeightIn), nVersion(nVersionIn) { }
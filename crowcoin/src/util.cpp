@@ -72,9 +72,15 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef __linux__
+#include <sched.h>
+#endif
+
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 #include <boost/foreach.hpp>
@@ -783,6 +789,57 @@ void RenameThread(const char* name)
 #endif
 }
 
+#ifdef __linux__
+/** List the online CPUs node by node, so that neighbouring entries share a NUMA node. */
+static std::vector<int> GetCPUsByNUMANode()
+{
+    std::vector<int> vCPUs;
+    for (int nNode = 0; ; nNode++) {
+        boost::filesystem::ifstream file(strprintf("/sys/devices/system/node/node%d/cpulist", nNode));
+        if (!file.good())
+            break;
+        // e.g. "0-7,16-23"
+        std::string strList;
+        std::getline(file, strList);
+        std::vector<std::string> vRanges;
+        boost::split(vRanges, strList, boost::is_any_of(","));
+        BOOST_FOREACH(const std::string& strRange, vRanges) {
+            int nFirst, nLast;
+            int nFields = sscanf(strRange.c_str(), "%d-%d", &nFirst, &nLast);
+            if (nFields < 1)
+                continue;
+            if (nFields == 1)
+                nLast = nFirst;
+            for (int i = nFirst; i <= nLast; i++)
+                vCPUs.push_back(i);
+        }
+    }
+    // No NUMA information (or a kernel without it): use plain CPU numbers.
+    if (vCPUs.empty()) {
+        for (int i = 0; i < (int)boost::thread::hardware_concurrency(); i++)
+            vCPUs.push_back(i);
+    }
+    return vCPUs;
+}
+#endif
+
+bool PinThreadToCPU(int nIndex)
+{
+#ifdef __linux__
+    static const std::vector<int> vCPUs = GetCPUsByNUMANode();
+    if (vCPUs.empty() || nIndex < 0)
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(vCPUs[nIndex % vCPUs.size()], &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    // Prevent warnings for unused parameters...
+    (void)nIndex;
+    return false;
+#endif
+}
+
 void SetupEnvironment()
 {
     // On most POSIX systems (e.g. Linux, but not BSD) the environment's locale
@@ -219,6 +219,13 @@ int GetNumCores();
 void SetThreadPriority(int nPriority);
 void RenameThread(const char* name);
 
+/**
+ * Pin the calling thread to the nIndex'th CPU (modulo the number of CPUs).
+ * CPUs are counted node by node, so threads with adjacent indices stay on
+ * the same NUMA node. Only implemented on Linux; returns false elsewhere.
+ */
+bool PinThreadToCPU(int nIndex);
+
 /**
  * .. and a wrapper that just calls func once
  */
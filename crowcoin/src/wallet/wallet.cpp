@@ -1266,7 +1266,9 @@ bool CWalletTx::RelayWalletTransaction()
     {
         if (GetDepthInMainChain() == 0 && !isAbandoned()) {
             LogPrintf("Relaying wtx %s\n", GetHash().ToString());
-            RelayTransaction((CTransaction)*this);
+            // Share the mempool's copy, if it has one
+            CTransactionRef ptx = mempool.get(GetHash());
+            RelayTransaction(ptx ? ptx : MakeTransactionRef(static_cast<const CTransaction&>(*this)));
             return true;
         }
     }
@@ -3036,5 +3038,5 @@ int CMerkleTx::GetBlocksToMaturity() const
 bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree, bool fRejectAbsurdFee)
 {
     CValidationState state;
-    return ::AcceptToMemoryPool(mempool, state, *this, fLimitFree, NULL, false, fRejectAbsurdFee);
+    return ::AcceptToMemoryPool(mempool, state, MakeTransactionRef(static_cast<const CTransaction&>(*this)), fLimitFree, NULL, false, fRejectAbsurdFee);
 }